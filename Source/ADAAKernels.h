@@ -0,0 +1,503 @@
+/*
+  ==============================================================================
+
+    ADAAKernels.h
+    First and second order antiderivative antialiasing for the first four
+    distortion types. Every curve is expressed in its own input variable
+    u = inGain * x + inOffset, with closed-form first (F1) and second (F2)
+    antiderivatives. The divided differences run in double precision and fall
+    back to evaluating the curve (or F1) at the midpoint when the input barely
+    moves between samples, whether the host's samples are float or double.
+    The saturation curves from Tanh on have no kernels here, getKernel()
+    returns nullptr for them and the processor runs them without.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <vector>
+#include "WaveshaperKernels.h"
+
+namespace ADAAKernels
+{
+    using WaveshaperKernels::BlockParams;
+    using WaveshaperKernels::ParamRamps;
+
+    /** The curve's constants for one block. */
+    struct Coeffs
+    {
+        double inGain, inOffset, outGain;
+        double threshold;
+        double level;       // output of the clippers beyond the threshold
+    };
+
+    //==============================================================================
+    /** Shared shape of the two clippers: an odd polynomial inside the threshold,
+        a constant +-level outside it. Poly supplies the polynomial and its first
+        two antiderivatives.
+    */
+    template <typename Poly>
+    struct Clipper
+    {
+        template <typename Vec>
+        static Vec sign (Vec u) noexcept
+        {
+            return Vec::select (Vec::lessThan (u, Vec::broadcast (0.0)), Vec::broadcast (-1.0), Vec::broadcast (1.0));
+        }
+
+        template <typename Vec>
+        static Vec f (Vec u, const Coeffs& c) noexcept
+        {
+            auto t = Vec::broadcast (c.threshold);
+            return Vec::select (Vec::lessThan (Vec::abs (u), t), Poly::f0 (u), sign (u) * Vec::broadcast (c.level));
+        }
+
+        template <typename Vec>
+        static Vec F1 (Vec u, const Coeffs& c) noexcept
+        {
+            auto m = Vec::min (Vec::abs (u), Vec::broadcast (c.threshold));
+            auto excess = Vec::abs (u) - m;
+            return Poly::f1 (m) + Vec::broadcast (c.level) * excess;
+        }
+
+        template <typename Vec>
+        static Vec F2 (Vec u, const Coeffs& c) noexcept
+        {
+            auto m = Vec::min (Vec::abs (u), Vec::broadcast (c.threshold));
+            auto excess = Vec::abs (u) - m;
+            auto atThreshold = Poly::f1 (Vec::broadcast (c.threshold));
+            return sign (u) * (Poly::f2 (m) + atThreshold * excess + Vec::broadcast (0.5 * c.level) * excess * excess);
+        }
+    };
+
+    struct CubicPoly
+    {
+        template <typename Vec> static Vec f0 (Vec u) noexcept  { return u - u * u * u / Vec::broadcast (3.0); }
+        template <typename Vec> static Vec f1 (Vec u) noexcept  { auto u2 = u * u; return u2 * (Vec::broadcast (0.5) - u2 / Vec::broadcast (12.0)); }
+        template <typename Vec> static Vec f2 (Vec u) noexcept  { auto u2 = u * u; return u * u2 * (Vec::broadcast (1.0 / 6.0) - u2 / Vec::broadcast (60.0)); }
+    };
+
+    struct LinearPoly
+    {
+        template <typename Vec> static Vec f0 (Vec u) noexcept  { return u; }
+        template <typename Vec> static Vec f1 (Vec u) noexcept  { return Vec::broadcast (0.5) * u * u; }
+        template <typename Vec> static Vec f2 (Vec u) noexcept  { return u * u * u / Vec::broadcast (6.0); }
+    };
+
+    struct SoftClip : public Clipper<CubicPoly>
+    {
+        // The soft clip holds at +-2/3 outside the threshold, see WaveshaperKernels::SoftClip
+        static Coeffs getCoeffs (const BlockParams& p) noexcept    { return { p.preGain, 0.0, 1.0, p.threshold, 2.0 / 3.0 }; }
+    };
+
+    struct HardClip : public Clipper<LinearPoly>
+    {
+        static Coeffs getCoeffs (const BlockParams& p) noexcept    { return { p.preGain, 0.0, 1.0, p.threshold, 1.0 }; }
+    };
+
+    //==============================================================================
+    /** foldback() is a triangle wave of period 4t through the origin. Each period
+        integrates to zero, and F1 integrates to 2 t^3 per period.
+    */
+    struct Foldback
+    {
+        static Coeffs getCoeffs (const BlockParams& p) noexcept    { return { p.preGain, 0.0, 1.0, p.threshold, 0.0 }; }
+
+        // Splits u into a whole number of periods and a phase w in [-t, 3t)
+        template <typename Vec>
+        static Vec phase (Vec u, const Coeffs& c, Vec& periods) noexcept
+        {
+            auto t = Vec::broadcast (c.threshold);
+            auto period = Vec::broadcast (4.0 * c.threshold);
+            periods = Vec::floor ((u + t) / period);
+            return u - period * periods;
+        }
+
+        template <typename Vec>
+        static Vec f (Vec u, const Coeffs& c) noexcept
+        {
+            Vec periods;
+            auto w = phase (u, c, periods);
+            auto t = Vec::broadcast (c.threshold);
+            return Vec::select (Vec::lessThanOrEqual (w, t), w, t + t - w);
+        }
+
+        template <typename Vec>
+        static Vec F1 (Vec u, const Coeffs& c) noexcept
+        {
+            Vec periods;
+            auto w = phase (u, c, periods);
+            auto t = Vec::broadcast (c.threshold);
+            auto r = t + t - w;
+            auto half = Vec::broadcast (0.5);
+            return Vec::select (Vec::lessThanOrEqual (w, t), half * w * w, t * t - half * r * r);
+        }
+
+        template <typename Vec>
+        static Vec F2 (Vec u, const Coeffs& c) noexcept
+        {
+            Vec periods;
+            auto w = phase (u, c, periods);
+            auto t = Vec::broadcast (c.threshold);
+            auto r = t + t - w;
+            auto sixth = Vec::broadcast (1.0 / 6.0);
+            auto inPeriod = Vec::select (Vec::lessThanOrEqual (w, t), sixth * w * w * w, t * t * (w - t) + sixth * r * r * r);
+            return periods * Vec::broadcast (2.0 * c.threshold * c.threshold * c.threshold) + inPeriod;
+        }
+    };
+
+    //==============================================================================
+    /** ScoopFold is r * h(u) with u = gainDb * x + r and h(u) = |u - round(u) - 0.25|,
+        which has period 1. With e = u - m in [-0.5, 0.5): h integrates to
+        G(e) over a partial period and to 5/16 over a full one.
+    */
+    struct ScoopFold
+    {
+        static Coeffs getCoeffs (const BlockParams& p) noexcept
+        {
+            // in double, like the direct kernel's double path, so large inputs keep their fold positions
+            auto foldThresh = (double) p.threshold * 10.0;
+            auto foldRatio = 1.0 / foldThresh;
+            return { foldRatio * (p.gainDb * foldThresh), foldRatio, foldRatio, p.threshold, 0.0 };
+        }
+
+        static constexpr double periodArea = 0.3125;
+
+        template <typename Vec>
+        static Vec G (Vec e) noexcept
+        {
+            auto half = Vec::broadcast (0.5);
+            auto q = Vec::broadcast (0.25);
+            auto rising = q * (e + half) - half * (e * e - q);
+            auto tail = e - q;
+            return Vec::select (Vec::lessThanOrEqual (e, q), rising, Vec::broadcast (0.28125) + half * tail * tail);
+        }
+
+        // integral of G from -0.5 to e
+        template <typename Vec>
+        static Vec G2 (Vec e) noexcept
+        {
+            auto half = Vec::broadcast (0.5);
+            auto q = Vec::broadcast (0.25);
+            auto shifted = e + half;
+            auto rising = Vec::broadcast (0.125) * shifted * shifted - e * e * e / Vec::broadcast (6.0)
+                            + Vec::broadcast (0.125) * e + Vec::broadcast (1.0 / 24.0);
+            auto tail = e - q;
+            auto falling = Vec::broadcast (g2AtQuarter) + Vec::broadcast (0.28125) * tail + tail * tail * tail / Vec::broadcast (6.0);
+            return Vec::select (Vec::lessThanOrEqual (e, q), rising, falling);
+        }
+
+        // G2 (0.25) and G2 (0.5), from the polynomial branches above
+        static constexpr double g2AtQuarter = 0.125 * 0.5625 - 0.015625 / 6.0 + 0.03125 + 1.0 / 24.0;
+        static constexpr double g2OverPeriod = g2AtQuarter + 0.28125 * 0.25 + 0.015625 / 6.0;
+
+        template <typename Vec>
+        static Vec f (Vec u, const Coeffs&) noexcept
+        {
+            return Vec::abs (u - Vec::round (u) - Vec::broadcast (0.25));
+        }
+
+        template <typename Vec>
+        static Vec F1 (Vec u, const Coeffs&) noexcept
+        {
+            auto m = Vec::floor (u + Vec::broadcast (0.5));
+            return m * Vec::broadcast (periodArea) + G (u - m);
+        }
+
+        template <typename Vec>
+        static Vec F2 (Vec u, const Coeffs&) noexcept
+        {
+            auto m = Vec::floor (u + Vec::broadcast (0.5));
+            auto e = u - m;
+            auto whole = Vec::broadcast (0.5 * periodArea) * m * (m - Vec::broadcast (1.0)) + m * Vec::broadcast (g2OverPeriod);
+            return whole + m * Vec::broadcast (periodArea) * (e + Vec::broadcast (0.5)) + G2 (e);
+        }
+    };
+
+    //==============================================================================
+    /** The last two raw inputs of a channel, so each block can re-derive its
+        history with the current coefficients.
+    */
+    struct ChannelState
+    {
+        double x1 = 0.0, x2 = 0.0;
+    };
+
+    /** Work buffers shared by all channels, sized in prepare(). */
+    struct Scratch
+    {
+        void prepare (int maxSamples)
+        {
+            for (auto* b : { &x, &u, &integral, &slope })
+                b->assign ((size_t) maxSamples + 2, 0.0);
+        }
+
+        void release()
+        {
+            for (auto* b : { &x, &u, &integral, &slope })
+                *b = {};
+        }
+
+        std::vector<double> x, u, integral, slope;
+    };
+
+    /** Delay of the antialiased output against the input, in samples. */
+    inline double getLatency (int order) noexcept     { return 0.5 * order; }
+
+    /** Fills u from the history and the block's input. With ramps, the input
+        gain follows GAIN per sample, the history uses the ramp's first value.
+        The threshold and output gain stay at the block values, as the
+        antiderivatives are only continuous for a fixed curve.
+    */
+    template <typename Curve, typename T>
+    void mapInput (const double* x, double* u, int historyLength, int numSamples,
+                   const Coeffs& c, const BlockParams& p, const ParamRamps<T>* ramps) noexcept
+    {
+        if (ramps == nullptr)
+        {
+            for (int i = 0; i < numSamples + historyLength; ++i)
+                u[i] = c.inGain * x[i] + c.inOffset;
+
+            return;
+        }
+
+        auto inGainAt = [&] (int i)
+        {
+            return Curve::getCoeffs ({ (float) ramps->preGain[i], (float) ramps->gainDb[i], p.threshold, p.mix }).inGain;
+        };
+
+        const auto historyGain = inGainAt (0);
+
+        for (int i = 0; i < historyLength; ++i)
+            u[i] = historyGain * x[i] + c.inOffset;
+
+        for (int i = 0; i < numSamples; ++i)
+            u[i + historyLength] = inGainAt (i) * x[i + historyLength] + c.inOffset;
+    }
+
+    template <typename Vec, typename T>
+    Vec getMix (const BlockParams& p, const ParamRamps<T>* ramps, int index) noexcept
+    {
+        if (ramps == nullptr)
+            return Vec::broadcast ((double) p.mix);
+
+        double values[Vec::size];
+
+        for (int k = 0; k < Vec::size; ++k)
+            values[k] = (double) ramps->mix[index + k];
+
+        return Vec::load (values);
+    }
+
+    //==============================================================================
+    /** First order: y = (F1 (u[n]) - F1 (u[n-1])) / (u[n] - u[n-1]). The dry signal is
+        the mean of the same two samples, which delays it by the same half sample and is
+        exactly what the antialiased signal is on a straight stretch of the curve.
+    */
+    template <typename Curve, typename T>
+    void processFirstOrder (ChannelState& state, Scratch& scratch, const T* in, T* out,
+                            int numSamples, const BlockParams& p, const ParamRamps<T>* ramps) noexcept
+    {
+        using Vec = typename NativeVec<double>::Type;
+        using Scalar = ScalarVec<double>;
+
+        if (numSamples <= 0)
+            return;
+
+        // Fully dry: just the half sample delay
+        if (ramps == nullptr && p.mix <= 0.0f)
+        {
+            auto previous = state.x1;
+            state.x2 = numSamples > 1 ? (double) in[numSamples - 2] : state.x1;
+            state.x1 = in[numSamples - 1];
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                auto current = (double) in[i];
+                out[i] = (T) (0.5 * (current + previous));
+                previous = current;
+            }
+
+            return;
+        }
+
+        const auto c = Curve::getCoeffs (p);
+        auto* x = scratch.x.data();
+        auto* u = scratch.u.data();
+        auto* F = scratch.integral.data();
+
+        x[0] = state.x1;
+
+        for (int i = 0; i < numSamples; ++i)
+            x[i + 1] = in[i];
+
+        mapInput<Curve> (x, u, 1, numSamples, c, p, ramps);
+
+        auto integrate = [&] (auto vec, int i)
+        {
+            using V = decltype (vec);
+            Curve::F1 (V::load (u + i), c).store (F + i);
+        };
+
+        auto differentiate = [&] (auto vec, int i)
+        {
+            using V = decltype (vec);
+            const auto eps = V::broadcast (1.0e-5);
+            auto u0 = V::load (u + i + 1), u1 = V::load (u + i);
+            auto diff = u0 - u1;
+            auto y = (V::load (F + i + 1) - V::load (F + i)) / diff;
+            auto illConditioned = V::lessThan (V::abs (diff), eps);
+
+            if (V::any (illConditioned))
+                y = V::select (illConditioned, Curve::f (V::broadcast (0.5) * (u0 + u1), c), y);
+
+            auto wet = getMix<V> (p, ramps, i);
+            auto dry = V::broadcast (0.5) * (V::load (x + i + 1) + V::load (x + i));
+            (dry * (V::broadcast (1.0) - wet) + y * V::broadcast (c.outGain) * wet).store (u + i);
+        };
+
+        int i = 0;
+        for (; i + Vec::size <= numSamples + 1; i += Vec::size) integrate (Vec(), i);
+        for (; i <= numSamples; ++i)                           integrate (Scalar(), i);
+
+        // The output overwrites u one step behind the values still being read
+        for (i = 0; i + Vec::size <= numSamples; i += Vec::size) differentiate (Vec(), i);
+        for (; i < numSamples; ++i)                              differentiate (Scalar(), i);
+
+        for (i = 0; i < numSamples; ++i)
+            out[i] = (T) u[i];
+
+        state.x2 = x[numSamples - 1];
+        state.x1 = x[numSamples];
+    }
+
+    /** Second order, after Bilbao et al: the divided difference of F2 is
+        differenced again across three samples. The dry signal is delayed by one
+        sample to line up with the one sample delay of the antialiased signal.
+    */
+    template <typename Curve, typename T>
+    void processSecondOrder (ChannelState& state, Scratch& scratch, const T* in, T* out,
+                             int numSamples, const BlockParams& p, const ParamRamps<T>* ramps) noexcept
+    {
+        using Vec = typename NativeVec<double>::Type;
+        using Scalar = ScalarVec<double>;
+
+        if (numSamples <= 0)
+            return;
+
+        // Fully dry: just the one sample delay
+        if (ramps == nullptr && p.mix <= 0.0f)
+        {
+            auto newX1 = (double) in[numSamples - 1];
+            auto newX2 = numSamples > 1 ? (double) in[numSamples - 2] : state.x1;
+
+            std::copy_backward (in, in + numSamples - 1, out + numSamples);
+            out[0] = (T) state.x1;
+
+            state.x1 = newX1;
+            state.x2 = newX2;
+            return;
+        }
+
+        const auto c = Curve::getCoeffs (p);
+        auto* x = scratch.x.data();
+        auto* u = scratch.u.data();
+        auto* F = scratch.integral.data();
+        auto* D = scratch.slope.data();
+
+        x[0] = state.x2;
+        x[1] = state.x1;
+
+        for (int i = 0; i < numSamples; ++i)
+            x[i + 2] = in[i];
+
+        mapInput<Curve> (x, u, 2, numSamples, c, p, ramps);
+
+        auto integrate = [&] (auto vec, int i)
+        {
+            using V = decltype (vec);
+            Curve::F2 (V::load (u + i), c).store (F + i);
+        };
+
+        // D[i] is the first divided difference between u[i] and u[i - 1]
+        auto firstDifference = [&] (auto vec, int i)
+        {
+            using V = decltype (vec);
+            const auto eps = V::broadcast (1.0e-3);
+            auto u0 = V::load (u + i), u1 = V::load (u + i - 1);
+            auto diff = u0 - u1;
+            auto d = (V::load (F + i) - V::load (F + i - 1)) / diff;
+            auto illConditioned = V::lessThan (V::abs (diff), eps);
+
+            if (V::any (illConditioned))
+                d = V::select (illConditioned, Curve::F1 (V::broadcast (0.5) * (u0 + u1), c), d);
+
+            d.store (D + i);
+        };
+
+        auto secondDifference = [&] (auto vec, int i)
+        {
+            using V = decltype (vec);
+            const auto eps = V::broadcast (1.0e-3);
+            const auto half = V::broadcast (0.5);
+            const auto two = V::broadcast (2.0);
+            auto u0 = V::load (u + i + 2), u1 = V::load (u + i + 1), u2 = V::load (u + i);
+            auto span = u0 - u2;
+            auto y = two * (V::load (D + i + 2) - V::load (D + i + 1)) / span;
+            auto illConditioned = V::lessThan (V::abs (span), eps);
+
+            if (V::any (illConditioned))
+            {
+                auto mean = half * (u0 + u2);
+                auto delta = mean - u1;
+                auto fallback = two / delta * (Curve::F1 (mean, c) + (V::load (F + i + 1) - Curve::F2 (mean, c)) / delta);
+                fallback = V::select (V::lessThan (V::abs (delta), eps), Curve::f (half * (mean + u1), c), fallback);
+                y = V::select (illConditioned, fallback, y);
+            }
+
+            auto wet = getMix<V> (p, ramps, i);
+            (V::load (x + i + 1) * (V::broadcast (1.0) - wet) + y * V::broadcast (c.outGain) * wet).store (u + i);
+        };
+
+        int i = 0;
+        for (; i + Vec::size <= numSamples + 2; i += Vec::size) integrate (Vec(), i);
+        for (; i < numSamples + 2; ++i)                         integrate (Scalar(), i);
+
+        for (i = 1; i + Vec::size <= numSamples + 2; i += Vec::size) firstDifference (Vec(), i);
+        for (; i < numSamples + 2; ++i)                              firstDifference (Scalar(), i);
+
+        for (i = 0; i + Vec::size <= numSamples; i += Vec::size) secondDifference (Vec(), i);
+        for (; i < numSamples; ++i)                              secondDifference (Scalar(), i);
+
+        for (i = 0; i < numSamples; ++i)
+            out[i] = (T) u[i];
+
+        state.x2 = x[numSamples];
+        state.x1 = x[numSamples + 1];
+    }
+
+    //==============================================================================
+    template <typename T>
+    using ChannelKernel = void (*) (ChannelState&, Scratch&, const T*, T*, int, const BlockParams&, const ParamRamps<T>*);
+
+    template <typename Curve, typename T>
+    ChannelKernel<T> getKernelForOrder (int order) noexcept
+    {
+        return order == 2 ? processSecondOrder<Curve, T> : processFirstOrder<Curve, T>;
+    }
+
+    /** Picks the kernel for a TYPE value and an order of 1 or 2, once per block. */
+    template <typename T>
+    ChannelKernel<T> getKernel (int type, int order) noexcept
+    {
+        switch (type)
+        {
+            case WaveshaperKernels::softClip:  return getKernelForOrder<SoftClip, T> (order);
+            case WaveshaperKernels::hardClip:  return getKernelForOrder<HardClip, T> (order);
+            case WaveshaperKernels::foldback:  return getKernelForOrder<Foldback, T> (order);
+            case WaveshaperKernels::scoopFold: return getKernelForOrder<ScoopFold, T> (order);
+            default:                           return nullptr;
+        }
+    }
+}
@@ -0,0 +1,526 @@
+/*
+  ==============================================================================
+
+    CabinetStage.h
+    The optional cabinet impulse response after the distortion. Files are
+    read, resampled to the host rate and partitioned on a shared low-priority
+    TimeSliceThread. A finished PartitionedConvolver is handed to the audio
+    thread through an atomic pointer, and the one it replaces goes back the
+    same way to be deleted, so the audio thread never locks or allocates.
+    A new response crossfades in from the old one.
+
+    The response is kept at its original rate, so it can be stored in the
+    session and resampled again whenever the host rate changes. Instances
+    that load the same response at the same rate share its partitions.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <utility>
+#include "PartitionedConvolver.h"
+#include "SharedCache.h"
+
+class CabinetStage  : private juce::TimeSliceClient
+{
+public:
+    static constexpr double maxResponseSeconds = 1.0;
+    static constexpr int maxResponseChannels = 2;
+    static constexpr double fadeSeconds = 0.02;
+
+    CabinetStage()
+    {
+        thread->addTimeSliceClient (this);
+    }
+
+    ~CabinetStage() override
+    {
+        thread->removeTimeSliceClient (this);
+
+        for (auto* convolver : { current, outgoing, pending.load(), retired.load() })
+            delete convolver;
+    }
+
+    //==============================================================================
+    /** Reads a file in the background. Anything JUCE's basic formats can read is accepted,
+        and only the first maxResponseSeconds of its first two channels are used.
+    */
+    void loadFile (const juce::File& file)
+    {
+        const juce::ScopedLock sl (lock);
+        fileToRead = file;
+    }
+
+    void clearResponse()
+    {
+        const juce::ScopedLock sl (lock);
+        fileToRead = juce::File();
+        setSource ({}, 0.0, {});
+    }
+
+    /** The file the current response came from, empty if there is none or it came from a session. */
+    juce::String getFilePath() const
+    {
+        const juce::ScopedLock sl (lock);
+        return sourcePath;
+    }
+
+    /** The response at the host rate, in samples, once it has been built. */
+    int getTailInSamples() const noexcept       { return tailInSamples.load (std::memory_order_relaxed); }
+
+    /** Blocks until every file and response asked for so far is built, for offline rendering.
+        Returns false on timeout.
+    */
+    bool waitUntilReady (int timeoutMs) const
+    {
+        auto end = juce::Time::getMillisecondCounter() + (juce::uint32) timeoutMs;
+
+        while (! isReady())
+        {
+            if (juce::Time::getMillisecondCounter() >= end)
+                return false;
+
+            juce::Thread::sleep (1);
+        }
+
+        return true;
+    }
+
+    //==============================================================================
+    void writeState (juce::MemoryBlock& destData) const
+    {
+        const juce::ScopedLock sl (lock);
+        juce::MemoryOutputStream stream (destData, false);
+        stream.writeString (sourcePath);
+        stream.writeDouble (sourceRate);
+        stream.writeCompressedInt (source.getNumChannels());
+        stream.writeCompressedInt (source.getNumSamples());
+
+        for (int channel = 0; channel < source.getNumChannels(); ++channel)
+            stream.write (source.getReadPointer (channel), sizeof (float) * (size_t) source.getNumSamples());
+    }
+
+    /** Empty data clears the response. A session stored without the samples reloads the file. */
+    void readState (const void* data, size_t sizeInBytes)
+    {
+        if (data == nullptr || sizeInBytes == 0)
+        {
+            clearResponse();
+            return;
+        }
+
+        juce::MemoryInputStream stream (data, sizeInBytes, false);
+        auto path = stream.readString();
+        auto rate = stream.readDouble();
+        auto numChannels = stream.readCompressedInt();
+        auto numSamples = stream.readCompressedInt();
+
+        if (! juce::isPositiveAndNotGreaterThan (numChannels, maxResponseChannels)
+            || ! juce::isPositiveAndNotGreaterThan (numSamples, juce::roundToInt (maxResponseSeconds * 768000.0))
+            || ! (rate > 0.0) || stream.getNumBytesRemaining() < (juce::int64) (sizeof (float) * (size_t) (numChannels * numSamples)))
+        {
+            if (juce::File::isAbsolutePath (path) && juce::File (path).existsAsFile())
+                loadFile (juce::File (path));
+            else
+                clearResponse();
+
+            return;
+        }
+
+        juce::AudioBuffer<float> samples (numChannels, numSamples);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            stream.read (samples.getWritePointer (channel), (int) sizeof (float) * numSamples);
+
+        const juce::ScopedLock sl (lock);
+        fileToRead = juce::File();
+        setSource (std::move (samples), rate, path);
+    }
+
+    //==============================================================================
+    /** Not on the audio thread. The response is rebuilt for the new rate or layout,
+        and the old one stays in use until it is ready.
+    */
+    void prepare (double sampleRate, int numChannels, int maxBlockSize)
+    {
+        input.setSize (numChannels, maxBlockSize);
+        wet.setSize (numChannels, maxBlockSize);
+        fadeWet.setSize (numChannels, maxBlockSize);
+        fadeLength = juce::jmax (1, juce::roundToInt (sampleRate * fadeSeconds));
+        fresh = true;
+
+        const juce::ScopedLock sl (lock);
+
+        if (sampleRate != targetRate || numChannels != targetChannels)
+        {
+            targetRate = sampleRate;
+            targetChannels = numChannels;
+            ++requestVersion;
+        }
+    }
+
+    void release()
+    {
+        for (auto* buffer : { &input, &wet, &fadeWet })
+            buffer->setSize (0, 0);
+    }
+
+    /** Audio thread: forgets the signal. A response arriving in the next block starts without a fade. */
+    void reset() noexcept
+    {
+        finishFade();
+
+        if (current != nullptr)
+            current->reset();
+
+        fresh = true;
+    }
+
+    /** Audio thread: convolves the channels in place, blending mix of the result with the input.
+        The convolution runs in float in both precisions, the dry signal keeps its own.
+    */
+    template <typename T>
+    void process (T* const* channels, int numChannels, int numSamples, float mix) noexcept
+    {
+        takePending();
+
+        // Only a response taken in the same block as prepare() or reset() has nothing to fade from
+        fresh = false;
+        numChannels = juce::jmin (numChannels, input.getNumChannels());
+
+        if (numChannels == 0 || ((current == nullptr || current->isEmpty()) && fadeRemaining == 0))
+            return;
+
+        for (int start = 0; start < numSamples; start += input.getNumSamples())
+        {
+            auto n = juce::jmin (input.getNumSamples(), numSamples - start);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                if constexpr (std::is_same_v<T, float>)
+                    juce::FloatVectorOperations::copy (input.getWritePointer (channel), channels[channel] + start, n);
+                else
+                    for (int i = 0; i < n; ++i)
+                        input.setSample (channel, i, (float) channels[channel][start + i]);
+            }
+
+            convolve (current, wet, numChannels, n);
+
+            // The old response fades out linearly as the new one fades in
+            if (fadeRemaining > 0)
+            {
+                convolve (outgoing, fadeWet, numChannels, n);
+                auto numFading = juce::jmin (n, fadeRemaining);
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    auto* in = wet.getWritePointer (channel);
+                    auto* out = fadeWet.getReadPointer (channel);
+
+                    for (int i = 0; i < numFading; ++i)
+                    {
+                        auto gain = (float) (fadeRemaining - i) / (float) fadeLength;
+                        in[i] += (out[i] - in[i]) * gain;
+                    }
+                }
+
+                fadeRemaining -= numFading;
+
+                if (fadeRemaining == 0)
+                    finishFade();
+            }
+
+            // MIX glides from the last block's value to this one's
+            auto step = (mix - currentMix) / (float) n;
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                auto* data = channels[channel] + start;
+                auto* processed = wet.getReadPointer (channel);
+
+                for (int i = 0; i < n; ++i)
+                    data[i] += ((T) processed[i] - data[i]) * (T) (currentMix + step * (float) (i + 1));
+            }
+
+            currentMix = mix;
+        }
+    }
+
+private:
+    struct SharedThread  : public juce::TimeSliceThread
+    {
+        SharedThread() : juce::TimeSliceThread ("EZ Distortion Cabinets")   { startThread (Priority::low); }
+        ~SharedThread() override                                            { stopThread (1000); }
+    };
+
+    //==============================================================================
+    // Audio thread
+    void takePending() noexcept
+    {
+        // One response at a time fades out, and the one before it must have been deleted
+        if (fadeRemaining > 0 || retired.load (std::memory_order_acquire) != nullptr)
+            return;
+
+        auto* next = pending.exchange (nullptr, std::memory_order_acq_rel);
+
+        if (next == nullptr)
+            return;
+
+        outgoing = current;
+        current = next;
+        fadeRemaining = fresh ? 0 : fadeLength;
+
+        if (fadeRemaining == 0)
+            finishFade();
+    }
+
+    void finishFade() noexcept
+    {
+        fadeRemaining = 0;
+
+        if (outgoing != nullptr)
+            retired.store (std::exchange (outgoing, nullptr), std::memory_order_release);
+    }
+
+    // Without a response the input passes through, so there is something to fade from and to
+    void convolve (PartitionedConvolver* convolver, juce::AudioBuffer<float>& dest, int numChannels, int numSamples) noexcept
+    {
+        auto numConvolved = convolver != nullptr && ! convolver->isEmpty() ? juce::jmin (numChannels, convolver->getNumChannels()) : 0;
+
+        if (numConvolved > 0)
+            convolver->process (input.getArrayOfReadPointers(), dest.getArrayOfWritePointers(), numConvolved, numSamples);
+
+        for (int channel = numConvolved; channel < numChannels; ++channel)
+            dest.copyFrom (channel, 0, input, channel, 0, numSamples);
+    }
+
+    //==============================================================================
+    // Loader thread
+    int useTimeSlice() override
+    {
+        delete retired.exchange (nullptr, std::memory_order_acq_rel);
+
+        juce::File file;
+
+        {
+            const juce::ScopedLock sl (lock);
+            file = std::exchange (fileToRead, juce::File());
+        }
+
+        if (file != juce::File())
+        {
+            readFile (file);
+            return 1;
+        }
+
+        juce::AudioBuffer<float> response;
+        double rate, hostRate;
+        int numChannels, version;
+
+        {
+            const juce::ScopedLock sl (lock);
+
+            if (requestVersion == builtVersion || targetRate <= 0.0)
+                return 20;
+
+            response.makeCopyOf (source);
+            rate = sourceRate;
+            hostRate = targetRate;
+            numChannels = targetChannels;
+            version = requestVersion;
+        }
+
+        ResponseKey key { hashSamples (response), rate, hostRate, response.getNumChannels(), response.getNumSamples() };
+        auto partitions = cache->getOrBuild (key, [&]
+        {
+            return std::make_unique<PartitionedConvolver::Response> (makeResponse (response, rate, hostRate));
+        });
+
+        auto* convolver = new PartitionedConvolver (partitions, numChannels);
+
+        // one the audio thread never picked up has nothing to fade from, and can go straight away
+        delete pending.exchange (convolver, std::memory_order_acq_rel);
+        tailInSamples.store (partitions->getLength(), std::memory_order_relaxed);
+
+        const juce::ScopedLock sl (lock);
+        builtVersion = version;
+        return 1;
+    }
+
+    void readFile (const juce::File& file)
+    {
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+        std::unique_ptr<juce::AudioFormatReader> reader (formats.createReaderFor (file));
+
+        if (reader == nullptr || reader->sampleRate <= 0.0)
+            return;
+
+        auto numChannels = juce::jmin ((int) reader->numChannels, maxResponseChannels);
+        auto numSamples = (int) juce::jmin (reader->lengthInSamples, (juce::int64) std::ceil (maxResponseSeconds * reader->sampleRate));
+
+        if (numChannels <= 0 || numSamples <= 0)
+            return;
+
+        juce::AudioBuffer<float> samples (numChannels, numSamples);
+        reader->read (&samples, 0, numSamples, 0, true, numChannels > 1);
+
+        const juce::ScopedLock sl (lock);
+        setSource (std::move (samples), reader->sampleRate, file.getFullPathName());
+    }
+
+    /** What a response was built from. The samples are identified by a hash, as comparing them
+        would mean keeping a copy of every source in the cache.
+    */
+    struct ResponseKey
+    {
+        juce::uint64 hash;
+        double sourceRate, hostRate;
+        int numChannels, numSamples;
+
+        bool operator== (const ResponseKey& other) const noexcept
+        {
+            return hash == other.hash && sourceRate == other.sourceRate && hostRate == other.hostRate
+                && numChannels == other.numChannels && numSamples == other.numSamples;
+        }
+    };
+
+    using ResponseCache = SharedCache<ResponseKey, PartitionedConvolver::Response>;
+
+    // 64-bit FNV-1a over the sample bits
+    static juce::uint64 hashSamples (const juce::AudioBuffer<float>& samples) noexcept
+    {
+        juce::uint64 hash = 14695981039346656037ull;
+
+        for (int channel = 0; channel < samples.getNumChannels(); ++channel)
+        {
+            auto* bytes = reinterpret_cast<const juce::uint8*> (samples.getReadPointer (channel));
+
+            for (size_t i = 0; i < sizeof (float) * (size_t) samples.getNumSamples(); ++i)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    /** Resamples to the host rate, trims what is below -100 dB at the end and scales the louder
+        channel to unit energy, so white noise comes out at about the level it went in.
+    */
+    static juce::AudioBuffer<float> makeResponse (const juce::AudioBuffer<float>& samples, double rate, double hostRate)
+    {
+        if (samples.getNumSamples() == 0)
+            return {};
+
+        auto resampled = rate == hostRate ? samples : resample (samples, rate, hostRate);
+        auto peak = resampled.getMagnitude (0, resampled.getNumSamples());
+        auto length = resampled.getNumSamples();
+
+        while (length > 1 && juce::jmax (std::abs (resampled.getSample (0, length - 1)),
+                                         std::abs (resampled.getSample (resampled.getNumChannels() - 1, length - 1))) < peak * 1.0e-5f)
+            --length;
+
+        resampled.setSize (resampled.getNumChannels(), length, true);
+        double energy = 0.0;
+
+        for (int channel = 0; channel < resampled.getNumChannels(); ++channel)
+        {
+            double sum = 0.0;
+
+            for (int i = 0; i < length; ++i)
+                sum += (double) resampled.getSample (channel, i) * resampled.getSample (channel, i);
+
+            energy = juce::jmax (energy, sum);
+        }
+
+        if (energy > 0.0)
+            resampled.applyGain ((float) (1.0 / std::sqrt (energy)));
+
+        return resampled;
+    }
+
+    /** Windowed sinc interpolation, band-limited to the lower of the two rates. Slow,
+        but responses are short and this is only done when one is loaded.
+    */
+    static juce::AudioBuffer<float> resample (const juce::AudioBuffer<float>& samples, double rate, double hostRate)
+    {
+        constexpr int halfWidth = 32;
+        const double pi = juce::MathConstants<double>::pi;
+        auto ratio = rate / hostRate;
+        auto cutoff = juce::jmin (1.0, 1.0 / ratio);
+        auto reach = halfWidth / cutoff;
+        auto numIn = samples.getNumSamples();
+        auto numOut = juce::jmax (1, (int) std::ceil (numIn / ratio));
+
+        juce::AudioBuffer<float> result (samples.getNumChannels(), numOut);
+
+        for (int channel = 0; channel < samples.getNumChannels(); ++channel)
+        {
+            auto* in = samples.getReadPointer (channel);
+            auto* out = result.getWritePointer (channel);
+
+            for (int i = 0; i < numOut; ++i)
+            {
+                auto centre = i * ratio;
+                auto first = juce::jmax (0, (int) std::ceil (centre - reach));
+                auto last = juce::jmin (numIn - 1, (int) std::floor (centre + reach));
+                double sum = 0.0;
+
+                for (int k = first; k <= last; ++k)
+                {
+                    auto x = (k - centre) * cutoff;
+                    auto sinc = x == 0.0 ? 1.0 : std::sin (pi * x) / (pi * x);
+                    auto window = 0.42 + 0.5 * std::cos (pi * x / halfWidth) + 0.08 * std::cos (2.0 * pi * x / halfWidth);
+                    sum += in[k] * sinc * window;
+                }
+
+                out[i] = (float) (sum * cutoff);
+            }
+        }
+
+        return result;
+    }
+
+    //==============================================================================
+    // Both under lock
+    void setSource (juce::AudioBuffer<float> samples, double rate, const juce::String& path)
+    {
+        source = std::move (samples);
+        sourceRate = rate;
+        sourcePath = path;
+        ++requestVersion;
+    }
+
+    bool isReady() const
+    {
+        const juce::ScopedLock sl (lock);
+        return fileToRead == juce::File() && (requestVersion == builtVersion || targetRate <= 0.0);
+    }
+
+    juce::SharedResourcePointer<SharedThread> thread;
+    juce::SharedResourcePointer<ResponseCache> cache;
+
+    // Shared between the message and loader threads, never touched by the audio thread
+    juce::CriticalSection lock;
+    juce::File fileToRead;
+    juce::AudioBuffer<float> source;
+    double sourceRate = 0.0, targetRate = 0.0;
+    juce::String sourcePath;
+    int targetChannels = 0, requestVersion = 0, builtVersion = 0;
+
+    // The loader publishes to pending, the audio thread hands back to retired
+    std::atomic<PartitionedConvolver*> pending { nullptr }, retired { nullptr };
+    std::atomic<int> tailInSamples { 0 };
+
+    // Audio thread only, apart from prepare()
+    PartitionedConvolver* current = nullptr;
+    PartitionedConvolver* outgoing = nullptr;
+    juce::AudioBuffer<float> input, wet, fadeWet;
+    int fadeLength = 1, fadeRemaining = 0;
+    float currentMix = 1.0f;
+    bool fresh = true;
+
+    JUCE_DECLARE_NON_COPYABLE (CabinetStage)
+};
@@ -0,0 +1,112 @@
+/*
+  ==============================================================================
+
+    CurveApproximations.h
+    tanh and atan for the saturation curves, as odd rational functions
+    x P(x^2) / Q(x^2) built from the SIMDVec/ScalarVec operations only, so
+    they vectorise like the rest of the kernels. Each comes in three
+    accuracy tiers. The coefficients are relative minimax fits, so the error
+    stays in proportion near zero as well as in saturation.
+
+    Maximum relative error against libm, in exact arithmetic. Rounding in
+    the sample type adds a few epsilons on top.
+
+                    Fast        Balanced    Precise
+        tanh        3.4e-3      6.6e-5      2.6e-8
+        atan        3.0e-4      5.3e-7      1.0e-9
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "SIMDVec.h"
+
+namespace CurveApproximations
+{
+    enum Accuracy
+    {
+        fast = 0,
+        balanced,
+        precise,
+        numAccuracies
+    };
+
+    /** x P(x^2) / (1 + x^2 Q(x^2)), lowest order first. */
+    struct Rational
+    {
+        int numP, numQ;
+        double p[5], q[4];
+        double maxError;
+    };
+
+    /** Fitted on [0, limit], with the end point pinned to 1 so the curve meets the clamp
+        without a step. Beyond the limit tanh is within maxError of 1.
+    */
+    constexpr double tanhLimits[] = { 3.2, 5.2, 9.1 };
+
+    constexpr Rational tanhRationals[] =
+    {
+        { 2, 1, { 0.99669786449455824, 0.048046715823823361 },
+                { 0.36756254114122016 }, 3.4e-3 },
+
+        { 3, 2, { 0.99993489848350496, 0.10177070926593463, 0.00065084869526967066 },
+                { 0.43471739184345279, 0.012622697720912425 }, 6.6e-5 },
+
+        { 5, 4, { 0.99999997623378464, 0.13372386720728899, 0.0034853680572639141, 2.0442982290369675e-05, 1.3129534034641231e-08 },
+                { 0.46705699663520417, 0.025837992691250553, 0.00032690039334441132, 7.6832921065176491e-07 }, 2.6e-8 }
+    };
+
+    /** Fitted on [0, 1], with atan (1) pinned so the two halves of the range reduction meet. */
+    constexpr Rational atanRationals[] =
+    {
+        { 2, 1, { 0.99970191808113775, 0.19599199448951793 },
+                { 0.52240465460220241 }, 3.0e-4 },
+
+        { 3, 2, { 0.99999947421733145, 0.66399809188483977, 0.041914057748605092 },
+                { 0.99729549745615361, 0.17473864167629536 }, 5.3e-7 },
+
+        { 4, 3, { 0.99999999904455388, 1.1270064962708107, 0.28481107814668171, 0.0088131571696406999 },
+                { 1.4603396978662077, 0.57159386665654568, 0.050109204918192862 }, 1.0e-9 }
+    };
+
+    template <typename Vec>
+    Vec evaluate (const Rational& r, Vec x) noexcept
+    {
+        auto s = x * x;
+        auto p = Vec::broadcast (r.p[r.numP - 1]);
+        auto q = Vec::broadcast (r.q[r.numQ - 1]);
+
+        for (int i = r.numP - 2; i >= 0; --i)
+            p = p * s + Vec::broadcast (r.p[i]);
+
+        for (int i = r.numQ - 2; i >= 0; --i)
+            q = q * s + Vec::broadcast (r.q[i]);
+
+        return x * p / (q * s + Vec::broadcast (1.0f));
+    }
+
+    //==============================================================================
+    template <int accuracy, typename Vec>
+    Vec tanh (Vec x) noexcept
+    {
+        auto limit = Vec::broadcast (tanhLimits[accuracy]);
+        return evaluate (tanhRationals[accuracy], Vec::max (-limit, Vec::min (x, limit)));
+    }
+
+    /** Inputs above 1 go through atan (x) = pi / 2 - atan (1 / x). */
+    template <int accuracy, typename Vec>
+    Vec atan (Vec x) noexcept
+    {
+        auto a = Vec::abs (x);
+        auto one = Vec::broadcast (1.0f);
+        auto above = Vec::greaterThan (a, one);
+        auto y = evaluate (atanRationals[accuracy], Vec::min (a, one) / Vec::max (a, one));
+        y = Vec::select (above, Vec::broadcast (1.57079632679489662) - y, y);
+        return Vec::select (Vec::lessThan (x, Vec::broadcast (0.0f)), -y, y);
+    }
+
+    /** The maximum relative errors above, by accuracy. */
+    inline double getTanhError (int accuracy) noexcept    { return tanhRationals[accuracy].maxError; }
+    inline double getAtanError (int accuracy) noexcept    { return atanRationals[accuracy].maxError; }
+}
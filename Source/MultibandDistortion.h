@@ -0,0 +1,454 @@
+/*
+  ==============================================================================
+
+    MultibandDistortion.h
+    Splits each channel into up to four bands with Linkwitz-Riley crossovers,
+    shapes every band with its own curve and sums them again.
+
+    Rather than a tree of crossovers, every band is the input through the
+    same cascade of three LR4 sections, one per crossover: highpasses for
+    the crossovers below the band, its own lowpass, and allpasses for the
+    crossovers above it, so the bands still sum to an allpass. With every
+    band the same shape of filter, a channel's bands sit in adjacent lanes
+    of a SIMD vector, and filtering and shaping them costs little more than
+    doing it for one band. A crossover that moves glides to its new
+    frequency. The filters run in double in both precisions: at oversampled
+    rates their poles sit so close to 1 that float coefficients and state
+    lose most of their bits, and the bands stop summing to an allpass.
+    Everything is allocated in prepare().
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include "WaveshaperKernels.h"
+#include "ParameterRamp.h"
+
+namespace MultibandDesign
+{
+    constexpr int maxBands = 4;
+    constexpr int maxCrossovers = maxBands - 1;
+
+    // Moving crossovers and tone controls glide for this long, redesigned every glideStep samples
+    constexpr double glideSeconds = 0.05;
+    constexpr int glideStep = 32;
+
+    /** Normalised biquad coefficients, a0 == 1. */
+    struct Biquad
+    {
+        double b0, b1, b2, a1, a2;
+    };
+
+    constexpr Biquad identity { 1.0, 0.0, 0.0, 0.0, 0.0 };
+    constexpr Biquad silence  { 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+    /** The three second-order Butterworth filters behind one LR4 crossover. Two lowpasses
+        plus two highpasses in parallel sum to the allpass.
+    */
+    struct Crossover
+    {
+        Biquad lowpass, highpass, allpass;
+    };
+
+    inline Crossover designCrossover (double frequency, double sampleRate)
+    {
+        const double pi = 3.14159265358979323846;
+        const double q = 1.0 / std::sqrt (2.0);
+        const double k = std::tan (pi * frequency / sampleRate);
+        const double norm = 1.0 / (1.0 + k / q + k * k);
+        const double a1 = 2.0 * (k * k - 1.0) * norm;
+        const double a2 = (1.0 - k / q + k * k) * norm;
+
+        Crossover c;
+        c.lowpass = { k * k * norm, 2.0 * k * k * norm, k * k * norm, a1, a2 };
+        c.highpass = { norm, -2.0 * norm, norm, a1, a2 };
+        c.allpass = { a2, a1, 1.0, a1, a2 };
+        return c;
+    }
+}
+
+//==============================================================================
+template <typename T>
+class MultibandDistortion
+{
+public:
+    using Vec = typename NativeVec<T>::Type;
+    using FilterVec = typename NativeVec<double>::Type;
+
+    static constexpr int maxBands = MultibandDesign::maxBands;
+    static constexpr int maxCrossovers = MultibandDesign::maxCrossovers;
+
+    //==============================================================================
+    void prepare (int newNumChannels)
+    {
+        numChannels = newNumChannels;
+        numLanes = roundUpToVector (numChannels * maxBands);
+
+        for (auto* v : { &b0, &b1, &b2, &a1, &a2, &z1, &z2 })
+            v->assign ((size_t) (numStages * numLanes), 0.0);
+
+        // Unused lanes get harmless curve values, their input is always 0
+        type.assign ((size_t) numLanes, T());
+        preGain.assign ((size_t) numLanes, T (1));
+        gainDb.assign ((size_t) numLanes, T());
+        threshold.assign ((size_t) numLanes, T (1));
+        mix.assign ((size_t) numLanes, T());
+
+        bands.assign ((size_t) (chunkSize * numLanes), T());
+        shaped.assign ((size_t) (chunkSize * numLanes), T());
+
+        // forces the next setCrossovers() to design the filters
+        numBands = 0;
+    }
+
+    void release()
+    {
+        for (auto* v : { &b0, &b1, &b2, &a1, &a2, &z1, &z2 })
+            *v = {};
+
+        for (auto* v : { &type, &preGain, &gainDb, &threshold, &mix, &bands, &shaped })
+            *v = {};
+
+        numChannels = numLanes = numBands = 0;
+    }
+
+    void reset() noexcept
+    {
+        std::fill (z1.begin(), z1.end(), 0.0);
+        std::fill (z2.begin(), z2.end(), 0.0);
+    }
+
+    /** Sets the number of bands and the crossover frequencies between them, sorted and kept below
+        Nyquist. The frequencies glide there at a constant rate in octaves, unless snapToTargets is set
+        or the number of bands or the rate changed, when the filters are redesigned straight away.
+    */
+    void setCrossovers (int newNumBands, const float* frequencies, double sampleRate, bool snapToTargets) noexcept
+    {
+        newNumBands = std::clamp (newNumBands, 1, maxBands);
+        std::array<double, maxCrossovers> sorted {};
+
+        for (int k = 0; k < newNumBands - 1; ++k)
+            sorted[(size_t) k] = std::clamp ((double) frequencies[k], 10.0, 0.45 * sampleRate);
+
+        std::sort (sorted.begin(), sorted.begin() + (newNumBands - 1));
+
+        const auto snap = snapToTargets || newNumBands != numBands || sampleRate != currentSampleRate;
+
+        if (! snap && sorted == crossovers)
+            return;
+
+        // A band that was off has no history worth keeping
+        if (newNumBands != numBands)
+            reset();
+
+        if (sampleRate != currentSampleRate)
+            for (auto& glide : glides)
+                glide.reset ((int) std::lround (sampleRate * MultibandDesign::glideSeconds));
+
+        numBands = newNumBands;
+        crossovers = sorted;
+        currentSampleRate = sampleRate;
+
+        for (size_t k = 0; k < glides.size(); ++k)
+        {
+            if (snap)
+                glides[k].setCurrentAndTargetValue ((float) crossovers[k]);
+            else
+                glides[k].setTargetValue ((float) crossovers[k]);
+        }
+
+        if (snap)
+            design();
+    }
+
+    /** Sets one band's curve. The type is a TYPE value, bands past the current count are ignored. */
+    void setBand (int band, int newType, const WaveshaperKernels::BlockParams& p) noexcept
+    {
+        const auto laneType = band < numBands ? (T) newType : T();
+
+        for (int lane = band; lane < numChannels * maxBands; lane += maxBands)
+        {
+            type[(size_t) lane] = laneType;
+            preGain[(size_t) lane] = (T) p.preGain;
+            gainDb[(size_t) lane] = (T) p.gainDb;
+            threshold[(size_t) lane] = (T) p.threshold;
+            mix[(size_t) lane] = (T) p.mix;
+        }
+    }
+
+    /** The CURVE_ACCURACY tier for the saturation curves, shared by every band. */
+    void setAccuracy (int newAccuracy) noexcept     { accuracy = newAccuracy; }
+
+    int getNumBands() const noexcept    { return numBands; }
+
+    /** Splits, shapes and sums numSamples samples from startSample of each channel, in place. */
+    void process (T* const* channels, int numChannelsToProcess, int startSample, int numSamples) noexcept
+    {
+        numChannelsToProcess = std::min (numChannelsToProcess, numChannels);
+        const int activeLanes = roundUpToVector (numChannelsToProcess * maxBands);
+
+        // While the crossovers glide, the filters are redesigned every glideStep samples
+        for (int done = 0; done < numSamples;)
+        {
+            const auto gliding = isGliding();
+            const int n = std::min (gliding ? MultibandDesign::glideStep : chunkSize, numSamples - done);
+
+            if (gliding)
+            {
+                for (auto& glide : glides)
+                    glide.skip (n);
+
+                design();
+            }
+
+            split (channels, numChannelsToProcess, activeLanes, startSample + done, n);
+            shape (activeLanes, n);
+            sum (channels, numChannelsToProcess, startSample + done, n);
+            done += n;
+        }
+    }
+
+private:
+    // two biquads per LR4 section, one section per crossover
+    static constexpr int numStages = 2 * maxCrossovers;
+
+    // samples per channel that go through the band buffers at a time
+    static constexpr int chunkSize = 256;
+
+    static int roundUpToVector (int lanes) noexcept    { return (lanes + Vec::size - 1) / Vec::size * Vec::size; }
+
+    bool isGliding() const noexcept
+    {
+        return std::any_of (glides.begin(), glides.end(), [] (const ParameterRamp<true>& glide) { return glide.isSmoothing(); });
+    }
+
+    void design() noexcept
+    {
+        std::array<MultibandDesign::Crossover, maxCrossovers> sections;
+
+        for (int k = 0; k < numBands - 1; ++k)
+            sections[(size_t) k] = MultibandDesign::designCrossover (glides[(size_t) k].getCurrentValue(), currentSampleRate);
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            const int band = lane % maxBands;
+            const bool used = lane / maxBands < numChannels && band < numBands;
+
+            for (int k = 0; k < maxCrossovers; ++k)
+            {
+                auto first = MultibandDesign::identity, second = MultibandDesign::identity;
+                auto& section = sections[(size_t) k];
+
+                if (! used)
+                    first = k == 0 ? MultibandDesign::silence : first;
+                else if (k < band && k < numBands - 1)
+                    first = second = section.highpass;
+                else if (k == band && k < numBands - 1)
+                    first = second = section.lowpass;
+                else if (k < numBands - 1)
+                    first = section.allpass;
+
+                setStage (2 * k, lane, first);
+                setStage (2 * k + 1, lane, second);
+            }
+        }
+    }
+
+    void setStage (int stage, int lane, const MultibandDesign::Biquad& c) noexcept
+    {
+        const auto index = (size_t) (stage * numLanes + lane);
+        b0[index] = c.b0;
+        b1[index] = c.b1;
+        b2[index] = c.b2;
+        a1[index] = c.a1;
+        a2[index] = c.a2;
+    }
+
+    /** Runs the band filters, transposed direct form II in double, with the bands interleaved by lane.
+        A double vector is never wider than a T one, so activeLanes is a whole number of them.
+    */
+    void split (T* const* channels, int numChannelsToProcess, int activeLanes, int start, int n) noexcept
+    {
+        // Sections past the last crossover are identity in every lane
+        const int activeStages = 2 * std::max (1, numBands - 1);
+
+        for (int lane = 0; lane < activeLanes; lane += FilterVec::size)
+        {
+            FilterVec cb0[numStages], cb1[numStages], cb2[numStages], ca1[numStages], ca2[numStages];
+            FilterVec s1[numStages], s2[numStages];
+
+            for (int s = 0; s < activeStages; ++s)
+            {
+                const int index = s * numLanes + lane;
+                cb0[s] = FilterVec::load (b0.data() + index);
+                cb1[s] = FilterVec::load (b1.data() + index);
+                cb2[s] = FilterVec::load (b2.data() + index);
+                ca1[s] = FilterVec::load (a1.data() + index);
+                ca2[s] = FilterVec::load (a2.data() + index);
+                s1[s] = FilterVec::load (z1.data() + index);
+                s2[s] = FilterVec::load (z2.data() + index);
+            }
+
+            // With at most four lanes per vector, all of them belong to one channel
+            const int channel = lane / maxBands;
+            const T* source = channel < numChannelsToProcess ? channels[channel] + start : nullptr;
+
+            for (int i = 0; i < n; ++i)
+            {
+                FilterVec x;
+
+                if constexpr (FilterVec::size <= maxBands)
+                {
+                    x = FilterVec::broadcast (source != nullptr ? (double) source[i] : 0.0);
+                }
+                else
+                {
+                    double input[FilterVec::size];
+
+                    for (int j = 0; j < FilterVec::size; ++j)
+                    {
+                        const int c = (lane + j) / maxBands;
+                        input[j] = c < numChannelsToProcess ? (double) channels[c][start + i] : 0.0;
+                    }
+
+                    x = FilterVec::load (input);
+                }
+
+                for (int s = 0; s < activeStages; ++s)
+                {
+                    const auto y = cb0[s] * x + s1[s];
+                    s1[s] = cb1[s] * x - ca1[s] * y + s2[s];
+                    s2[s] = cb2[s] * x - ca2[s] * y;
+                    x = y;
+                }
+
+                if constexpr (std::is_same_v<T, double>)
+                {
+                    x.store (bands.data() + i * numLanes + lane);
+                }
+                else
+                {
+                    double output[FilterVec::size];
+                    x.store (output);
+
+                    for (int j = 0; j < FilterVec::size; ++j)
+                        bands[(size_t) (i * numLanes + lane + j)] = (T) output[j];
+                }
+            }
+
+            for (int s = 0; s < activeStages; ++s)
+            {
+                s1[s].store (z1.data() + s * numLanes + lane);
+                s2[s].store (z2.data() + s * numLanes + lane);
+            }
+        }
+    }
+
+    /** Each curve in use runs once per vector of lanes, and only lands in the lanes that chose it. */
+    void shape (int activeLanes, int n) noexcept
+    {
+        using namespace WaveshaperKernels;
+
+        for (int lane = 0; lane < activeLanes; lane += Vec::size)
+        {
+            const auto laneType = Vec::load (type.data() + lane);
+            const CurveParams<Vec> curve (Vec::load (preGain.data() + lane), Vec::load (gainDb.data() + lane), Vec::load (threshold.data() + lane));
+            bool first = true;
+
+            for (int t = softClip; t <= lastType; ++t)
+            {
+                const auto mask = Vec::lessThan (Vec::abs (laneType - Vec::broadcast ((T) t)), Vec::broadcast ((T) 0.5));
+
+                if (! Vec::any (mask))
+                    continue;
+
+                switch (t)
+                {
+                    case softClip:   shapeLanes<SoftClip> (lane, n, mask, curve, first); break;
+                    case hardClip:   shapeLanes<HardClip> (lane, n, mask, curve, first); break;
+                    case foldback:   shapeLanes<Foldback> (lane, n, mask, curve, first); break;
+                    case scoopFold:  shapeLanes<ScoopFold> (lane, n, mask, curve, first); break;
+                    case tanhClip:   shapeLanesAtAccuracy<TanhClip> (lane, n, mask, curve, first); break;
+                    case arctanClip: shapeLanesAtAccuracy<ArctanClip> (lane, n, mask, curve, first); break;
+                    case tube:       shapeLanesAtAccuracy<Tube> (lane, n, mask, curve, first); break;
+                    case diode:      shapeLanesAtAccuracy<Diode> (lane, n, mask, curve, first); break;
+                    default:         break;
+                }
+
+                first = false;
+            }
+
+            // Lanes without a curve are off bands or padding, and hold 0 already
+            if (first)
+                continue;
+
+            const auto wet = Vec::load (mix.data() + lane);
+
+            for (int i = 0; i < n; ++i)
+            {
+                const auto index = i * numLanes + lane;
+                const auto x = Vec::load (bands.data() + index);
+                (x + (Vec::load (shaped.data() + index) - x) * wet).store (bands.data() + index);
+            }
+        }
+    }
+
+    template <typename Curve>
+    void shapeLanes (int lane, int n, typename Vec::Mask mask, const WaveshaperKernels::CurveParams<Vec>& curve, bool first) noexcept
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            const auto index = i * numLanes + lane;
+            const auto x = Vec::load (bands.data() + index);
+            const auto previous = first ? x : Vec::load (shaped.data() + index);
+            Vec::select (mask, Curve::apply (x, curve), previous).store (shaped.data() + index);
+        }
+    }
+
+    template <template <int> class Curve>
+    void shapeLanesAtAccuracy (int lane, int n, typename Vec::Mask mask, const WaveshaperKernels::CurveParams<Vec>& curve, bool first) noexcept
+    {
+        switch (accuracy)
+        {
+            case CurveApproximations::fast:     shapeLanes<Curve<CurveApproximations::fast>> (lane, n, mask, curve, first); break;
+            case CurveApproximations::balanced: shapeLanes<Curve<CurveApproximations::balanced>> (lane, n, mask, curve, first); break;
+            default:                            shapeLanes<Curve<CurveApproximations::precise>> (lane, n, mask, curve, first); break;
+        }
+    }
+
+    void sum (T* const* channels, int numChannelsToProcess, int start, int n) noexcept
+    {
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+        {
+            auto* out = channels[channel] + start;
+            const T* lanes = bands.data() + channel * maxBands;
+
+            for (int i = 0; i < n; ++i, lanes += numLanes)
+                out[i] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        }
+    }
+
+    //==============================================================================
+    int numChannels = 0, numLanes = 0, numBands = 0;
+    int accuracy = CurveApproximations::balanced;
+    double currentSampleRate = 0.0;
+    std::array<double, maxCrossovers> crossovers {};
+
+    // Where each crossover has got to on its way to crossovers
+    std::array<ParameterRamp<true>, maxCrossovers> glides;
+
+    // stage-major: stage s of lane l is at s * numLanes + l, in double whatever T is
+    std::vector<double> b0, b1, b2, a1, a2, z1, z2;
+
+    // per lane
+    std::vector<T> type, preGain, gainDb, threshold, mix;
+
+    // sample-major: sample i of lane l is at i * numLanes + l
+    std::vector<T> bands, shaped;
+};
@@ -0,0 +1,545 @@
+/*
+  ==============================================================================
+
+    Oversampler.h
+    Cascaded polyphase half-band oversampling, 2x to 16x. Each 2x stage is
+    either a linear-phase half-band FIR (only every other tap is non-zero, so
+    both polyphase branches are cheap) or a minimum-phase two-path allpass IIR.
+    The stages run on groups of channels interleaved into the lanes of a
+    SIMD vector, so the recursive allpasses process several channels for the
+    cost of one. All buffers are allocated in prepare(), nothing allocates
+    while processing.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "SIMDVec.h"
+
+namespace OversamplerDesign
+{
+    /** Kaiser-windowed half-band FIR with 4 * halfOrder + 3 taps, normalised to unity DC gain. */
+    inline std::vector<double> designHalfBandFIR (int halfOrder, double beta)
+    {
+        const int numTaps = 4 * halfOrder + 3;
+        const int centre = numTaps / 2;
+        const double pi = 3.14159265358979323846;
+
+        auto besselI0 = [] (double x)
+        {
+            double sum = 1.0, term = 1.0;
+
+            for (int k = 1; k < 50; ++k)
+            {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+
+            return sum;
+        };
+
+        std::vector<double> taps ((size_t) numTaps, 0.0);
+        double sum = 0.0;
+
+        for (int n = 0; n < numTaps; ++n)
+        {
+            const int offset = n - centre;
+
+            if (offset == 0)
+                taps[(size_t) n] = 0.5;
+            else if (offset % 2 != 0)
+            {
+                const double r = (double) offset / centre;
+                const double window = besselI0 (beta * std::sqrt (1.0 - r * r)) / besselI0 (beta);
+                taps[(size_t) n] = std::sin (0.5 * pi * offset) / (pi * offset) * window;
+            }
+
+            sum += taps[(size_t) n];
+        }
+
+        for (auto& t : taps)
+            t /= sum;
+
+        return taps;
+    }
+
+    /** Allpass coefficients of a two-path polyphase half-band IIR for a given
+        number of coefficients and normalised transition bandwidth (after
+        Laurent de Soras' elliptic design). Even indices belong to the first path.
+    */
+    inline std::vector<double> designHalfBandIIR (int numCoefs, double transition)
+    {
+        const double pi = 3.14159265358979323846;
+
+        double k = std::tan ((1.0 - transition * 2.0) * pi / 4.0);
+        k *= k;
+        const double kksqrt = std::pow (1.0 - k * k, 0.25);
+        const double e = 0.5 * (1.0 - kksqrt) / (1.0 + kksqrt);
+        const double e4 = e * e * e * e;
+        const double q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4)));
+
+        const int order = numCoefs * 2 + 1;
+        std::vector<double> coefs ((size_t) numCoefs);
+
+        for (int index = 0; index < numCoefs; ++index)
+        {
+            const int c = index + 1;
+            double num = 0.0, den = 0.0;
+
+            for (int i = 0, sign = 1; i < 100; ++i, sign = -sign)
+            {
+                const double term = std::pow (q, (double) (i * (i + 1))) * std::sin ((i * 2 + 1) * c * pi / order) * sign;
+                num += term;
+
+                if (std::abs (term) < 1e-100)
+                    break;
+            }
+
+            for (int i = 1, sign = -1; i < 100; ++i, sign = -sign)
+            {
+                const double term = std::pow (q, (double) (i * i)) * std::cos (i * 2 * c * pi / order) * sign;
+                den += term;
+
+                if (std::abs (term) < 1e-100)
+                    break;
+            }
+
+            const double ww = num * std::pow (q, 0.25) / (den + 0.5);
+            const double wwsq = ww * ww;
+            const double x = std::sqrt ((1.0 - wwsq * k) * (1.0 - wwsq / k)) / (1.0 + wwsq);
+            coefs[(size_t) index] = (1.0 - x) / (1.0 + x);
+        }
+
+        return coefs;
+    }
+
+    /** Every instance runs the same stages, so they are designed once per process. The first
+        stage has to be steep, later ones only reject images of already band-limited content.
+    */
+    struct StageDesign
+    {
+        std::vector<double> fir, iir;
+    };
+
+    inline const StageDesign& getStageDesign (int stage)
+    {
+        static const StageDesign designs[] = { { designHalfBandFIR (15, 9.0), designHalfBandIIR (10, 0.04) },
+                                               { designHalfBandFIR (6, 8.0), designHalfBandIIR (4, 0.2) } };
+        return designs[stage == 0 ? 0 : 1];
+    }
+}
+
+//==============================================================================
+/** One linear-phase 2x stage. Each direction delays by the centre tap, at the higher rate.
+    Data is interleaved, one frame of Vec::size channels per sample.
+*/
+template <typename T>
+class HalfBandFIRStage
+{
+public:
+    using Vec = typename NativeVec<T>::Type;
+    static constexpr int lanes = Vec::size;
+
+    void prepare (const std::vector<double>& taps, int numGroups, int maxInputSize)
+    {
+        centre = (int) taps.size() / 2;
+        numTaps = (int) taps.size();
+        evenTaps.clear();
+
+        for (size_t n = 0; n < taps.size(); n += 2)
+            evenTaps.push_back ((T) taps[n]);
+
+        upHistory = (int) evenTaps.size() - 1;
+        downHistory = (int) taps.size() - 1;
+
+        upState.assign ((size_t) numGroups, std::vector<T> ((size_t) ((upHistory + maxInputSize) * lanes), T()));
+        downState.assign ((size_t) numGroups, std::vector<T> ((size_t) ((downHistory + 2 * maxInputSize) * lanes), T()));
+    }
+
+    void reset()
+    {
+        for (auto& s : upState)   std::fill (s.begin(), s.end(), T());
+        for (auto& s : downState) std::fill (s.begin(), s.end(), T());
+    }
+
+    /** Latency of one direction, in samples at the higher rate. */
+    double getLatency() const noexcept    { return (double) centre; }
+
+    /** Length of the up and down impulse responses together, in samples at the higher rate. */
+    double getTail() const noexcept       { return 2.0 * numTaps; }
+
+    /** numSamples frames in, 2 * numSamples frames out. */
+    void processUp (int group, const T* in, T* out, int numSamples) noexcept
+    {
+        auto* x = upState[(size_t) group].data();
+        std::copy (in, in + numSamples * lanes, x + upHistory * lanes);
+
+        const int numEvenTaps = (int) evenTaps.size();
+        const int centreDelay = (centre - 1) / 2;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            // frame upHistory + i is the current input, even taps run backwards from it
+            const T* newest = x + (upHistory + i) * lanes;
+            auto acc = Vec::broadcast (T());
+
+            for (int k = 0; k < numEvenTaps; ++k)
+                acc = acc + Vec::broadcast (evenTaps[(size_t) k]) * Vec::load (newest - k * lanes);
+
+            (acc * Vec::broadcast ((T) 2)).store (out + 2 * i * lanes);
+            Vec::load (newest - centreDelay * lanes).store (out + (2 * i + 1) * lanes);
+        }
+
+        std::copy (x + numSamples * lanes, x + (numSamples + upHistory) * lanes, x);
+    }
+
+    /** 2 * numSamples frames in, numSamples frames out. */
+    void processDown (int group, const T* in, T* out, int numSamples) noexcept
+    {
+        auto* x = downState[(size_t) group].data();
+        std::copy (in, in + 2 * numSamples * lanes, x + downHistory * lanes);
+
+        const int numEvenTaps = (int) evenTaps.size();
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const T* newest = x + (downHistory + 2 * i) * lanes;
+            auto acc = Vec::broadcast (T());
+
+            for (int k = 0; k < numEvenTaps; ++k)
+                acc = acc + Vec::broadcast (evenTaps[(size_t) k]) * Vec::load (newest - 2 * k * lanes);
+
+            (acc + Vec::broadcast ((T) 0.5) * Vec::load (newest - centre * lanes)).store (out + i * lanes);
+        }
+
+        std::copy (x + 2 * numSamples * lanes, x + (2 * numSamples + downHistory) * lanes, x);
+    }
+
+private:
+    std::vector<T> evenTaps;
+    int centre = 0, numTaps = 0, upHistory = 0, downHistory = 0;
+    std::vector<std::vector<T>> upState, downState;
+};
+
+//==============================================================================
+/** One minimum-phase 2x stage: two chains of first-order allpasses running at the lower rate.
+    Data is interleaved like HalfBandFIRStage.
+*/
+template <typename T>
+class HalfBandIIRStage
+{
+public:
+    using Vec = typename NativeVec<T>::Type;
+    static constexpr int lanes = Vec::size;
+
+    void prepare (const std::vector<double>& coefs, int numGroups, int /*maxInputSize*/)
+    {
+        pathA.clear();
+        pathB.clear();
+
+        for (size_t i = 0; i < coefs.size(); ++i)
+            (i % 2 == 0 ? pathA : pathB).push_back ((T) coefs[i]);
+
+        // Group delay at DC per direction, in samples at the higher rate: each section delays
+        // by 2 (1 - a) / (1 + a) there and the two paths are averaged. The unit delay between the
+        // paths adds half a sample going up and removes it coming down, so it is left out.
+        latency = 0.0;
+
+        for (auto a : coefs)
+            latency += (1.0 - a) / (1.0 + a);
+
+        // Each section's pole at -a decays below -120 dB after log (1e-6) / log (a) samples at the lower rate
+        double decayA = 0.0, decayB = 0.0;
+
+        for (size_t i = 0; i < coefs.size(); ++i)
+            (i % 2 == 0 ? decayA : decayB) += coefs[i] > 0.0 ? std::ceil (std::log (1.0e-6) / std::log (coefs[i])) : 1.0;
+
+        tail = 4.0 * std::max (decayA, decayB);
+
+        upState.assign ((size_t) numGroups, State (pathA.size(), pathB.size()));
+        downState.assign ((size_t) numGroups, State (pathA.size(), pathB.size()));
+    }
+
+    void reset()
+    {
+        for (auto& s : upState)   s.clear();
+        for (auto& s : downState) s.clear();
+    }
+
+    double getLatency() const noexcept    { return latency; }
+
+    /** Time for the up and down filters together to ring out, in samples at the higher rate. */
+    double getTail() const noexcept       { return tail; }
+
+    void processUp (int group, const T* in, T* out, int numSamples) noexcept
+    {
+        auto& s = upState[(size_t) group];
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto x = Vec::load (in + i * lanes);
+            runPath (pathA, s.a.data(), x).store (out + 2 * i * lanes);
+            runPath (pathB, s.b.data(), x).store (out + (2 * i + 1) * lanes);
+        }
+    }
+
+    void processDown (int group, const T* in, T* out, int numSamples) noexcept
+    {
+        auto& s = downState[(size_t) group];
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            // the odd input feeds the first path: the second path's extra delay lines them back up
+            auto a = runPath (pathA, s.a.data(), Vec::load (in + (2 * i + 1) * lanes));
+            auto b = runPath (pathB, s.b.data(), Vec::load (in + 2 * i * lanes));
+            (Vec::broadcast ((T) 0.5) * (a + b)).store (out + i * lanes);
+        }
+    }
+
+private:
+    struct State
+    {
+        State (size_t sizeA, size_t sizeB) : a ((sizeA + 1) * lanes, T()), b ((sizeB + 1) * lanes, T()) {}
+        void clear()    { std::fill (a.begin(), a.end(), T()); std::fill (b.begin(), b.end(), T()); }
+
+        // frame 0 is the previous path input, frame n + 1 the previous output of section n
+        std::vector<T> a, b;
+    };
+
+    static Vec runPath (const std::vector<T>& coefs, T* mem, Vec x) noexcept
+    {
+        for (size_t n = 0; n < coefs.size(); ++n)
+        {
+            auto* section = mem + n * lanes;
+            auto y = Vec::broadcast (coefs[n]) * (x - Vec::load (section + lanes)) + Vec::load (section);
+            x.store (section);
+            x = y;
+        }
+
+        x.store (mem + coefs.size() * lanes);
+        return x;
+    }
+
+    std::vector<T> pathA, pathB;
+    double latency = 0.0, tail = 0.0;
+    std::vector<State> upState, downState;
+};
+
+//==============================================================================
+template <typename T>
+class Oversampler
+{
+public:
+    enum FilterType
+    {
+        linearPhase = 0,
+        minimumPhase
+    };
+
+    static constexpr int maxFactorLog2 = 4;
+    static constexpr int lanes = NativeVec<T>::Type::size;
+
+    /** Designs every stage of both filter types and allocates the buffers for 16x. */
+    void prepare (int newNumChannels, int newMaxBlockSize)
+    {
+        numChannels = newNumChannels;
+        maxBlockSize = newMaxBlockSize;
+        const int numGroups = (numChannels + lanes - 1) / lanes;
+
+        for (int stage = 0; stage < maxFactorLog2; ++stage)
+        {
+            const int stageInputSize = maxBlockSize << stage;
+            auto& design = OversamplerDesign::getStageDesign (stage);
+            firStages[stage].prepare (design.fir, numGroups, stageInputSize);
+            iirStages[stage].prepare (design.iir, numGroups, stageInputSize);
+        }
+
+        // One group of channels at a time goes through the stages, ping-ponging between two interleaved buffers
+        const auto maxOversampledSize = (size_t) (maxBlockSize << maxFactorLog2);
+
+        for (auto& b : interleaved)
+            b.assign (maxOversampledSize * lanes, T());
+
+        channelBuffers.assign ((size_t) numChannels, std::vector<T> (maxOversampledSize, T()));
+        oversampled.assign ((size_t) numChannels, nullptr);
+        reset();
+    }
+
+    void release()
+    {
+        for (int stage = 0; stage < maxFactorLog2; ++stage)
+        {
+            firStages[stage] = {};
+            iirStages[stage] = {};
+        }
+
+        for (auto& b : interleaved)
+            b = {};
+
+        channelBuffers = {};
+        oversampled = {};
+        numChannels = maxBlockSize = 0;
+    }
+
+    void reset()
+    {
+        for (int stage = 0; stage < maxFactorLog2; ++stage)
+        {
+            firStages[stage].reset();
+            iirStages[stage].reset();
+        }
+    }
+
+    /** Changes factor or filter type without allocating. Filter state is cleared when either changes. */
+    void setMode (int newFactorLog2, FilterType newFilterType) noexcept
+    {
+        newFactorLog2 = std::clamp (newFactorLog2, 0, maxFactorLog2);
+
+        if (newFactorLog2 != factorLog2 || newFilterType != filterType)
+        {
+            factorLog2 = newFactorLog2;
+            filterType = newFilterType;
+            reset();
+        }
+    }
+
+    int getFactorLog2() const noexcept      { return factorLog2; }
+    int getFactor() const noexcept          { return 1 << factorLog2; }
+    FilterType getFilterType() const noexcept   { return filterType; }
+
+    /** Round-trip (up then down) latency at the base rate. */
+    double getLatencyInSamples() const noexcept     { return getLatencyInSamples (factorLog2, filterType); }
+
+    /** The same for any mode, without switching to it. */
+    double getLatencyInSamples (int forFactorLog2, FilterType forFilterType) const noexcept
+    {
+        double latency = 0.0;
+
+        for (int stage = 0; stage < forFactorLog2; ++stage)
+        {
+            auto stageLatency = forFilterType == linearPhase ? firStages[stage].getLatency()
+                                                             : iirStages[stage].getLatency();
+
+            // both directions run at twice the stage's input rate
+            latency += stageLatency / (double) (1 << stage);
+        }
+
+        return latency;
+    }
+
+    /** How long the filters keep ringing after the input stops, at the base rate. */
+    double getTailInSamples() const noexcept
+    {
+        double tail = 0.0;
+
+        for (int stage = 0; stage < factorLog2; ++stage)
+        {
+            auto stageTail = filterType == linearPhase ? firStages[stage].getTail()
+                                                       : iirStages[stage].getTail();
+            tail += stageTail / (double) (2 << stage);
+        }
+
+        return tail;
+    }
+
+    /** Upsamples the first numChannelsToProcess channels. Afterwards getOversampledData()
+        returns numSamples * getFactor() samples for each of them, which is the channel
+        data itself with a factor of 1.
+    */
+    void processUp (T* const* channelData, int numChannelsToProcess, int numSamples) noexcept
+    {
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+            oversampled[(size_t) channel] = factorLog2 > 0 ? channelBuffers[(size_t) channel].data() : channelData[channel];
+
+        if (factorLog2 == 0)
+            return;
+
+        for (int first = 0, group = 0; first < numChannelsToProcess; first += lanes, ++group)
+        {
+            const int count = std::min (lanes, numChannelsToProcess - first);
+            interleave (channelData + first, count, numSamples, interleaved[0].data());
+
+            for (int stage = 0; stage < factorLog2; ++stage)
+            {
+                auto* source = interleaved[stage % 2].data();
+                auto* dest = interleaved[(stage + 1) % 2].data();
+
+                if (filterType == linearPhase)
+                    firStages[stage].processUp (group, source, dest, numSamples << stage);
+                else
+                    iirStages[stage].processUp (group, source, dest, numSamples << stage);
+            }
+
+            deinterleave (interleaved[factorLog2 % 2].data(), numSamples << factorLog2, oversampled.data() + first, count);
+        }
+    }
+
+    T* getOversampledData (int channel) const noexcept     { return oversampled[(size_t) channel]; }
+
+    /** Brings the oversampled data (as returned by getOversampledData()) back down into channelData. */
+    void processDown (T* const* channelData, int numChannelsToProcess, int numSamples) noexcept
+    {
+        if (factorLog2 == 0)
+            return;
+
+        for (int first = 0, group = 0; first < numChannelsToProcess; first += lanes, ++group)
+        {
+            const int count = std::min (lanes, numChannelsToProcess - first);
+            interleave (oversampled.data() + first, count, numSamples << factorLog2, interleaved[0].data());
+
+            for (int stage = factorLog2, pass = 0; --stage >= 0; ++pass)
+            {
+                auto* source = interleaved[pass % 2].data();
+                auto* dest = interleaved[(pass + 1) % 2].data();
+
+                if (filterType == linearPhase)
+                    firStages[stage].processDown (group, source, dest, numSamples << stage);
+                else
+                    iirStages[stage].processDown (group, source, dest, numSamples << stage);
+            }
+
+            deinterleave (interleaved[factorLog2 % 2].data(), numSamples, channelData + first, count);
+        }
+    }
+
+private:
+    int numChannels = 0, maxBlockSize = 0;
+    int factorLog2 = 0;
+    FilterType filterType = linearPhase;
+
+    HalfBandFIRStage<T> firStages[maxFactorLog2];
+    HalfBandIIRStage<T> iirStages[maxFactorLog2];
+
+    std::vector<T> interleaved[2];
+    std::vector<std::vector<T>> channelBuffers;
+    std::vector<T*> oversampled;
+
+    /** Lane n of each frame takes channel n, lanes past the last channel are zero. */
+    static void interleave (const T* const* channels, int count, int numSamples, T* dest) noexcept
+    {
+        for (int lane = 0; lane < lanes; ++lane)
+        {
+            if (lane < count)
+            {
+                for (int i = 0; i < numSamples; ++i)
+                    dest[i * lanes + lane] = channels[lane][i];
+            }
+            else
+            {
+                for (int i = 0; i < numSamples; ++i)
+                    dest[i * lanes + lane] = T();
+            }
+        }
+    }
+
+    static void deinterleave (const T* source, int numSamples, T* const* channels, int count) noexcept
+    {
+        for (int lane = 0; lane < count; ++lane)
+            for (int i = 0; i < numSamples; ++i)
+                channels[lane][i] = source[i * lanes + lane];
+    }
+};
@@ -0,0 +1,233 @@
+/*
+  ==============================================================================
+
+    ParameterRamp.h
+    A parameter smoother in the spirit of juce::SmoothedValue that writes a
+    whole block of its ramp at once with SIMD. Linear ramps suit the mix and
+    the gain in dB; multiplicative ramps move linear gains at a constant
+    rate in dB. CurveRamps groups the four that drive one curve.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "WaveshaperKernels.h"
+
+template <bool multiplicative>
+class ParameterRamp
+{
+public:
+    /** Sets the ramp length for future target changes. A ramp already running jumps to its target. */
+    void reset (int newLengthInSamples) noexcept
+    {
+        length = newLengthInSamples > 0 ? newLengthInSamples : 1;
+        setCurrentAndTargetValue (target);
+    }
+
+    /** Sets the ramp length for future target changes, as reset() does, but a ramp already
+        running carries on to its target, stretched to take the same time at the new rate.
+    */
+    void setLength (int newLengthInSamples) noexcept
+    {
+        newLengthInSamples = newLengthInSamples > 0 ? newLengthInSamples : 1;
+
+        if (countdown > 0 && newLengthInSamples != length)
+        {
+            countdown = std::max (1, (int) ((long long) countdown * newLengthInSamples / length));
+            step = multiplicative ? std::exp ((std::log (target) - std::log (current)) / (float) countdown)
+                                  : (target - current) / (float) countdown;
+        }
+
+        length = newLengthInSamples;
+    }
+
+    void setCurrentAndTargetValue (float newValue) noexcept
+    {
+        current = target = newValue;
+        countdown = 0;
+    }
+
+    void setTargetValue (float newValue) noexcept
+    {
+        if (newValue == target)
+            return;
+
+        target = newValue;
+
+        // multiplicative ramps can't start from, end at or cross zero
+        if (multiplicative && (current <= 0.0f || target <= 0.0f))
+        {
+            setCurrentAndTargetValue (newValue);
+            return;
+        }
+
+        countdown = length;
+        step = multiplicative ? std::exp ((std::log (target) - std::log (current)) / (float) length)
+                              : (target - current) / (float) length;
+    }
+
+    bool isSmoothing() const noexcept           { return countdown > 0; }
+    float getCurrentValue() const noexcept      { return current; }
+    float getTargetValue() const noexcept       { return target; }
+
+    /** Writes the next numSamples values of the ramp to dest and advances it.
+        The ramp itself is kept in float, dest may be float or double.
+    */
+    template <typename T>
+    void fill (T* dest, int numSamples) noexcept
+    {
+        using Vec = typename NativeVec<T>::Type;
+
+        const int numRamping = countdown < numSamples ? countdown : numSamples;
+        int i = 0;
+
+        if (numRamping >= Vec::size)
+        {
+            // lane k holds the value k + 1 steps ahead, every vector advances by Vec::size steps
+            T offsets[Vec::size];
+            auto lane = multiplicative ? (T) step : T (0);
+
+            for (int k = 0; k < Vec::size; ++k)
+            {
+                offsets[k] = multiplicative ? lane : (T) step * (T) (k + 1);
+                lane *= (T) step;
+            }
+
+            auto advance = Vec::broadcast (multiplicative ? offsets[Vec::size - 1] : (T) step * (T) Vec::size);
+            auto values = multiplicative ? Vec::broadcast ((T) current) * Vec::load (offsets)
+                                         : Vec::broadcast ((T) current) + Vec::load (offsets);
+
+            for (; i + Vec::size <= numRamping; i += Vec::size)
+            {
+                values.store (dest + i);
+                values = multiplicative ? values * advance : values + advance;
+            }
+
+            current = (float) dest[i - 1];
+        }
+
+        for (; i < numRamping; ++i)
+        {
+            current = multiplicative ? current * step : current + step;
+            dest[i] = current;
+        }
+
+        countdown -= numRamping;
+
+        if (countdown == 0)
+            current = target;
+
+        for (; i < numSamples; ++i)
+            dest[i] = target;
+    }
+
+    /** Advances the ramp without writing it out. */
+    void skip (int numSamples) noexcept
+    {
+        if (numSamples >= countdown)
+        {
+            setCurrentAndTargetValue (target);
+            return;
+        }
+
+        current = multiplicative ? current * std::pow (step, (float) numSamples)
+                                 : current + step * (float) numSamples;
+        countdown -= numSamples;
+    }
+
+private:
+    float current = 0.0f, target = 0.0f, step = 0.0f;
+    int length = 1, countdown = 0;
+};
+
+//==============================================================================
+/** The four ramps behind one distortion curve. MIX and GAIN in dB move linearly,
+    the linear pre-gain and threshold move at a constant rate in dB.
+*/
+class CurveRamps
+{
+public:
+    void reset (int newLengthInSamples) noexcept
+    {
+        mix.reset (newLengthInSamples);
+        gainDb.reset (newLengthInSamples);
+        preGain.reset (newLengthInSamples);
+        threshold.reset (newLengthInSamples);
+    }
+
+    void setLength (int newLengthInSamples) noexcept
+    {
+        mix.setLength (newLengthInSamples);
+        gainDb.setLength (newLengthInSamples);
+        preGain.setLength (newLengthInSamples);
+        threshold.setLength (newLengthInSamples);
+    }
+
+    /** Takes the parameter values, GAIN and THRESHOLD in dB. The dB conversions
+        only run when one of them actually moved.
+    */
+    void setTargets (float newMix, float newGainDb, float newThresholdDb, bool snapToTargets) noexcept
+    {
+        if (snapToTargets)
+        {
+            mix.setCurrentAndTargetValue (newMix);
+            gainDb.setCurrentAndTargetValue (newGainDb);
+            preGain.setCurrentAndTargetValue (1.0f + decibelsToGain (newGainDb));
+            threshold.setCurrentAndTargetValue (decibelsToGain (newThresholdDb));
+            thresholdDb = newThresholdDb;
+            return;
+        }
+
+        mix.setTargetValue (newMix);
+
+        if (newGainDb != gainDb.getTargetValue())
+        {
+            gainDb.setTargetValue (newGainDb);
+            preGain.setTargetValue (1.0f + decibelsToGain (newGainDb));
+        }
+
+        if (newThresholdDb != thresholdDb)
+        {
+            thresholdDb = newThresholdDb;
+            threshold.setTargetValue (decibelsToGain (newThresholdDb));
+        }
+    }
+
+    /** True while the curve itself is moving, rather than only the blend. */
+    bool isCurveSmoothing() const noexcept      { return gainDb.isSmoothing() || preGain.isSmoothing() || threshold.isSmoothing(); }
+    bool isSmoothing() const noexcept           { return mix.isSmoothing() || isCurveSmoothing(); }
+
+    /** The values reached so far, for kernels that take one value per block. */
+    WaveshaperKernels::BlockParams getCurrentParams() const noexcept
+    {
+        return { preGain.getCurrentValue(), gainDb.getCurrentValue(), threshold.getCurrentValue(), mix.getCurrentValue() };
+    }
+
+    /** Writes the next numSamples values of each ramp, in the order of ParamRamps. */
+    template <typename T>
+    void fill (T* const* dest, int numSamples) noexcept
+    {
+        preGain.fill (dest[0], numSamples);
+        gainDb.fill (dest[1], numSamples);
+        threshold.fill (dest[2], numSamples);
+        mix.fill (dest[3], numSamples);
+    }
+
+    void skip (int numSamples) noexcept
+    {
+        mix.skip (numSamples);
+        gainDb.skip (numSamples);
+        preGain.skip (numSamples);
+        threshold.skip (numSamples);
+    }
+
+    ParameterRamp<false> mix, gainDb;
+    ParameterRamp<true> preGain, threshold;
+
+private:
+    // as juce::Decibels::decibelsToGain, without the JUCE dependency
+    static float decibelsToGain (float db) noexcept     { return db > -100.0f ? std::pow (10.0f, db * 0.05f) : 0.0f; }
+
+    float thresholdDb = 0.0f;
+};
@@ -0,0 +1,320 @@
+/*
+  ==============================================================================
+
+    PartitionedConvolver.h
+    Zero-latency convolution with a cabinet impulse response, non-uniformly
+    partitioned. The first headSize samples of the response are applied
+    directly in the time domain. The rest is split between levels whose
+    block size grows 8 times at each step, and each level is a uniformly
+    partitioned overlap-save convolution with a frequency-domain delay line.
+    A level's part of the response starts one of its blocks in, so the block
+    it waits for is already part of the response and adds no latency.
+
+    The transformed response is read-only, so instances loading the same
+    one share it. Each convolver only owns its delay lines and transforms.
+    Everything is allocated on construction, off the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+class PartitionedConvolver
+{
+public:
+    static constexpr int headSize = 64;
+    static constexpr int levelGrowthLog2 = 3;
+    static constexpr int maxNumLevels = 3;      // blocks of 64, 512 and 4096 samples
+
+    /** The partitioned and transformed impulse response. */
+    class Response
+    {
+    public:
+        /** response holds one impulse response per channel, already at the rate it will run at.
+            Channels past the response's last one use its last.
+        */
+        explicit Response (const juce::AudioBuffer<float>& response)
+            : numResponses (juce::jmax (1, response.getNumChannels())),
+              length (response.getNumSamples())
+        {
+            // The head's taps are reversed, so each output is a forward dot product with the history
+            headTaps.assign ((size_t) (numResponses * headSize), 0.0f);
+
+            for (int r = 0; r < response.getNumChannels(); ++r)
+                for (int i = 0; i < juce::jmin (headSize, length); ++i)
+                    headTaps[(size_t) (r * headSize + headSize - 1 - i)] = response.getSample (r, i);
+
+            for (int blockSize = headSize, index = 0; blockSize < length && index < maxNumLevels; blockSize <<= levelGrowthLog2, ++index)
+            {
+                auto isLast = index == maxNumLevels - 1 || (blockSize << levelGrowthLog2) >= length;
+                addLevel (response, blockSize, isLast ? length : (blockSize << levelGrowthLog2));
+            }
+        }
+
+        int getLength() const noexcept     { return length; }
+
+        /** Bytes held, for seeing what sharing saves. */
+        size_t getMemoryUsage() const noexcept
+        {
+            auto bytes = headTaps.size();
+
+            for (auto& level : levels)
+                bytes += level.re.size() + level.im.size();
+
+            return bytes * sizeof (float);
+        }
+
+    private:
+        friend class PartitionedConvolver;
+
+        struct Level
+        {
+            int blockSize, numBins, numPartitions;
+
+            // partition p of response r is at (r * numPartitions + p) * numBins
+            std::vector<float> re, im;
+        };
+
+        // Each partition is zero padded to two blocks, for overlap-save
+        void addLevel (const juce::AudioBuffer<float>& response, int blockSize, int end)
+        {
+            Level level { blockSize, blockSize + 1, (end - blockSize + blockSize - 1) / blockSize, {}, {} };
+            level.re.assign ((size_t) (numResponses * level.numPartitions * level.numBins), 0.0f);
+            level.im.assign (level.re.size(), 0.0f);
+
+            juce::dsp::FFT fft (juce::roundToInt (std::log2 (2 * blockSize)));
+            std::vector<float> buffer ((size_t) (4 * blockSize));
+
+            for (int r = 0; r < response.getNumChannels(); ++r)
+            {
+                for (int p = 0; p < level.numPartitions; ++p)
+                {
+                    auto start = blockSize + p * blockSize;
+                    std::fill (buffer.begin(), buffer.end(), 0.0f);
+                    std::copy_n (response.getReadPointer (r, start), juce::jmin (blockSize, end - start), buffer.begin());
+                    fft.performRealOnlyForwardTransform (buffer.data(), true);
+
+                    auto offset = (size_t) ((r * level.numPartitions + p) * level.numBins);
+                    deinterleave (buffer.data(), level.re.data() + offset, level.im.data() + offset, level.numBins);
+                }
+            }
+
+            levels.push_back (std::move (level));
+        }
+
+        const float* getHeadTaps (int channel) const noexcept
+        {
+            return headTaps.data() + juce::jmin (channel, numResponses - 1) * headSize;
+        }
+
+        const int numResponses, length;
+        std::vector<float> headTaps;
+        std::vector<Level> levels;
+
+        JUCE_DECLARE_NON_COPYABLE (Response)
+    };
+
+    //==============================================================================
+    PartitionedConvolver (std::shared_ptr<const Response> responseToUse, int numChannelsToUse)
+        : response (std::move (responseToUse)),
+          numChannels (numChannelsToUse)
+    {
+        headHistory.assign ((size_t) (numChannels * (headSize - 1 + headChunk)), 0.0f);
+
+        for (auto& level : response->levels)
+            levels.push_back (std::make_unique<Level> (level, numChannels));
+    }
+
+    int getNumChannels() const noexcept     { return numChannels; }
+    int getLength() const noexcept          { return response->length; }
+    bool isEmpty() const noexcept           { return response->length == 0; }
+
+    void reset() noexcept
+    {
+        std::fill (headHistory.begin(), headHistory.end(), 0.0f);
+
+        for (auto& level : levels)
+            level->reset();
+    }
+
+    /** Convolves numSamples samples of each input channel into the matching output, which must not
+        be the same memory. Channels from getNumChannels() on are left alone.
+    */
+    void process (const float* const* input, float* const* output, int numChannelsToProcess, int numSamples) noexcept
+    {
+        numChannelsToProcess = juce::jmin (numChannelsToProcess, numChannels);
+
+        processHead (input, output, numChannelsToProcess, numSamples);
+
+        for (auto& level : levels)
+            level->process (input, output, numChannelsToProcess, numSamples, response->numResponses);
+    }
+
+private:
+    // samples per channel that go through the head's history at a time
+    static constexpr int headChunk = 256;
+
+    // The transforms give interleaved bins, the products run faster on separate halves
+    static void deinterleave (const float* bins, float* re, float* im, int numBins) noexcept
+    {
+        for (int k = 0; k < numBins; ++k)
+        {
+            re[k] = bins[2 * k];
+            im[k] = bins[2 * k + 1];
+        }
+    }
+
+    void processHead (const float* const* input, float* const* output, int numChannelsToProcess, int numSamples) noexcept
+    {
+        for (int done = 0; done < numSamples; done += headChunk)
+        {
+            auto n = juce::jmin (headChunk, numSamples - done);
+
+            for (int channel = 0; channel < numChannelsToProcess; ++channel)
+            {
+                auto* history = headHistory.data() + channel * (headSize - 1 + headChunk);
+                auto* taps = response->getHeadTaps (channel);
+                auto* out = output[channel] + done;
+
+                juce::FloatVectorOperations::copy (history + headSize - 1, input[channel] + done, n);
+                juce::FloatVectorOperations::clear (out, n);
+
+                // a tap at a time, so the inner loop runs along the samples and vectorises
+                for (int tap = 0; tap < headSize; ++tap)
+                    if (taps[tap] != 0.0f)
+                        juce::FloatVectorOperations::addWithMultiply (out, history + tap, taps[tap], n);
+
+                std::copy (history + n, history + n + headSize - 1, history);
+            }
+        }
+    }
+
+    //==============================================================================
+    /** One uniformly partitioned level: the response from blockSize on, in blocks of blockSize. */
+    struct Level
+    {
+        Level (const Response::Level& partitionsToUse, int numChannels)
+            : partitions (partitionsToUse),
+              blockSize (partitions.blockSize),
+              numBins (partitions.numBins),
+              numPartitions (partitions.numPartitions),
+              fft (juce::roundToInt (std::log2 (2 * blockSize)))
+        {
+            fftBuffer.assign ((size_t) (4 * blockSize), 0.0f);
+            frames.assign ((size_t) (numChannels * 2 * blockSize), 0.0f);
+            spectraRe.assign ((size_t) (numChannels * numPartitions * numBins), 0.0f);
+            spectraIm.assign ((size_t) (numChannels * numPartitions * numBins), 0.0f);
+            outputs.assign ((size_t) (numChannels * blockSize), 0.0f);
+            sumRe.assign ((size_t) numBins, 0.0f);
+            sumIm.assign ((size_t) numBins, 0.0f);
+        }
+
+        void reset() noexcept
+        {
+            for (auto* v : { &frames, &spectraRe, &spectraIm, &outputs })
+                std::fill (v->begin(), v->end(), 0.0f);
+
+            position = newest = 0;
+        }
+
+        /** Adds this level's part to the output. Each block computed when the input fills one is
+            played out over the next, which is exactly where this level's part of the response starts.
+        */
+        void process (const float* const* input, float* const* output, int numChannels, int numSamples, int numResponses) noexcept
+        {
+            for (int done = 0; done < numSamples;)
+            {
+                auto n = juce::jmin (numSamples - done, blockSize - position);
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    juce::FloatVectorOperations::copy (getFrame (channel) + blockSize + position, input[channel] + done, n);
+                    juce::FloatVectorOperations::add (output[channel] + done, getOutput (channel) + position, n);
+                }
+
+                done += n;
+                position += n;
+
+                if (position == blockSize)
+                {
+                    position = 0;
+                    newest = newest + 1 < numPartitions ? newest + 1 : 0;
+
+                    for (int channel = 0; channel < numChannels; ++channel)
+                        transform (channel, juce::jmin (channel, numResponses - 1));
+                }
+            }
+        }
+
+        /** The last two input blocks go into the delay line, which is multiplied by the partitions,
+            and the second half of the inverse transform is the next output block.
+        */
+        void transform (int channel, int r) noexcept
+        {
+            auto* frame = getFrame (channel);
+            std::copy_n (frame, 2 * blockSize, fftBuffer.begin());
+            std::fill (fftBuffer.begin() + 2 * blockSize, fftBuffer.end(), 0.0f);
+            std::copy_n (frame + blockSize, blockSize, frame);
+
+            fft.performRealOnlyForwardTransform (fftBuffer.data(), true);
+            deinterleave (fftBuffer.data(), getSpectrumRe (channel, newest), getSpectrumIm (channel, newest), numBins);
+
+            std::fill (sumRe.begin(), sumRe.end(), 0.0f);
+            std::fill (sumIm.begin(), sumIm.end(), 0.0f);
+
+            for (int p = 0; p < numPartitions; ++p)
+            {
+                auto slot = newest - p >= 0 ? newest - p : newest - p + numPartitions;
+                auto* xr = getSpectrumRe (channel, slot);
+                auto* xi = getSpectrumIm (channel, slot);
+                auto* hr = partitions.re.data() + (r * numPartitions + p) * numBins;
+                auto* hi = partitions.im.data() + (r * numPartitions + p) * numBins;
+
+                for (int k = 0; k < numBins; ++k)
+                {
+                    sumRe[(size_t) k] += xr[k] * hr[k] - xi[k] * hi[k];
+                    sumIm[(size_t) k] += xr[k] * hi[k] + xi[k] * hr[k];
+                }
+            }
+
+            for (int k = 0; k < numBins; ++k)
+            {
+                fftBuffer[(size_t) (2 * k)] = sumRe[(size_t) k];
+                fftBuffer[(size_t) (2 * k + 1)] = sumIm[(size_t) k];
+            }
+
+            fft.performRealOnlyInverseTransform (fftBuffer.data());
+            std::copy_n (fftBuffer.begin() + blockSize, blockSize, getOutput (channel));
+        }
+
+        float* getSpectrumRe (int c, int slot) noexcept { return spectraRe.data() + (c * numPartitions + slot) * numBins; }
+        float* getSpectrumIm (int c, int slot) noexcept { return spectraIm.data() + (c * numPartitions + slot) * numBins; }
+        float* getFrame (int c) noexcept                { return frames.data() + c * 2 * blockSize; }
+        float* getOutput (int c) noexcept               { return outputs.data() + c * blockSize; }
+
+        const Response::Level& partitions;
+        const int blockSize, numBins, numPartitions;
+
+        // Not shared: JUCE's fallback FFT locks around its scratch space
+        juce::dsp::FFT fft;
+        int position = 0, newest = 0;
+
+        // per channel: the delay line of past input spectra, the last two input blocks,
+        // and the output block being played out
+        std::vector<float> spectraRe, spectraIm, frames, outputs;
+        std::vector<float> fftBuffer, sumRe, sumIm;
+    };
+
+    //==============================================================================
+    const std::shared_ptr<const Response> response;
+    const int numChannels;
+    std::vector<float> headHistory;
+    std::vector<std::unique_ptr<Level>> levels;
+
+    JUCE_DECLARE_NON_COPYABLE (PartitionedConvolver)
+};
@@ -15,9 +15,28 @@ EZDistortionAudioProcessorEditor::EZDistortionAudioProcessorEditor (EZDistortion
 {
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (400, 360);
+    setSize (620, 360);
+    setOpaque(true);
+    setWantsKeyboardFocus(true);
     Timer::startTimerHz(20);
 
+    addChildComponent(performancePanel);
+
+    auto cabinetFile = audioProcessor.cabinet.getFilePath();
+    cabinetButton.setButtonText(cabinetFile.isEmpty() ? "Load Cabinet IR" : File(cabinetFile).getFileNameWithoutExtension());
+    cabinetButton.onClick = [this] { chooseCabinetFile(); };
+    addAndMakeVisible(cabinetButton);
+
+    savePresetButton.onClick = [this] { saveUserPreset(); };
+    addAndMakeVisible(savePresetButton);
+
+    for (auto* id : { "MIX", "GAIN", "THRESHOLD", "TYPE" })
+        audioProcessor.apvts.addParameterListener(id, this);
+
+    // The processor only meters while an editor is open
+    audioProcessor.signalTap.drain();
+    audioProcessor.signalTap.setActive(true);
+
     using SliderAttachment = juce::AudioProcessorValueTreeState::SliderAttachment;
     using BoxAttachment = juce::AudioProcessorValueTreeState::ComboBoxAttachment;
     mixAttachment = std::make_unique<SliderAttachment>(audioProcessor.apvts, "MIX", mixSlider);
@@ -38,15 +57,71 @@ EZDistortionAudioProcessorEditor::EZDistortionAudioProcessorEditor (EZDistortion
 
 EZDistortionAudioProcessorEditor::~EZDistortionAudioProcessorEditor()
 {
+    audioProcessor.signalTap.setActive(false);
+
+    for (auto* id : { "MIX", "GAIN", "THRESHOLD", "TYPE" })
+        audioProcessor.apvts.removeParameterListener(id, this);
 }
 
 //==============================================================================
 void EZDistortionAudioProcessorEditor::paint (juce::Graphics& g)
 {
-    auto sliderPosGain =  Decibels::decibelsToGain(gainSlider.getValue()) / Decibels::decibelsToGain(gainSlider.getMaximum());
-    auto sliderPosThreshold = Decibels::decibelsToGain(thresholdSlider.getValue()) / Decibels::decibelsToGain(thresholdSlider.getMaximum());
-    auto sliderPosMix = mixSlider.getValue() / mixSlider.getMaximum();
-    auto titleFont = Font("Euphemia UCAS", 60.0f, Font::plain);
+    auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+
+    if (background.isNull() || background.getWidth() != roundToInt((float) getWidth() * scale))
+        renderBackground(scale);
+
+    g.drawImage(background, getLocalBounds().toFloat());
+
+    // Only what lies in the area being repainted is drawn again
+    if (g.clipRegionIntersects(getKnobArea(mixSlider)))
+    {
+        auto sliderPosMix = mixSlider.getValue() / mixSlider.getMaximum();
+        drawRotarySlider(g, mixSlider.getX(), mixSlider.getY(), sliderWidthAndHeight, sliderWidthAndHeight, sliderPosMix, 4 * M_PI / 3, 8*M_PI/3, mixSlider, String("Mix"));
+    }
+
+    if (g.clipRegionIntersects(getKnobArea(gainSlider)))
+    {
+        auto sliderPosGain =  Decibels::decibelsToGain(gainSlider.getValue()) / Decibels::decibelsToGain(gainSlider.getMaximum());
+        drawRotarySlider(g, gainSlider.getX(), gainSlider.getY(), sliderWidthAndHeight, sliderWidthAndHeight, sliderPosGain, 4 * M_PI / 3, 8 * M_PI /3, gainSlider, String("Gain"));
+    }
+
+    if (g.clipRegionIntersects(getKnobArea(thresholdSlider)))
+    {
+        auto sliderPosThreshold = Decibels::decibelsToGain(thresholdSlider.getValue()) / Decibels::decibelsToGain(thresholdSlider.getMaximum());
+        drawRotarySlider(g, thresholdSlider.getX(), thresholdSlider.getY(), sliderWidthAndHeight, sliderWidthAndHeight, sliderPosThreshold , 4 * M_PI / 3, 8 * M_PI /3, thresholdSlider, String("Threshold"));
+    }
+
+    if (g.clipRegionIntersects(paramTextArea))
+        drawParamText(g);
+
+    if (g.clipRegionIntersects(transferCurveArea.toNearestInt()))
+        drawTransferCurve(g, transferCurveArea);
+
+    if (g.clipRegionIntersects(meterArea.toNearestInt()))
+        drawMeters(g, meterArea);
+
+    if (g.clipRegionIntersects(scopeArea.toNearestInt()))
+        drawScope(g, scopeArea);
+}
+
+static void drawDisplayBackground(Graphics& g, Rectangle<float> area, const String& label)
+{
+    g.setColour(Colours::grey);
+    g.setOpacity(.5);
+    g.fillRoundedRectangle(area, 10);
+    g.setColour(Colours::white);
+    g.drawRoundedRectangle(area, 10, 2);
+    g.setFont(14.0f);
+    g.drawFittedText(label, area.toNearestInt().translated(0, -18).withHeight(18), Justification::centred, 1);
+}
+
+void EZDistortionAudioProcessorEditor::renderBackground(float scale)
+{
+    background = Image(Image::RGB, roundToInt((float) getWidth() * scale), roundToInt((float) getHeight() * scale), true);
+    Graphics g(background);
+    g.addTransform(AffineTransform::scale(scale));
+
     auto fillRect2 = Rectangle<float>(mixSlider.getX()-5, mixSlider.getY() - 5, mixSlider.getWidth()+10, mixSlider.getHeight() + 25);
     g.fillAll (Colours::black);
     g.setFont(titleFont);
@@ -58,13 +133,22 @@ void EZDistortionAudioProcessorEditor::paint (juce::Graphics& g)
     g.fillRoundedRectangle(fillRect2, 10);
     g.setColour(Colours::white);
     g.drawRoundedRectangle(fillRect2, 10, 2);
-    
+
     drawGroupRectangle(gainSlider, thresholdSlider, String("Stuff"), g);
-    drawRotarySlider(g, mixSlider.getX(), mixSlider.getY(), sliderWidthAndHeight, sliderWidthAndHeight, sliderPosMix, 4 * M_PI / 3, 8*M_PI/3, mixSlider, String("Mix"));
-    drawRotarySlider(g, gainSlider.getX(), gainSlider.getY(), sliderWidthAndHeight, sliderWidthAndHeight, sliderPosGain, 4 * M_PI / 3, 8 * M_PI /3, gainSlider, String("Gain"));
-    drawRotarySlider(g, thresholdSlider.getX(), thresholdSlider.getY(), sliderWidthAndHeight, sliderWidthAndHeight, sliderPosThreshold , 4 * M_PI / 3, 8 * M_PI /3, thresholdSlider, String("Threshold"));
-    drawParamText(g);
+    drawDisplayBackground(g, transferCurveArea, "Curve");
+    drawDisplayBackground(g, meterArea, "Levels");
+    drawDisplayBackground(g, scopeArea, "Output");
+
+    auto plot = transferCurveArea.reduced(8);
+    g.setColour(Colours::white.withAlpha(.3f));
+    g.drawHorizontalLine(roundToInt(plot.getCentreY()), plot.getX(), plot.getRight());
+    g.drawVerticalLine(roundToInt(plot.getCentreX()), plot.getY(), plot.getBottom());
+}
 
+Rectangle<int> EZDistortionAudioProcessorEditor::getKnobArea(const Slider& slider) const
+{
+    // drawRotarySlider puts the label just under the knob
+    return slider.getBounds().withHeight(slider.getHeight() + 25).expanded(2);
 }
 
 void EZDistortionAudioProcessorEditor::resized()
@@ -73,6 +157,10 @@ void EZDistortionAudioProcessorEditor::resized()
     mixSlider.setBounds(row1X, distortionType.getBottom() + distanceBetweenSlidersVertical, sliderWidthAndHeight, sliderWidthAndHeight);
     gainSlider.setBounds(mixSlider.getRight()+horizontalDistance, column1Y, sliderWidthAndHeight, sliderWidthAndHeight);
     thresholdSlider.setBounds(gainSlider.getX(), gainSlider.getBottom()+distanceBetweenSlidersVertical, sliderWidthAndHeight, sliderWidthAndHeight);
+    performancePanel.setBounds(transferCurveArea.getUnion(scopeArea).toNearestInt());
+    cabinetButton.setBounds(meterArea.toNearestInt().getX(), 24, roundToInt(meterArea.getWidth()), 24);
+    savePresetButton.setBounds(transferCurveArea.toNearestInt().getX(), 24, roundToInt(transferCurveArea.getWidth()), 24);
+    background = {};
 }
 void EZDistortionAudioProcessorEditor::drawParamText(Graphics &g)
 {
@@ -104,7 +192,312 @@ void EZDistortionAudioProcessorEditor::drawParamText(Graphics &g)
     g.setOpacity(.5);
     g.drawRoundedRectangle(textRect, 10, 2);
 }
+void EZDistortionAudioProcessorEditor::drawTransferCurve(Graphics& g, Rectangle<float> area)
+{
+    // Same curve and blend as the processor, from -1 to 1 in and -1.5 to 1.5 out
+    auto gainDb = audioProcessor.apvts.getRawParameterValue("GAIN")->load();
+    WaveshaperKernels::BlockParams params;
+    params.preGain = 1 + Decibels::decibelsToGain(gainDb);
+    params.gainDb = gainDb;
+    params.threshold = Decibels::decibelsToGain(audioProcessor.apvts.getRawParameterValue("THRESHOLD")->load());
+    params.mix = audioProcessor.apvts.getRawParameterValue("MIX")->load();
+    auto accuracy = (int) audioProcessor.apvts.getRawParameterValue("CURVE_ACCURACY")->load();
+    auto curve = WaveshaperKernels::getCurve<float>((int) audioProcessor.apvts.getRawParameterValue("TYPE")->load(), accuracy);
+
+    auto plot = area.reduced(8);
+    Path path;
+    const int numPoints = (int) plot.getWidth();
+
+    for (int i = 0; i <= numPoints; ++i)
+    {
+        auto x = 2.0f * (float) i / (float) numPoints - 1.0f;
+        auto wet = curve != nullptr ? curve(x, params) : 0.0f;
+        auto y = jlimit(-1.5f, 1.5f, x * (1 - params.mix) + wet * params.mix);
+        auto point = Point<float>(plot.getX() + (float) i, plot.getCentreY() - y / 1.5f * plot.getHeight() * 0.5f);
+
+        if (i == 0)
+            path.startNewSubPath(point);
+        else
+            path.lineTo(point);
+    }
+
+    g.setColour(Colours::skyblue);
+    g.strokePath(path, PathStrokeType(2.0f));
+}
+
+void EZDistortionAudioProcessorEditor::drawMeters(Graphics& g, Rectangle<float> area)
+{
+    const float minDb = -60, maxDb = 6;
+    auto toY = [&](Rectangle<float> bar, float gain)
+    {
+        auto db = jlimit(minDb, maxDb, Decibels::gainToDecibels(gain, minDb));
+        return jmap(db, minDb, maxDb, bar.getBottom(), bar.getY());
+    };
+
+    auto bars = area.reduced(10, 8).withTrimmedBottom(16);
+    auto barWidth = bars.getWidth() / 3;
+
+    auto drawBar = [&](int index, float rms, float peak, const String& label)
+    {
+        auto bar = bars.withX(bars.getX() + barWidth * index).withWidth(barWidth).reduced(6, 0);
+        g.setColour(Colours::black.withAlpha(.5f));
+        g.fillRect(bar);
+        g.setColour(Colours::skyblue);
+        g.fillRect(bar.withTop(toY(bar, rms)));
+        g.setColour(Colours::white);
+        g.drawHorizontalLine(roundToInt(toY(bar, peak)), bar.getX(), bar.getRight());
+        g.setFont(12.0f);
+        g.drawFittedText(label, bar.toNearestInt().withY((int) bars.getBottom()).withHeight(16).expanded(6, 0), Justification::centred, 1);
+    };
+
+    drawBar(0, displayLevels.inputRms, displayLevels.inputPeak, "In");
+    drawBar(1, displayLevels.outputRms, displayLevels.outputPeak, "Out");
+
+    // How far the output RMS sits below the input, drawn down from 0 dB
+    auto reductionDb = displayLevels.inputRms > 0 ? jlimit(0.0f, maxDb - minDb, Decibels::gainToDecibels(displayLevels.inputRms)
+                                                                                   - Decibels::gainToDecibels(displayLevels.outputRms, minDb))
+                                                  : 0.0f;
+    auto bar = bars.withX(bars.getX() + barWidth * 2).withWidth(barWidth).reduced(6, 0);
+    g.setColour(Colours::black.withAlpha(.5f));
+    g.fillRect(bar);
+    g.setColour(Colours::orange);
+    g.fillRect(bar.withHeight(bar.getHeight() * reductionDb / (maxDb - minDb)));
+    g.setColour(Colours::white);
+    g.setFont(12.0f);
+    g.drawFittedText("GR", bar.toNearestInt().withY((int) bars.getBottom()).withHeight(16).expanded(6, 0), Justification::centred, 1);
+}
+
+void EZDistortionAudioProcessorEditor::drawScope(Graphics& g, Rectangle<float> area)
+{
+    auto plot = area.reduced(10, 8);
+    auto numPoints = (int) scopeTrace.size();
+    Path path;
+
+    // oldest point first, scopeWritePosition is where the next point will go
+    for (int i = 0; i < numPoints; ++i)
+    {
+        auto sample = jlimit(-1.0f, 1.0f, scopeTrace[(size_t) ((scopeWritePosition + i) % numPoints)]);
+        auto point = Point<float>(plot.getX() + plot.getWidth() * (float) i / (float) (numPoints - 1),
+                                  plot.getCentreY() - sample * plot.getHeight() * 0.5f);
+
+        if (i == 0)
+            path.startNewSubPath(point);
+        else
+            path.lineTo(point);
+    }
+
+    g.setColour(Colours::skyblue);
+    g.strokePath(path, PathStrokeType(1.5f));
+}
+
+void EZDistortionAudioProcessorEditor::parameterChanged(const String& parameterID, float)
+{
+    // This can come from the audio thread, so it only flags what needs drawing
+    if (parameterID == "MIX")            dirtyParameters.fetch_or(mixDirty);
+    else if (parameterID == "GAIN")      dirtyParameters.fetch_or(gainDirty);
+    else if (parameterID == "THRESHOLD") dirtyParameters.fetch_or(thresholdDirty);
+    else if (parameterID == "TYPE")      dirtyParameters.fetch_or(typeDirty);
+}
+
 void EZDistortionAudioProcessorEditor::timerCallback()
 {
-    repaint();
+    auto dirty = dirtyParameters.exchange(0);
+
+    if (dirty & mixDirty)       repaint(getKnobArea(mixSlider));
+    if (dirty & gainDirty)      repaint(getKnobArea(gainSlider));
+    if (dirty & thresholdDirty) repaint(getKnobArea(thresholdSlider));
+    if (dirty != 0)             repaint(transferCurveArea.toNearestInt());
+
+    // The text box follows the control under the mouse, and that control's value
+    Component* hovered = nullptr;
+
+    for (auto* c : std::initializer_list<Component*> { &mixSlider, &gainSlider, &thresholdSlider, &distortionType })
+        if (c->isMouseOverOrDragging())
+            hovered = c;
+
+    if (hovered != lastHovered)
+    {
+        repaint(paramTextArea);
+
+        for (auto* c : { hovered, lastHovered })
+            if (auto* slider = dynamic_cast<Slider*>(c))
+                repaint(getKnobArea(*slider));
+
+        lastHovered = hovered;
+    }
+    else if (hovered != nullptr && dirty != 0)
+    {
+        repaint(paramTextArea);
+    }
+
+    // Peaks are held and fall back slowly, RMS follows the latest block
+    const float peakDecay = 0.85f;
+    auto levelsChanged = displayLevels.inputPeak > 1.0e-4f || displayLevels.outputPeak > 1.0e-4f;
+    displayLevels.inputPeak *= peakDecay;
+    displayLevels.outputPeak *= peakDecay;
+
+    SignalTap::Levels levels;
+
+    while (audioProcessor.signalTap.popLevels(levels))
+    {
+        displayLevels.inputPeak = jmax(displayLevels.inputPeak, levels.inputPeak);
+        displayLevels.outputPeak = jmax(displayLevels.outputPeak, levels.outputPeak);
+        displayLevels.inputRms = levels.inputRms;
+        displayLevels.outputRms = levels.outputRms;
+        levelsChanged = true;
+    }
+
+    if (levelsChanged)
+        repaint(meterArea.toNearestInt());
+
+    auto scopeChanged = false;
+
+    for (int numRead; (numRead = audioProcessor.signalTap.popScope(scopeIncoming.data(), (int) scopeIncoming.size())) > 0;)
+    {
+        for (int i = 0; i < numRead; ++i)
+        {
+            scopeTrace[(size_t) scopeWritePosition] = scopeIncoming[(size_t) i];
+            scopeWritePosition = (scopeWritePosition + 1) % (int) scopeTrace.size();
+        }
+
+        scopeChanged = true;
+    }
+
+    if (scopeChanged)
+        repaint(scopeArea.toNearestInt());
+
+    if (performancePanel.isVisible())
+        performancePanel.update();
+}
+
+bool EZDistortionAudioProcessorEditor::keyPressed(const KeyPress& key)
+{
+    if (key == KeyPress('p', ModifierKeys::commandModifier | ModifierKeys::shiftModifier, 0))
+    {
+        performancePanel.setVisible(! performancePanel.isVisible());
+        return true;
+    }
+
+    return false;
+}
+
+// Loading a response switches the cabinet on, the file is read in the background
+void EZDistortionAudioProcessorEditor::chooseCabinetFile()
+{
+    auto current = audioProcessor.cabinet.getFilePath();
+    cabinetChooser = std::make_unique<FileChooser>("Cabinet impulse response", current.isEmpty() ? File() : File(current).getParentDirectory(),
+                                                   "*.wav;*.aif;*.aiff;*.flac");
+
+    cabinetChooser->launchAsync(FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles, [this](const FileChooser& chooser)
+    {
+        auto file = chooser.getResult();
+
+        if (! file.existsAsFile())
+            return;
+
+        audioProcessor.cabinet.loadFile(file);
+        audioProcessor.apvts.getParameter("CAB")->setValueNotifyingHost(1.0f);
+        cabinetButton.setButtonText(file.getFileNameWithoutExtension());
+    });
+}
+
+// Presets are saved in the folder the bank reads them from, named after the file
+void EZDistortionAudioProcessorEditor::saveUserPreset()
+{
+    auto folder = PresetBank::getUserPresetFolder();
+    folder.createDirectory();
+    presetChooser = std::make_unique<FileChooser>("Save preset", folder.getChildFile("New Preset" + String(PresetBank::fileExtension)),
+                                                  "*" + String(PresetBank::fileExtension));
+
+    presetChooser->launchAsync(FileBrowserComponent::saveMode | FileBrowserComponent::canSelectFiles
+                                   | FileBrowserComponent::warnAboutOverwriting, [this](const FileChooser& chooser)
+    {
+        auto file = chooser.getResult();
+
+        if (file == File())
+            return;
+
+        if (! audioProcessor.saveUserPreset(file.withFileExtension(PresetBank::fileExtension)))
+            AlertWindow::showMessageBoxAsync(MessageBoxIconType::WarningIcon, "EZ Distortion", "Can't write " + file.getFullPathName());
+    });
+}
+
+//==============================================================================
+PerformancePanel::PerformancePanel(ProcessTimer& timerToShow, const QualityGovernor& governorToShow)
+    : timer(timerToShow), governor(governorToShow)
+{
+    setOpaque(true);
+    addAndMakeVisible(resetButton);
+    addAndMakeVisible(exportButton);
+
+    resetButton.onClick = [this] { timer.reset(); };
+
+    exportButton.onClick = [this]
+    {
+        chooser = std::make_unique<FileChooser>("Append the statistics to a CSV file",
+                                                File::getSpecialLocation(File::userDocumentsDirectory).getChildFile("EZ Distortion performance.csv"),
+                                                "*.csv");
+
+        chooser->launchAsync(FileBrowserComponent::saveMode | FileBrowserComponent::canSelectFiles, [this](const FileChooser& fc)
+        {
+            auto file = fc.getResult();
+
+            if (file != File() && ! timer.appendToCsv(file))
+                AlertWindow::showMessageBoxAsync(MessageBoxIconType::WarningIcon, "EZ Distortion", "Can't write " + file.getFullPathName());
+        });
+    };
+}
+
+void PerformancePanel::update()
+{
+    auto newStats = timer.getStats();
+    auto newLevel = governor.getLevel();
+    auto newMaxLevel = governor.getMaxLevel();
+
+    if (newStats.numBlocks != stats.numBlocks || newLevel != governorLevel || newMaxLevel != governorMaxLevel)
+    {
+        stats = newStats;
+        governorLevel = newLevel;
+        governorMaxLevel = newMaxLevel;
+        repaint();
+    }
+}
+
+void PerformancePanel::paint(Graphics& g)
+{
+    g.fillAll(Colours::black.withAlpha(0.9f));
+    g.setColour(Colours::white);
+    g.drawRect(getLocalBounds(), 1);
+
+    auto area = getLocalBounds().reduced(10).withTrimmedBottom(30);
+    g.setFont(Font(Font::getDefaultMonospacedFontName(), 13.0f, Font::plain));
+
+    if (! ProcessTimer::isEnabled)
+    {
+        g.drawFittedText("Block timing was compiled out\n(EZ_DISTORTION_PERF_STATS=0)", area, Justification::centred, 2);
+        return;
+    }
+
+    auto line = [&](const String& text)
+    {
+        g.drawText(text, area.removeFromTop(18), Justification::left);
+    };
+
+    auto value = [](double x) { return String(x, 1).paddedLeft(' ', 9); };
+
+    line("processBlock     min     mean      p99      max");
+    line("time (us)  " + value(stats.minMicroseconds) + value(stats.meanMicroseconds) + value(stats.p99Microseconds) + value(stats.maxMicroseconds));
+    line("budget (%)          " + value(stats.meanLoad) + value(stats.p99Load) + value(stats.maxLoad));
+    area.removeFromTop(10);
+    line("blocks    " + String(stats.numBlocks));
+    line("overruns  " + String(stats.numOverruns));
+    line("rate      " + String(timer.getSampleRate(), 0) + " Hz");
+    line("governor  " + String(governorLevel) + " of " + String(governorMaxLevel) + " steps down");
+}
+
+void PerformancePanel::resized()
+{
+    auto buttons = getLocalBounds().reduced(10).removeFromBottom(24);
+    resetButton.setBounds(buttons.removeFromLeft(80));
+    exportButton.setBounds(buttons.removeFromRight(140));
 }
@@ -10,6 +10,7 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "WaveshaperKernels.h"
 using namespace juce;
 
 //==============================================================================
@@ -62,7 +63,32 @@ public:
     }
 };
 
-class EZDistortionAudioProcessorEditor  : public juce::AudioProcessorEditor, public juce::Timer, public OtherLookAndFeel
+//==============================================================================
+/** The processor's block timing, hidden until Ctrl+Shift+P (Cmd+Shift+P on a Mac)
+    toggles it over the displays.
+*/
+class PerformancePanel : public Component
+{
+public:
+    PerformancePanel(ProcessTimer& timerToShow, const QualityGovernor& governorToShow);
+
+    /** Called from the editor's timer while the panel is showing. */
+    void update();
+
+    void paint(Graphics& g) override;
+    void resized() override;
+
+private:
+    ProcessTimer& timer;
+    ProcessTimer::Stats stats;
+    const QualityGovernor& governor;
+    int governorLevel = 0, governorMaxLevel = 0;
+    TextButton resetButton { "Reset" }, exportButton { "Append to CSV..." };
+    std::unique_ptr<FileChooser> chooser;
+};
+
+class EZDistortionAudioProcessorEditor  : public juce::AudioProcessorEditor, public juce::Timer, public OtherLookAndFeel,
+                                          private AudioProcessorValueTreeState::Listener
 {
 public:
     EZDistortionAudioProcessorEditor (EZDistortionAudioProcessor&);
@@ -77,6 +103,10 @@ public:
         box.addItem(String("Hard Clipping"), 2);
         box.addItem(String("Foldback"), 3);
         box.addItem(String("ScoopFold"), 4);
+        box.addItem(String("Tanh"), 5);
+        box.addItem(String("Arctan"), 6);
+        box.addItem(String("Tube"), 7);
+        box.addItem(String("Diode"), 8);
         box.setJustificationType(Justification::centred);
         addAndMakeVisible(box);
         box.setSelectedId(1);
@@ -131,9 +161,19 @@ public:
        
        }
        void drawParamText(Graphics& g);
+       void renderBackground(float scale);
+       Rectangle<int> getKnobArea(const Slider& slider) const;
+       void drawTransferCurve(Graphics& g, Rectangle<float> area);
+       void drawMeters(Graphics& g, Rectangle<float> area);
+       void drawScope(Graphics& g, Rectangle<float> area);
        void timerCallback() override;
+       bool keyPressed(const KeyPress& key) override;
+       void chooseCabinetFile();
+       void saveUserPreset();
 
 private:
+    void parameterChanged(const String& parameterID, float newValue) override;
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     EZDistortionAudioProcessor& audioProcessor;
@@ -155,5 +195,42 @@ private:
     int row1X = 50;
     int column1Y = 100;
 
+    // Title, group boxes and display frames, drawn once at the screen's pixel scale
+    Image background;
+    Font titleFont { "Euphemia UCAS", 60.0f, Font::plain };
+
+    // Set by parameterChanged() on any thread, turned into repaints of just those areas by timerCallback()
+    enum DirtyFlags
+    {
+        mixDirty = 1,
+        gainDirty = 2,
+        thresholdDirty = 4,
+        typeDirty = 8
+    };
+
+    std::atomic<int> dirtyParameters { 0 };
+    Component* lastHovered = nullptr;
+    Rectangle<int> paramTextArea { 0, 8, 154, 54 };
+
+    // Levels and scope trace drained from the processor's SignalTap in timerCallback()
+    SignalTap::Levels displayLevels;
+    std::vector<float> scopeTrace = std::vector<float> (560, 0.0f);
+    std::vector<float> scopeIncoming = std::vector<float> (1024, 0.0f);
+    int scopeWritePosition = 0;
+
+    Rectangle<float> transferCurveArea { 320, 85, 140, 125 };
+    Rectangle<float> meterArea { 475, 85, 125, 125 };
+    Rectangle<float> scopeArea { 320, 240, 280, 105 };
+
+    PerformancePanel performancePanel { audioProcessor.processTimer, audioProcessor.governor };
+
+    // Picks the cabinet's impulse response, CAB and CAB_MIX are left to the host
+    TextButton cabinetButton;
+    std::unique_ptr<FileChooser> cabinetChooser;
+
+    // Saves the current settings to the user preset folder
+    TextButton savePresetButton { "Save Preset" };
+    std::unique_ptr<FileChooser> presetChooser;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EZDistortionAudioProcessorEditor)
 };
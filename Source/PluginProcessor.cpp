@@ -7,7 +7,12 @@
 */
 
 #include "PluginProcessor.h"
-#include "PluginEditor.h"
+#include "WaveshaperKernels.h"
+
+// Headless builds such as the offline renderer link the processor without any UI code
+#if ! EZ_DISTORTION_HEADLESS
+ #include "PluginEditor.h"
+#endif
 
 //==============================================================================
 EZDistortionAudioProcessor::EZDistortionAudioProcessor()
@@ -25,17 +30,104 @@ apvts(*this, nullptr, "Parameters",
 std::make_unique<AudioParameterFloat>(ParameterID("MIX",1), "Mix", NormalisableRange<float> { 0.0f, 1.0f, .001f }, 0.5f),
 std::make_unique<AudioParameterFloat>(ParameterID("GAIN",1), "Gain", NormalisableRange<float> { -40.0f, 6.0f, .01f }, -17.f),
 std::make_unique<AudioParameterFloat>(ParameterID("THRESHOLD",1), "Threshold", NormalisableRange<float> { -40.0f, 6.0f, .01f }, 0.f),
-std::make_unique<AudioParameterInt>(ParameterID("TYPE",1), "Type", 1, 4, 1)
+std::make_unique<AudioParameterInt>(ParameterID("TYPE",1), "Type", 1, 8, 1),
+std::make_unique<AudioParameterChoice>(ParameterID("OVERSAMPLING",1), "Oversampling", StringArray { "1x", "2x", "4x", "8x", "16x" }, 0),
+std::make_unique<AudioParameterChoice>(ParameterID("OS_FILTER",1), "Oversampling Filter", StringArray { "Linear Phase", "Minimum Phase" }, 1),
+std::make_unique<AudioParameterChoice>(ParameterID("ANTIALIAS",1), "Antialiasing", StringArray { "Off", "ADAA 1st Order", "ADAA 2nd Order" }, 0),
+std::make_unique<AudioParameterChoice>(ParameterID("ENGINE",1), "Engine", StringArray { "Direct", "Table" }, 0),
+std::make_unique<AudioParameterChoice>(ParameterID("TABLE_SIZE",1), "Table Size", StringArray { "1024", "4096", "16384", "65536" }, 1),
+std::make_unique<AudioParameterChoice>(ParameterID("TABLE_INTERP",1), "Table Interpolation", StringArray { "Linear", "Cubic" }, 0),
+std::make_unique<AudioParameterChoice>(ParameterID("CURVE_ACCURACY",1), "Curve Accuracy", StringArray { "Fast", "Balanced", "Precise" }, 1),
+std::make_unique<AudioParameterChoice>(ParameterID("GOVERNOR",1), "CPU Governor", StringArray { "Off", "On" }, 0),
+std::make_unique<AudioParameterChoice>(ParameterID("BANDS",1), "Bands", StringArray { "Off", "2 Bands", "3 Bands", "4 Bands" }, 0),
+std::make_unique<AudioParameterFloat>(ParameterID("CROSSOVER_1",1), "Crossover 1", NormalisableRange<float> { 20.0f, 20000.0f, 1.0f, 0.25f }, 200.f),
+std::make_unique<AudioParameterFloat>(ParameterID("CROSSOVER_2",1), "Crossover 2", NormalisableRange<float> { 20.0f, 20000.0f, 1.0f, 0.25f }, 1000.f),
+std::make_unique<AudioParameterFloat>(ParameterID("CROSSOVER_3",1), "Crossover 3", NormalisableRange<float> { 20.0f, 20000.0f, 1.0f, 0.25f }, 5000.f),
+std::make_unique<AudioParameterInt>(ParameterID("BAND1_TYPE",1), "Band 1 Type", 1, 8, 1),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND1_GAIN",1), "Band 1 Gain", NormalisableRange<float> { -40.0f, 6.0f, .01f }, -17.f),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND1_THRESHOLD",1), "Band 1 Threshold", NormalisableRange<float> { -40.0f, 6.0f, .01f }, 0.f),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND1_MIX",1), "Band 1 Mix", NormalisableRange<float> { 0.0f, 1.0f, .001f }, 0.5f),
+std::make_unique<AudioParameterInt>(ParameterID("BAND2_TYPE",1), "Band 2 Type", 1, 8, 1),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND2_GAIN",1), "Band 2 Gain", NormalisableRange<float> { -40.0f, 6.0f, .01f }, -17.f),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND2_THRESHOLD",1), "Band 2 Threshold", NormalisableRange<float> { -40.0f, 6.0f, .01f }, 0.f),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND2_MIX",1), "Band 2 Mix", NormalisableRange<float> { 0.0f, 1.0f, .001f }, 0.5f),
+std::make_unique<AudioParameterInt>(ParameterID("BAND3_TYPE",1), "Band 3 Type", 1, 8, 1),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND3_GAIN",1), "Band 3 Gain", NormalisableRange<float> { -40.0f, 6.0f, .01f }, -17.f),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND3_THRESHOLD",1), "Band 3 Threshold", NormalisableRange<float> { -40.0f, 6.0f, .01f }, 0.f),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND3_MIX",1), "Band 3 Mix", NormalisableRange<float> { 0.0f, 1.0f, .001f }, 0.5f),
+std::make_unique<AudioParameterInt>(ParameterID("BAND4_TYPE",1), "Band 4 Type", 1, 8, 1),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND4_GAIN",1), "Band 4 Gain", NormalisableRange<float> { -40.0f, 6.0f, .01f }, -17.f),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND4_THRESHOLD",1), "Band 4 Threshold", NormalisableRange<float> { -40.0f, 6.0f, .01f }, 0.f),
+std::make_unique<AudioParameterFloat>(ParameterID("BAND4_MIX",1), "Band 4 Mix", NormalisableRange<float> { 0.0f, 1.0f, .001f }, 0.5f),
+std::make_unique<AudioParameterFloat>(ParameterID("PRE_TILT",1), "Pre Tilt", NormalisableRange<float> { -12.0f, 12.0f, .1f }, 0.f),
+std::make_unique<AudioParameterFloat>(ParameterID("PRE_LOW_CUT",1), "Pre Low Cut", NormalisableRange<float> { 20.0f, 2000.0f, 1.0f, 0.3f }, 20.f),
+std::make_unique<AudioParameterFloat>(ParameterID("PRE_HIGH_CUT",1), "Pre High Cut", NormalisableRange<float> { 1000.0f, 20000.0f, 1.0f, 0.3f }, 20000.f),
+std::make_unique<AudioParameterFloat>(ParameterID("PRE_MID_FREQ",1), "Pre Mid Frequency", NormalisableRange<float> { 100.0f, 10000.0f, 1.0f, 0.3f }, 1000.f),
+std::make_unique<AudioParameterFloat>(ParameterID("PRE_MID_GAIN",1), "Pre Mid Gain", NormalisableRange<float> { -12.0f, 12.0f, .1f }, 0.f),
+std::make_unique<AudioParameterFloat>(ParameterID("POST_TILT",1), "Post Tilt", NormalisableRange<float> { -12.0f, 12.0f, .1f }, 0.f),
+std::make_unique<AudioParameterFloat>(ParameterID("POST_LOW_CUT",1), "Post Low Cut", NormalisableRange<float> { 20.0f, 2000.0f, 1.0f, 0.3f }, 20.f),
+std::make_unique<AudioParameterFloat>(ParameterID("POST_HIGH_CUT",1), "Post High Cut", NormalisableRange<float> { 1000.0f, 20000.0f, 1.0f, 0.3f }, 20000.f),
+std::make_unique<AudioParameterFloat>(ParameterID("POST_MID_FREQ",1), "Post Mid Frequency", NormalisableRange<float> { 100.0f, 10000.0f, 1.0f, 0.3f }, 1000.f),
+std::make_unique<AudioParameterFloat>(ParameterID("POST_MID_GAIN",1), "Post Mid Gain", NormalisableRange<float> { -12.0f, 12.0f, .1f }, 0.f),
+std::make_unique<AudioParameterChoice>(ParameterID("CAB",1), "Cabinet", StringArray { "Off", "On" }, 0),
+std::make_unique<AudioParameterFloat>(ParameterID("CAB_MIX",1), "Cabinet Mix", NormalisableRange<float> { 0.0f, 1.0f, .001f }, 1.f)
 
 
 }
     )
 #endif
 {
+    mixParam = apvts.getRawParameterValue("MIX");
+    gainParam = apvts.getRawParameterValue("GAIN");
+    thresholdParam = apvts.getRawParameterValue("THRESHOLD");
+    typeParam = apvts.getRawParameterValue("TYPE");
+    oversamplingParam = apvts.getRawParameterValue("OVERSAMPLING");
+    osFilterParam = apvts.getRawParameterValue("OS_FILTER");
+    antialiasParam = apvts.getRawParameterValue("ANTIALIAS");
+    engineParam = apvts.getRawParameterValue("ENGINE");
+    tableSizeParam = apvts.getRawParameterValue("TABLE_SIZE");
+    tableInterpParam = apvts.getRawParameterValue("TABLE_INTERP");
+    curveAccuracyParam = apvts.getRawParameterValue("CURVE_ACCURACY");
+    governorParam = apvts.getRawParameterValue("GOVERNOR");
+    bandsParam = apvts.getRawParameterValue("BANDS");
+
+    for (int i = 0; i < MultibandDesign::maxCrossovers; ++i)
+        crossoverParams[(size_t) i] = apvts.getRawParameterValue("CROSSOVER_" + String(i + 1));
+
+    for (int band = 0; band < MultibandDesign::maxBands; ++band)
+    {
+        auto prefix = "BAND" + String(band + 1) + "_";
+        bandTypeParams[(size_t) band] = apvts.getRawParameterValue(prefix + "TYPE");
+        bandGainParams[(size_t) band] = apvts.getRawParameterValue(prefix + "GAIN");
+        bandThresholdParams[(size_t) band] = apvts.getRawParameterValue(prefix + "THRESHOLD");
+        bandMixParams[(size_t) band] = apvts.getRawParameterValue(prefix + "MIX");
+    }
+
+    for (int i = 0; i < ToneDesign::numControls; ++i)
+    {
+        preToneParams[(size_t) i] = apvts.getRawParameterValue("PRE_" + String(ToneDesign::controlIds[i]));
+        postToneParams[(size_t) i] = apvts.getRawParameterValue("POST_" + String(ToneDesign::controlIds[i]));
+    }
+
+    cabParam = apvts.getRawParameterValue("CAB");
+    cabMixParam = apvts.getRawParameterValue("CAB_MIX");
+
+    // Sessions and presets address parameters through PresetBank's list, which has to cover all of them
+    jassert (getParameters().size() == PresetBank::numParameters);
+
+    for (int i = 0; i < PresetBank::numParameters; ++i)
+    {
+        parameters[(size_t) i] = apvts.getParameter(PresetBank::parameterIds[i]);
+        rawValues[(size_t) i] = apvts.getRawParameterValue(PresetBank::parameterIds[i]);
+        jassert (parameters[(size_t) i] != nullptr && rawValues[(size_t) i] != nullptr);
+    }
+
+    startTimer(50);
 }
 
 EZDistortionAudioProcessor::~EZDistortionAudioProcessor()
 {
+    stopTimer();
 }
 
 //==============================================================================
@@ -73,27 +165,35 @@ bool EZDistortionAudioProcessor::isMidiEffect() const
 
 double EZDistortionAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    // The curves have no memory, only the oversampling filters, ADAA and the cabinet ring on
+    auto cabinetTail = cabParam->load() > 0.5f ? cabinet.getTailInSamples() : 0;
+    return (tailLengthSamples.load(std::memory_order_relaxed) + cabinetTail) / currentSampleRate;
 }
 
 int EZDistortionAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return jmax(1, presetBank->size());   // NB: some hosts don't cope very well if you tell them there are 0 programs,
+                                          // so this should be at least 1, even if you're not really implementing programs.
 }
 
 int EZDistortionAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram.load();
 }
 
 void EZDistortionAudioProcessor::setCurrentProgram (int index)
 {
+    if (! isPositiveAndBelow(index, presetBank->size()))
+        return;
+
+    // Only staged here, hosts may call this from the audio thread
+    currentProgram.store(index);
+    pendingProgram.store(index);
 }
 
 const juce::String EZDistortionAudioProcessor::getProgramName (int index)
 {
-    return {};
+    return isPositiveAndBelow(index, presetBank->size()) ? (*presetBank)[index].name : juce::String();
 }
 
 void EZDistortionAudioProcessor::changeProgramName (int index, const juce::String& newName)
@@ -103,14 +203,219 @@ void EZDistortionAudioProcessor::changeProgramName (int index, const juce::Strin
 //==============================================================================
 void EZDistortionAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Use this method as the place to do any pre-playback
-    // initialisation that you need..
+    // Every oversampling factor and filter type is designed and allocated here,
+    // so switching them while playing never allocates
+    maxBlockSize = samplesPerBlock;
+    auto numChannels = jmax(getTotalNumInputChannels(), getTotalNumOutputChannels());
+
+    // Playback starts at the full quality the parameters ask for, or the offline quality
+    governor.prepare(sampleRate);
+    governor.setMode(governorParam->load() > 0.5f, isNonRealtime());
+    auto requested = getRequestedQuality();
+    auto quality = governor.apply(requested, getQualityUsage((int) typeParam->load(), (int) bandsParam->load() + 1));
+    auto latencyFactorLog2 = governor.getLatencyFactorLog2(requested);
+    modeSwitch = modeIdle;
+
+    // The oversampler and one ramp per smoothed parameter, in the precision the host
+    // will call processBlock with, each long enough for a block at the highest oversampling rate
+    int factor;
+
+    if (isUsingDoublePrecision())
+    {
+        doubleState.prepare(numChannels, maxBlockSize);
+        floatState.release();
+        factor = updateOversampling(doubleState, quality.factorLog2, latencyFactorLog2, true);
+    }
+    else
+    {
+        floatState.prepare(numChannels, maxBlockSize);
+        doubleState.release();
+        factor = updateOversampling(floatState, quality.factorLog2, latencyFactorLog2, true);
+    }
+
+    // The antialiasing history starts from silence and can hold a block at the highest oversampling rate
+    adaaScratch.prepare(maxBlockSize << Oversampler<float>::maxFactorLog2);
+    adaaState.assign((size_t) numChannels, {});
+    fadeAdaaState.assign((size_t) numChannels, {});
+    silentRun.assign((size_t) numChannels, 0);
+
+    currentSampleRate = sampleRate;
+    cabinet.prepare(sampleRate, numChannels, maxBlockSize);
+    signalTap.prepare(sampleRate);
+    processTimer.prepare(sampleRate);
+    programFadeLength = jmax(1, roundToInt(sampleRate * programFadeSeconds));
+    modeFadeLength = jmax(1, roundToInt(sampleRate * modeFadeSeconds));
+    factorFadeLength = jmax(1, roundToInt(sampleRate * factorFadeSeconds));
+    currentType = previousType = (int) typeParam->load();
+    currentAccuracy = previousAccuracy = quality.accuracy;
+    typeFadeRemaining = 0;
+    numParameterEvents = 0;
+    cabinetActive = false;
+
+    // A program still waiting for its fade out is staged again, for the first block to take
+    if (programSwitch == switchFadingOut)
+    {
+        auto none = -1;
+        pendingProgram.compare_exchange_strong(none, stagedProgram);
+    }
+
+    programSwitch = switchIdle;
+    stagedProgram = -1;
+
+    updateParameterRamps(factor, true);
 }
 
 void EZDistortionAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    floatState.release();
+    doubleState.release();
+    adaaScratch.release();
+    cabinet.release();
+}
+
+template <typename T>
+int EZDistortionAudioProcessor::updateOversampling (PrecisionState<T>& state, int factorLog2, int latencyFactorLog2, bool immediate)
+{
+    auto& oversampler = state.oversampler;
+    auto filterType = (typename Oversampler<T>::FilterType) (int) osFilterParam->load();
+
+    // ADAA delays the signal by half a sample per order, at the oversampled rate
+    auto adaaOrder = (int) antialiasParam->load();
+    auto latencyAt = [&](int log2, typename Oversampler<T>::FilterType type)
+    {
+        return oversampler.getLatencyInSamples(log2, type) + ADAAKernels::getLatency(adaaOrder) / (double) (1 << log2);
+    };
+
+    // The host is told the latency of the highest factor the governor may run. At a lower factor,
+    // a delay makes up the difference, so the governor's steps don't move the latency under the host.
+    auto latency = roundToInt(latencyAt(latencyFactorLog2, filterType));
+
+    if (latency != getLatencySamples())
+        setLatencySamples(latency);
+
+    auto delayAt = [&](int log2) { return latency - roundToInt(latencyAt(log2, filterType)); };
+    auto setDelay = [&](CompensationDelay<T>& delay, int log2)
+    {
+        delay.setDelay(delayAt(log2));
+        delay.reset();
+    };
+
+    // A new filter type or latency can't be crossfaded, the path that's running would need a different delay
+    auto modeChanged = factorLog2 != oversampler.getFactorLog2() || filterType != oversampler.getFilterType();
+    auto needsDip = filterType != oversampler.getFilterType() || delayAt(oversampler.getFactorLog2()) != state.latencyDelay.getDelay();
+
+    if (immediate)
+    {
+        // the output is already silent, there's nothing to fade
+        if (modeChanged)
+            oversampler.setMode(factorLog2, filterType);
+
+        setDelay(state.latencyDelay, factorLog2);
+        factorWarmupRemaining = factorFadeRemaining = 0;
+        modeSwitch = modeIdle;
+    }
+    else if (modeSwitch == modeSwitching)
+    {
+        // any factor step still going stops here, where nothing is heard of either factor
+        oversampler.setMode(factorLog2, filterType);
+        setDelay(state.latencyDelay, factorLog2);
+        factorWarmupRemaining = factorFadeRemaining = 0;
+        modeSwitch = modeFadingIn;
+        modeFadeRemaining = modeFadeLength;
+    }
+    else if (modeSwitch == modeIdle && needsDip)
+    {
+        // the switch waits until the output has faded out in the old mode
+        modeSwitch = modeFadingOut;
+        modeFadeRemaining = modeFadeLength;
+    }
+    else if (modeSwitch == modeIdle && modeChanged && ! isChangingFactor())
+    {
+        // A governor step. The old factor carries on in the fade path with everything it has built up,
+        // and the new one starts from silence next to it. Another step waits for this one to finish.
+        std::swap(state.oversampler, state.fadeOversampler);
+        std::swap(state.latencyDelay, state.fadeLatencyDelay);
+        std::swap(state.multiband, state.fadeMultiband);
+        std::swap(adaaState, fadeAdaaState);
+
+        oversampler.setMode(factorLog2, filterType);
+        oversampler.reset();
+        setDelay(state.latencyDelay, factorLog2);
+        state.multiband.reset();
+
+        for (auto& channelState : adaaState)
+            channelState = {};
+
+        // long enough for the filters and the delay to fill, with a fade's length more for the crossovers to settle
+        factorWarmupRemaining = (int) std::ceil(oversampler.getTailInSamples()) + state.latencyDelay.getDelay() + factorFadeLength;
+        factorFadeRemaining = factorFadeLength;
+    }
+
+    tailLengthSamples.store((int) std::ceil(oversampler.getTailInSamples() + (double) adaaOrder / oversampler.getFactor()) + state.latencyDelay.getDelay(),
+                            std::memory_order_relaxed);
+    return oversampler.getFactor();
+}
+
+// The quality settings as the parameters have them, the most the governor will run with
+QualityGovernor::Quality EZDistortionAudioProcessor::getRequestedQuality() const noexcept
+{
+    QualityGovernor::Quality quality;
+    quality.factorLog2 = (int) oversamplingParam->load();
+    quality.interpolation = (int) tableInterpParam->load();
+    quality.accuracy = (int) curveAccuracyParam->load();
+    return quality;
+}
+
+// Which quality settings make a difference to the cost of the current curves
+QualityGovernor::Usage EZDistortionAudioProcessor::getQualityUsage(int type, int numBands) const noexcept
+{
+    QualityGovernor::Usage usage;
+
+    if (numBands == 1)
+    {
+        // as in processSegment, a curve with an ADAA kernel runs that rather than a table
+        auto adaaOrder = (int) antialiasParam->load();
+        usage.table = (int) engineParam->load() == 1 && (adaaOrder == 0 || ADAAKernels::getKernel<float>(type, adaaOrder) == nullptr);
+        usage.approximations = type >= WaveshaperKernels::tanhClip;
+        return usage;
+    }
+
+    // the bands always run the direct curves
+    for (int band = 0; band < numBands; ++band)
+        usage.approximations = usage.approximations || (int) bandTypeParams[(size_t) band]->load() >= WaveshaperKernels::tanhClip;
+
+    return usage;
+}
+
+// The controls of one tone stage, in ToneDesign::controlIds order
+ToneDesign::Settings EZDistortionAudioProcessor::getToneSettings(const ToneParams& params) noexcept
+{
+    ToneDesign::Settings settings;
+    settings.tiltDb = params[0]->load();
+    settings.lowCut = params[1]->load();
+    settings.highCut = params[2]->load();
+    settings.midFrequency = params[3]->load();
+    settings.midGainDb = params[4]->load();
+    return settings;
+}
+
+void EZDistortionAudioProcessor::updateParameterRamps(int factor, bool snapToTargets)
+{
+    // The ramps run at the oversampled rate, so a new factor stretches any glide still running to take the same time
+    if (factor != rampFactor)
+    {
+        rampFactor = factor;
+        auto length = roundToInt(currentSampleRate * factor * rampLengthSeconds);
+        curveRamps.setLength(length);
+
+        for (auto& ramps : bandRamps)
+            ramps.setLength(length);
+    }
+
+    curveRamps.setTargets(mixParam->load(), gainParam->load(), thresholdParam->load(), snapToTargets);
+
+    for (size_t band = 0; band < bandRamps.size(); ++band)
+        bandRamps[band].setTargets(bandMixParams[band]->load(), bandGainParams[band]->load(), bandThresholdParams[band]->load(), snapToTargets);
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -120,12 +425,11 @@ bool EZDistortionAudioProcessor::isBusesLayoutSupported (const BusesLayout& layo
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Any layout up to 16 channels, which covers 7.1.4 and third order ambisonics.
+    // Every channel is processed the same way, so named and discrete layouts are equally fine.
+    auto outputs = layouts.getMainOutputChannelSet();
+
+    if (outputs.isDisabled() || outputs.size() > maxNumChannels)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -139,8 +443,447 @@ bool EZDistortionAudioProcessor::isBusesLayoutSupported (const BusesLayout& layo
 }
 #endif
 
+// Peak across all channels, and RMS over all of them together
+template <typename T>
+static void measureLevels (const juce::AudioBuffer<T>& buffer, int numChannels, float& peak, float& rms)
+{
+    float sumOfSquares = 0;
+    peak = 0;
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        auto channelRms = (float) buffer.getRMSLevel(channel, 0, buffer.getNumSamples());
+        peak = jmax(peak, (float) buffer.getMagnitude(channel, 0, buffer.getNumSamples()));
+        sumOfSquares += channelRms * channelRms;
+    }
+
+    rms = numChannels > 0 ? std::sqrt(sumOfSquares / (float) numChannels) : 0.0f;
+}
+
+// Equal-power fade from the outgoing curve's output into the incoming one's, over the samples left of the fade
+template <typename T>
+static void crossfadeTypes (T* incoming, const T* outgoing, int numSamples, int fadeRemaining, int fadeLength)
+{
+    for (int i = 0; i < jmin(numSamples, fadeRemaining); ++i)
+    {
+        auto angle = MathConstants<double>::halfPi * (double) (fadeRemaining - i) / (double) fadeLength;
+        incoming[i] = (T) (incoming[i] * std::cos(angle) + outgoing[i] * std::sin(angle));
+    }
+}
+
+// Linear fade from the outgoing factor's output into the incoming one's. They are the same signal but for the
+// aliasing, and an equal-power fade would lift it by up to 3 dB halfway.
+template <typename T>
+static void crossfadeFactors (T* incoming, const T* outgoing, int numSamples, int fadeRemaining, int fadeLength)
+{
+    for (int i = 0; i < jmin(numSamples, fadeRemaining); ++i)
+    {
+        auto outgoingGain = (T) (fadeRemaining - i) / (T) fadeLength;
+        incoming[i] += (outgoing[i] - incoming[i]) * outgoingGain;
+    }
+}
+
+// Each band's curve follows its ramps in steps of bandRampStep samples while any of them is moving
+template <typename T>
+void EZDistortionAudioProcessor::processBands (MultibandDistortion<T>& multiband, T* const* channels, int numChannels, int numSamples)
+{
+    auto smoothing = std::any_of(bandRamps.begin(), bandRamps.end(), [](const CurveRamps& ramps) { return ramps.isSmoothing(); });
+    auto step = smoothing ? bandRampStep : numSamples;
+
+    std::array<int, MultibandDesign::maxBands> types;
+
+    for (size_t band = 0; band < types.size(); ++band)
+        types[band] = (int) bandTypeParams[band]->load();
+
+    for (int start = 0; start < numSamples; start += step)
+    {
+        auto numStep = jmin(step, numSamples - start);
+
+        for (size_t band = 0; band < types.size(); ++band)
+        {
+            if (smoothing)
+                bandRamps[band].skip(numStep);
+
+            multiband.setBand((int) band, types[band], bandRamps[band].getCurrentParams());
+        }
+
+        multiband.process(channels, numChannels, start, numStep);
+    }
+}
+
+// A linear fade over what is left of it, either out to silence, which then holds for the rest of the block, or back in
+template <typename T>
+static void applyFade (juce::AudioBuffer<T>& buffer, int numChannels, int& fadeRemaining, int fadeLength, bool fadingOut)
+{
+    auto gainAt = [&](int remaining)
+    {
+        auto fraction = (float) remaining / (float) fadeLength;
+        return fadingOut ? fraction : 1.0f - fraction;
+    };
+
+    auto numSamples = buffer.getNumSamples();
+    auto numFading = jmin(numSamples, fadeRemaining);
+    auto startGain = gainAt(fadeRemaining);
+    fadeRemaining -= numFading;
+    auto endGain = gainAt(fadeRemaining);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        buffer.applyGainRamp(channel, 0, numFading, (T) startGain, (T) endGain);
+
+        if (fadingOut)
+            buffer.clear(channel, numFading, numSamples - numFading);
+    }
+}
+
+// Programs that change the signal path dip through silence, so it never switches under the signal.
+// The new program came in at switchOffset, or -1 if it wasn't in this block.
+template <typename T>
+void EZDistortionAudioProcessor::applyProgramFade (juce::AudioBuffer<T>& buffer, int numChannels, int switchOffset)
+{
+    auto numSamples = buffer.getNumSamples();
+
+    if (programSwitch == switchFadingOut)
+    {
+        juce::AudioBuffer<T> before (buffer.getArrayOfWritePointers(), numChannels, 0, switchOffset >= 0 ? switchOffset : numSamples);
+        applyFade(before, numChannels, programFadeRemaining, programFadeLength, true);
+
+        if (switchOffset < 0)
+            return;
+
+        // the rest of the block is the new program, fading in straight away
+        programSwitch = switchFadingIn;
+        programFadeRemaining = programFadeLength;
+        juce::AudioBuffer<T> after (buffer.getArrayOfWritePointers(), numChannels, switchOffset, numSamples - switchOffset);
+        applyFade(after, numChannels, programFadeRemaining, programFadeLength, false);
+    }
+    else if (programSwitch == switchFadingIn)
+    {
+        applyFade(buffer, numChannels, programFadeRemaining, programFadeLength, false);
+    }
+
+    if (programSwitch == switchFadingIn && programFadeRemaining == 0)
+        programSwitch = switchIdle;
+}
+
+// And so do oversampling modes, whose filters start over in silence
+template <typename T>
+void EZDistortionAudioProcessor::applyModeFade (juce::AudioBuffer<T>& buffer, int numChannels)
+{
+    if (modeSwitch != modeFadingOut && modeSwitch != modeFadingIn)
+        return;
+
+    auto fadingOut = modeSwitch == modeFadingOut;
+    applyFade(buffer, numChannels, modeFadeRemaining, modeFadeLength, fadingOut);
+
+    if (modeFadeRemaining == 0)
+        modeSwitch = fadingOut ? modeSwitching : modeIdle;
+}
+
 void EZDistortionAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    process(buffer);
+}
+
+void EZDistortionAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    process(buffer);
+}
+
+bool EZDistortionAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
+// Everything between two parameter events: the parameters are read once, then run in sub-blocks
+template <typename T>
+void EZDistortionAudioProcessor::processSegment (juce::AudioBuffer<T>& buffer, int segmentStart, int segmentLength, bool resuming)
+{
+    auto totalNumInputChannels = getTotalNumInputChannels();
+    auto& state = getPrecisionState<T>();
+    auto& oversampler = state.oversampler;
+    auto& rampBuffer = state.rampBuffer;
+    auto& channelPointers = state.channelPointers;
+    auto& oversampledPointers = state.oversampledPointers;
+
+    // What the parameters ask for, and what the governor lets this segment run with
+    int typeInt = (int) typeParam->load();
+    auto numBands = (int) bandsParam->load() + 1;
+    auto multiband = numBands > 1;
+    auto requested = getRequestedQuality();
+    auto quality = governor.apply(requested, getQualityUsage(typeInt, numBands));
+    auto wasChangingFactor = isChangingFactor();
+    auto factor = updateOversampling(state, quality.factorLog2, governor.getLatencyFactorLog2(requested), resuming);
+
+    // the path of a factor the governor has just stepped to starts from silence, as everything does when resuming
+    auto newFactorPath = isChangingFactor() && ! wasChangingFactor;
+
+    if (resuming)
+    {
+        oversampler.reset();
+        state.multiband.reset();
+        state.preTone.reset();
+        state.postTone.reset();
+
+        for (auto& channelState : adaaState)
+            channelState = {};
+    }
+
+    updateParameterRamps(factor, resuming);
+
+    // A TYPE or accuracy change fades from the old curve to the new one. Only for the length of the fade do both run.
+    if (typeInt != currentType || quality.accuracy != currentAccuracy)
+    {
+        previousType = currentType;
+        previousAccuracy = currentAccuracy;
+        currentType = typeInt;
+        currentAccuracy = quality.accuracy;
+        typeFadeLength = jmax(1, roundToInt(currentSampleRate * factor * typeFadeSeconds));
+        typeFadeRemaining = resuming ? 0 : typeFadeLength;
+    }
+
+    // With more than one band, each band's TYPE, GAIN, THRESHOLD and MIX replace the global ones
+    if (multiband)
+    {
+        float crossovers[MultibandDesign::maxCrossovers];
+
+        for (size_t i = 0; i < crossoverParams.size(); ++i)
+            crossovers[i] = crossoverParams[i]->load();
+
+        state.multiband.setCrossovers(numBands, crossovers, currentSampleRate * factor, resuming || newFactorPath);
+        state.multiband.setAccuracy(quality.accuracy);
+
+        // the bands have TYPEs of their own, the global one isn't heard
+        typeFadeRemaining = 0;
+    }
+
+    // The tone stages run at the host rate, and their controls glide like the crossovers do
+    state.preTone.setSettings(getToneSettings(preToneParams), currentSampleRate, resuming);
+    state.postTone.setSettings(getToneSettings(postToneParams), currentSampleRate, resuming);
+    auto toneActive = state.preTone.isActive() || state.postTone.isActive();
+
+    // The type and accuracy are resolved once per segment, the kernels themselves don't branch
+    auto adaaOrder = (int) antialiasParam->load();
+    auto kernel = WaveshaperKernels::getKernel<T>(typeInt, quality.accuracy);
+    auto silentCurve = WaveshaperKernels::getCurve<T>(typeInt, quality.accuracy);
+    auto adaaKernel = adaaOrder > 0 ? ADAAKernels::getKernel<T>(typeInt, adaaOrder) : nullptr;
+
+    // A table is only valid for fixed GAIN and THRESHOLD values, so it waits until they have settled.
+    // Until a table for the current settings is ready, the direct kernel is used.
+    const TransferTable* table = nullptr;
+    TransferTableKernels::ChannelKernel<T> tableKernel = nullptr;
+    auto curveSteady = ! curveRamps.isCurveSmoothing();
+
+    if (! multiband && adaaKernel == nullptr && curveSteady && (int) engineParam->load() == 1)
+    {
+        TableSpec spec;
+        spec.type = typeInt;
+        spec.gainDb = curveRamps.gainDb.getTargetValue();
+        spec.threshold = curveRamps.threshold.getTargetValue();
+        spec.size = 1024 << (2 * (int) tableSizeParam->load());
+
+        tableBuilder.request(spec);
+        table = tableBuilder.acquire(spec);
+        tableKernel = TransferTableKernels::getKernel<T>(typeInt, quality.interpolation);
+    }
+
+    // The outgoing curve of a TYPE fade never has a table, it runs directly or with the same antialiasing
+    auto fadeKernel = WaveshaperKernels::getKernel<T>(previousType, previousAccuracy);
+    auto fadeAdaaKernel = adaaOrder > 0 ? ADAAKernels::getKernel<T>(previousType, adaaOrder) : nullptr;
+    auto* fadeBuffer = state.typeFadeBuffer.getWritePointer(0);
+
+    WaveshaperKernels::ParamRamps<T> ramps;
+    ramps.preGain = rampBuffer.getReadPointer(0);
+    ramps.gainDb = rampBuffer.getReadPointer(1);
+    ramps.threshold = rampBuffer.getReadPointer(2);
+    ramps.mix = rampBuffer.getReadPointer(3);
+
+    // The oversampler is sized for the block size given to prepareToPlay, larger host blocks are split
+    for (int start = segmentStart; start < segmentStart + segmentLength; start += maxBlockSize)
+    {
+        auto numSamples = jmin(maxBlockSize, segmentStart + segmentLength - start);
+        auto numOversampled = numSamples * factor;
+
+        // Steady parameters take the constant kernels, ramps are only written while something is moving
+        auto smoothing = curveRamps.isSmoothing();
+        auto* blockRamps = smoothing ? &ramps : nullptr;
+
+        if (smoothing)
+            curveRamps.fill(rampBuffer.getArrayOfWritePointers(), numOversampled);
+
+        // Where a kernel can't follow a ramp per sample it takes the value reached at the end of the sub-block
+        auto params = curveRamps.getCurrentParams();
+
+        // Once a channel's input has been silent for longer than the tail, its output has settled on
+        // the curve's value for 0 (only ScoopFold's isn't 0), so there is nothing left to compute
+        auto silentLevel = silentCurve != nullptr ? silentCurve(T(), params) * (T) params.mix : T();
+        auto settledAfter = tailLengthSamples.load(std::memory_order_relaxed) + numSamples;
+        auto isSettled = [&](int channel) { return silentRun[(size_t) channel] >= settledAfter; };
+        auto allSettled = true;
+
+        for (int channel = 0; channel < totalNumInputChannels; ++channel)
+        {
+            channelPointers[(size_t) channel] = buffer.getWritePointer(channel, start);
+
+            auto& run = silentRun[(size_t) channel];
+            auto isSilent = ! smoothing && ! multiband && ! toneActive && typeFadeRemaining == 0 && ! isChangingFactor()
+                              && buffer.getMagnitude(channel, start, numSamples) < silenceThreshold;
+            run = isSilent ? jmin(run + numSamples, 1 << 30) : 0;
+            allSettled = allSettled && isSettled(channel);
+        }
+
+        if (allSettled)
+        {
+            for (int channel = 0; channel < totalNumInputChannels; ++channel)
+            {
+                FloatVectorOperations::fill(channelPointers[(size_t) channel], silentLevel, numSamples);
+                adaaState[(size_t) channel] = {};
+            }
+
+            continue;
+        }
+
+        // The tone filters and the oversampling filters take several channels at once in the lanes of a SIMD register
+        state.preTone.process(channelPointers.data(), totalNumInputChannels, 0, numSamples);
+
+        // While the governor changes the factor, the outgoing one runs on a copy of the same input. It takes
+        // the curve as it stands at the end of the sub-block, and no TYPE fade, for the few blocks it's heard.
+        auto changingFactor = isChangingFactor();
+        auto* fadeChannels = state.factorFadeBuffer.getArrayOfWritePointers();
+
+        if (changingFactor)
+        {
+            auto& fadeOversampler = state.fadeOversampler;
+
+            for (int channel = 0; channel < totalNumInputChannels; ++channel)
+                FloatVectorOperations::copy(fadeChannels[channel], channelPointers[(size_t) channel], numSamples);
+
+            fadeOversampler.processUp(fadeChannels, totalNumInputChannels, numSamples);
+            auto numFadeOversampled = numSamples * fadeOversampler.getFactor();
+
+            if (multiband)
+            {
+                for (int channel = 0; channel < totalNumInputChannels; ++channel)
+                    oversampledPointers[(size_t) channel] = fadeOversampler.getOversampledData(channel);
+
+                for (size_t band = 0; band < bandRamps.size(); ++band)
+                    state.fadeMultiband.setBand((int) band, (int) bandTypeParams[band]->load(), bandRamps[band].getCurrentParams());
+
+                state.fadeMultiband.process(oversampledPointers.data(), totalNumInputChannels, 0, numFadeOversampled);
+            }
+            else
+            {
+                for (int channel = 0; channel < totalNumInputChannels; ++channel)
+                {
+                    auto* oversampled = fadeOversampler.getOversampledData(channel);
+
+                    if (adaaKernel != nullptr)
+                        adaaKernel(fadeAdaaState[(size_t) channel], adaaScratch, oversampled, oversampled, numFadeOversampled, params, nullptr);
+                    else if (table != nullptr && tableKernel != nullptr)
+                        tableKernel(*table, oversampled, oversampled, numFadeOversampled, params, nullptr);
+                    else if (kernel != nullptr)
+                        kernel(oversampled, oversampled, numFadeOversampled, params, nullptr);
+                    else
+                        FloatVectorOperations::multiply(oversampled, (T) (1 - params.mix), numFadeOversampled);
+                }
+            }
+
+            fadeOversampler.processDown(fadeChannels, totalNumInputChannels, numSamples);
+            state.fadeLatencyDelay.process(fadeChannels, totalNumInputChannels, numSamples);
+        }
+
+        oversampler.processUp(channelPointers.data(), totalNumInputChannels, numSamples);
+
+        // The bands of all channels are split, shaped and summed together, with the direct curves
+        if (multiband)
+        {
+            for (int channel = 0; channel < totalNumInputChannels; ++channel)
+                oversampledPointers[(size_t) channel] = oversampler.getOversampledData(channel);
+
+            processBands(state.multiband, oversampledPointers.data(), totalNumInputChannels, numOversampled);
+        }
+        else
+        {
+            auto numFading = jmin(numOversampled, typeFadeRemaining);
+
+            for (int channel = 0; channel < totalNumInputChannels; ++channel)
+            {
+                auto* oversampled = oversampler.getOversampledData(channel);
+
+                // The outgoing curve shapes a copy of the start of the sub-block, from its own copy of the
+                // antialiasing history, which only holds past input and so is the same for every TYPE
+                if (numFading > 0)
+                {
+                    FloatVectorOperations::copy(fadeBuffer, oversampled, numFading);
+                    auto fadeState = adaaState[(size_t) channel];
+
+                    if (fadeAdaaKernel != nullptr)
+                        fadeAdaaKernel(fadeState, adaaScratch, fadeBuffer, fadeBuffer, numFading, params, blockRamps);
+                    else if (fadeKernel != nullptr)
+                        fadeKernel(fadeBuffer, fadeBuffer, numFading, params, blockRamps);
+                    else
+                        FloatVectorOperations::multiply(fadeBuffer, (T) (1 - params.mix), numFading);
+                }
+
+                if (isSettled(channel))
+                {
+                    FloatVectorOperations::fill(oversampled, silentLevel, numOversampled);
+                    adaaState[(size_t) channel] = {};
+                }
+                else if (adaaKernel != nullptr)
+                    adaaKernel(adaaState[(size_t) channel], adaaScratch, oversampled, oversampled, numOversampled, params, blockRamps);
+                else if (table != nullptr && tableKernel != nullptr)
+                    tableKernel(*table, oversampled, oversampled, numOversampled, params, blockRamps);
+                else if (kernel != nullptr)
+                    kernel(oversampled, oversampled, numOversampled, params, blockRamps);
+                else
+                    FloatVectorOperations::multiply(oversampled, (T) (1 - params.mix), numOversampled);
+
+                if (numFading > 0)
+                    crossfadeTypes(oversampled, (const T*) fadeBuffer, numFading, typeFadeRemaining, typeFadeLength);
+            }
+
+            // back to a single kernel as soon as this reaches 0
+            typeFadeRemaining -= numFading;
+        }
+
+        oversampler.processDown(channelPointers.data(), totalNumInputChannels, numSamples);
+
+        // Makes up the latency of any oversampling the governor has taken away
+        state.latencyDelay.process(channelPointers.data(), totalNumInputChannels, numSamples);
+
+        // Only the outgoing factor is heard until the new one has filled, then it fades across
+        if (changingFactor)
+        {
+            auto numWarming = jmin(numSamples, factorWarmupRemaining);
+            auto numFading = jmin(numSamples - numWarming, factorFadeRemaining);
+
+            for (int channel = 0; channel < totalNumInputChannels; ++channel)
+            {
+                auto* data = channelPointers[(size_t) channel];
+                FloatVectorOperations::copy(data, fadeChannels[channel], numWarming);
+                crossfadeFactors(data + numWarming, (const T*) fadeChannels[channel] + numWarming, numFading, factorFadeRemaining, factorFadeLength);
+            }
+
+            factorWarmupRemaining -= numWarming;
+            factorFadeRemaining -= numFading;
+        }
+
+        state.postTone.process(channelPointers.data(), totalNumInputChannels, 0, numSamples);
+    }
+}
+
+// Both processBlock overloads land here, every kernel below is compiled once per sample type
+template <typename T>
+void EZDistortionAudioProcessor::process (juce::AudioBuffer<T>& buffer)
+{
+    // Every block's wall-clock cost against its real-time budget, for the editor's hidden panel
+    ProcessTimer::ScopedMeasurement measurement (processTimer, buffer.getNumSamples());
+
+    // The governor measures the same for itself. It stays at full quality in offline renders.
+    governor.setMode(governorParam->load() > 0.5f, isNonRealtime());
+    QualityGovernor::ScopedMeasurement governorMeasurement (governor, buffer.getNumSamples());
+
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -148,84 +891,286 @@ void EZDistortionAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    auto& mix = *apvts.getRawParameterValue("MIX");
-    auto& gain = *apvts.getRawParameterValue("GAIN");
-    auto& type = *apvts.getRawParameterValue("TYPE");
-    auto& thresh = *apvts.getRawParameterValue("THRESHOLD");
-    int typeInt = (int) type;
-    auto gainDigital = juce::Decibels::decibelsToGain((float) gain);
-    auto threshDigital = juce::Decibels::decibelsToGain((float) thresh);
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
+    // prepareToPlay only allocates for the precision the host asked for
+    auto& state = getPrecisionState<T>();
+
+    jassert (maxBlockSize > 0 && state.rampBuffer.getNumSamples() > 0);
+    if (maxBlockSize <= 0 || state.rampBuffer.getNumSamples() == 0)
+    {
+        numParameterEvents = 0;
+        return;
+    }
+
+    blocksProcessed.fetch_add(1);
+
+    // A staged program is taken here. Most are applied straight away, and their settings glide there from the
+    // old ones. One that changes the signal path fades out first, and is switched to where the fade ends.
+    if (programSwitch != switchFadingIn)
     {
-        for (int sample = 0; sample < buffer.getNumSamples(); sample++)
+        auto program = pendingProgram.exchange(-1);
+
+        if (isPositiveAndBelow(program, presetBank->size()))
         {
-            float newSample = 0;
-            float sampleValue = buffer.getSample(channel, sample);
-            float gainSample = sampleValue * (1+gainDigital);
-            float newGain = 0;
-            float gainSample1 = 0;
-            float foldThresh = 0;
-            float foldRatio = 0;
-        
-            switch (typeInt) {
-                case 1:
-                    if (gainSample <= -threshDigital)
-                        newSample = -2/3;
-                    else if (gainSample > -threshDigital && gainSample < threshDigital)
-                        newSample = gainSample - (gainSample * gainSample * gainSample)/3;
-                    else if (gainSample <= threshDigital)
-                        newSample = 2/3;
-                    break;
-                case 2:
-                    if (gainSample <= -threshDigital)
-                        newSample = -1;
-                    else if (gainSample > -threshDigital && gainSample < threshDigital)
-                        newSample = gainSample;
-                    else if (gainSample >= threshDigital)
-                        newSample = 1;
-                    break;
-                case 3:
-                    newSample = foldback(gainSample, threshDigital);
-                    break;
-                case 4:
-                    foldThresh = threshDigital * 10;
-                    newGain = gain * foldThresh;
-                    gainSample1 = sampleValue * newGain;
-                    foldRatio = 1 / foldThresh;
-                    newSample = foldRatio * (abs(foldRatio * gainSample1 + foldRatio - round(foldRatio * gainSample1 + foldRatio) - .25));
-                    break;
-                default:
-                    break;
+            // during a fade out, the latest program is the one switched to
+            if (programSwitch == switchFadingOut)
+                stagedProgram = program;
+            else if (programNeedsDip((*presetBank)[program].parameters))
+            {
+                stagedProgram = program;
+                programSwitch = switchFadingOut;
+                programFadeRemaining = programFadeLength;
             }
-            
-            buffer.setSample(channel, sample, sampleValue * (1-mix) + newSample * mix);
+            else
+                applyProgramOnAudioThread(program);
         }
     }
+
+    // Nothing is measured unless an editor is open to show it
+    auto metering = signalTap.isActive() && buffer.getNumSamples() > 0;
+    SignalTap::Levels levels;
+
+    if (metering)
+        measureLevels(buffer, totalNumInputChannels, levels.inputPeak, levels.inputRms);
+
+    // Queued events split the block at the samples they land on, and the parameters are read again
+    // from there. Without any the whole block is one segment, and nothing is read per sample either way.
+    auto numSamples = buffer.getNumSamples();
+    int start = 0, eventIndex = 0;
+
+    // A fade out ending in this block splits it too. The staged program's values go in where the
+    // output is silent, and processing starts over from them with the old signal forgotten.
+    auto switchOffset = programSwitch == switchFadingOut && programFadeRemaining < numSamples ? programFadeRemaining : -1;
+
+    do
+    {
+        while (eventIndex < numParameterEvents && parameterEvents[(size_t) eventIndex].sampleOffset <= start)
+            applyParameterEvent(parameterEvents[(size_t) eventIndex++]);
+
+        auto resuming = start == switchOffset;
+
+        if (resuming)
+            applyProgramOnAudioThread(stagedProgram);
+
+        auto end = eventIndex < numParameterEvents ? jmin(parameterEvents[(size_t) eventIndex].sampleOffset, numSamples) : numSamples;
+
+        if (switchOffset > start)
+            end = jmin(end, switchOffset);
+
+        processSegment(buffer, start, end - start, resuming);
+        start = end;
+    }
+    while (start < numSamples);
+
+    // Anything queued past the end of the block still takes effect
+    while (eventIndex < numParameterEvents)
+        applyParameterEvent(parameterEvents[(size_t) eventIndex++]);
+
+    numParameterEvents = 0;
+
+    applyProgramFade(buffer, totalNumInputChannels, switchOffset);
+    applyModeFade(buffer, totalNumInputChannels);
+
+    // The cabinet follows everything else on the whole block. Its first partition is applied directly,
+    // so it adds nothing to the latency. It rings on through the dips above, and switching it on starts it from silence.
+    auto cabinetOn = cabParam->load() > 0.5f;
+
+    if (cabinetOn && ! cabinetActive)
+        cabinet.reset();
+
+    cabinetActive = cabinetOn;
+
+    if (cabinetOn)
+        cabinet.process(buffer.getArrayOfWritePointers(), totalNumInputChannels, numSamples, cabMixParam->load());
+
+    if (metering)
+    {
+        measureLevels(buffer, totalNumInputChannels, levels.outputPeak, levels.outputRms);
+        signalTap.pushLevels(levels);
+
+        if (totalNumInputChannels > 0)
+            signalTap.pushScope(buffer.getReadPointer(0), buffer.getNumSamples());
+    }
 }
 
 //==============================================================================
 bool EZDistortionAudioProcessor::hasEditor() const
 {
+   #if EZ_DISTORTION_HEADLESS
+    return false;
+   #else
     return true; // (change this to false if you choose to not supply an editor)
+   #endif
 }
 
 juce::AudioProcessorEditor* EZDistortionAudioProcessor::createEditor()
 {
+   #if EZ_DISTORTION_HEADLESS
+    return nullptr;
+   #else
     return new EZDistortionAudioProcessorEditor (*this);
+   #endif
+}
+
+//==============================================================================
+bool EZDistortionAudioProcessor::queueParameterEvent (const ParameterEvent& event)
+{
+    jassert (isPositiveAndBelow(event.parameterIndex, PresetBank::numParameters));
+
+    if (! isPositiveAndBelow(event.parameterIndex, PresetBank::numParameters) || numParameterEvents == maxParameterEvents)
+        return false;
+
+    // Kept in order of offset, events at the same offset stay in the order they were queued
+    auto* first = parameterEvents.data();
+    auto* last = first + numParameterEvents;
+    auto* position = std::upper_bound(first, last, event.sampleOffset,
+                                      [](int offset, const ParameterEvent& e) { return offset < e.sampleOffset; });
+
+    std::move_backward(position, last, last + 1);
+    *position = event;
+    ++numParameterEvents;
+    return true;
+}
+
+void EZDistortionAudioProcessor::applyParameterEvent (const ParameterEvent& event)
+{
+    // The caller's own automation, so it isn't echoed back. The raw value the segment reads follows straight away.
+    setParameterOnAudioThread(event.parameterIndex, event.value);
+}
+
+void EZDistortionAudioProcessor::applyParameters (const PresetBank::ParameterSet& values)
+{
+    for (int i = 0; i < PresetBank::numParameters; ++i)
+        if (values.contains(i))
+            parameters[(size_t) i]->setValueNotifyingHost(parameters[(size_t) i]->convertTo0to1(values.values[(size_t) i]));
+}
+
+// Sets both the parameter's own value and the raw value processBlock reads, without locking or notifying anyone
+void EZDistortionAudioProcessor::setParameterOnAudioThread (int index, float normalisedValue) noexcept
+{
+    auto* parameter = parameters[(size_t) index];
+    parameter->setValue(normalisedValue);
+    rawValues[(size_t) index]->store(parameter->convertFrom0to1(parameter->getValue()));
+}
+
+void EZDistortionAudioProcessor::applyProgramOnAudioThread (int program) noexcept
+{
+    if (! isPositiveAndBelow(program, presetBank->size()))
+        return;
+
+    const auto& values = (*presetBank)[program].parameters;
+
+    for (int i = 0; i < PresetBank::numParameters; ++i)
+        if (values.contains(i))
+            setParameterOnAudioThread(i, parameters[(size_t) i]->convertTo0to1(values.values[(size_t) i]));
+
+    programApplied.store(true);
+}
+
+// Whether a program changes anything that has no glide or crossfade of its own
+bool EZDistortionAudioProcessor::programNeedsDip (const PresetBank::ParameterSet& values) const noexcept
+{
+    // found by the raw value, so nothing here allocates a string
+    auto differs = [&](const std::atomic<float>* raw)
+    {
+        for (int i = 0; i < PresetBank::numParameters; ++i)
+            if (rawValues[(size_t) i] == raw)
+                return values.contains(i) && values.values[(size_t) i] != raw->load();
+
+        return false;
+    };
+
+    if (differs(bandsParam) || differs(antialiasParam) || differs(cabParam))
+        return true;
+
+    // the bands switch curves without the TYPE crossfade
+    if (bandsParam->load() > 0.5f)
+        for (auto* type : bandTypeParams)
+            if (differs(type))
+                return true;
+
+    return false;
+}
+
+void EZDistortionAudioProcessor::timerCallback()
+{
+    // With no blocks coming in, a staged program would never be taken, so it's applied here instead
+    auto blocks = blocksProcessed.load();
+    auto audioStopped = blocks == lastBlocksProcessed;
+    lastBlocksProcessed = blocks;
+
+    if (audioStopped)
+    {
+        auto program = pendingProgram.exchange(-1);
+
+        if (isPositiveAndBelow(program, presetBank->size()))
+            applyParameters((*presetBank)[program].parameters);
+    }
+
+    // The editor and host catch up with a program the audio thread has applied
+    if (programApplied.exchange(false))
+    {
+        for (auto* parameter : parameters)
+            parameter->sendValueChangedMessageToListeners(parameter->getValue());
+
+        updateHostDisplay(ChangeDetails().withProgramChanged(true));
+    }
+}
+
+PresetBank::ParameterSet EZDistortionAudioProcessor::getParameterSet() const
+{
+    PresetBank::ParameterSet values;
+
+    for (int i = 0; i < PresetBank::numParameters; ++i)
+        values.values[(size_t) i] = parameters[(size_t) i]->convertFrom0to1(parameters[(size_t) i]->getValue());
+
+    return values;
+}
+
+bool EZDistortionAudioProcessor::saveUserPreset (const juce::File& file)
+{
+    MemoryBlock data;
+    PresetBank::write(data, getParameterSet(), 0);
+    return file.getParentDirectory().createDirectory().wasOk() && file.replaceWithData(data.getData(), data.getSize());
 }
 
 //==============================================================================
 void EZDistortionAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    // Binary rather than XML, so sessions with many instances load quickly.
+    // The cabinet's response goes after the parameters, where older versions don't look.
+    MemoryBlock cabinetState;
+    cabinet.writeState(cabinetState);
+
+    PresetBank::write(destData, getParameterSet(), currentProgram.load(), cabinetState);
 }
 
 void EZDistortionAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    PresetBank::ParameterSet values;
+    MemoryBlock cabinetState;
+    int program = 0;
+
+    if (PresetBank::read(data, sizeInBytes, values, program, &cabinetState))
+    {
+        cabinet.readState(cabinetState.getData(), cabinetState.getSize());
+
+        // A parameter the session was saved without starts from its default
+        for (int i = 0; i < PresetBank::numParameters; ++i)
+        {
+            auto* parameter = parameters[(size_t) i];
+            parameter->setValueNotifyingHost(values.contains(i) ? parameter->convertTo0to1(values.values[(size_t) i])
+                                                                : parameter->getDefaultValue());
+        }
+
+        currentProgram.store(jlimit(0, getNumPrograms() - 1, program));
+        return;
+    }
+
+    // Sessions saved before the binary format
+    std::unique_ptr<XmlElement> xml (getXmlFromBinary (data, sizeInBytes));
+
+    if (xml != nullptr && xml->hasTagName (apvts.state.getType()))
+        apvts.replaceState (ValueTree::fromXml (*xml));
 }
 
 //==============================================================================
@@ -9,11 +9,23 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "Oversampler.h"
+#include "ADAAKernels.h"
+#include "TransferTableBuilder.h"
+#include "ParameterRamp.h"
+#include "SignalTap.h"
+#include "PresetBank.h"
+#include "MultibandDistortion.h"
+#include "ProcessTimer.h"
+#include "QualityGovernor.h"
+#include "ToneFilters.h"
+#include "CabinetStage.h"
 using namespace juce;
 //==============================================================================
 /**
 */
-class EZDistortionAudioProcessor  : public juce::AudioProcessor
+class EZDistortionAudioProcessor  : public juce::AudioProcessor,
+                                    private juce::Timer
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
@@ -22,6 +34,10 @@ private:
     
 public:
     AudioProcessorValueTreeState apvts;
+    SignalTap signalTap;
+    ProcessTimer processTimer;
+    QualityGovernor governor;
+    CabinetStage cabinet;
     //==============================================================================
     EZDistortionAudioProcessor();
     ~EZDistortionAudioProcessor() override;
@@ -35,6 +51,8 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -67,7 +85,241 @@ public:
           }
           return samp;
     }
-    
+
+    static constexpr int maxNumChannels = 16;
+
+    //==============================================================================
+    /** A parameter change that lands partway through the next block. parameterIndex
+        indexes PresetBank::parameterIds, value is normalised as for setValue().
+    */
+    struct ParameterEvent
+    {
+        int sampleOffset;
+        int parameterIndex;
+        float value;
+    };
+
+    static constexpr int maxParameterEvents = 256;
+
+    /** For wrappers and tools that know where in a block automation lands. Call on the
+        audio thread before processBlock(): the block is split at each event's offset and
+        the value applied there, without locking or notifying the host. Returns false if the
+        event is invalid or the queue is full.
+    */
+    bool queueParameterEvent (const ParameterEvent& event);
+
+    /** Writes the current parameters to a preset file, see PresetBank. The bank is shared and never
+        changes, so the preset is one of the programs once it's built again, with no instance open.
+    */
+    bool saveUserPreset (const juce::File& file);
+
+private:
+    /** What the float and double paths each need of their own. Only the precision
+        the host asked for in prepareToPlay is allocated.
+    */
+    template <typename T>
+    struct PrecisionState
+    {
+        void prepare (int numChannels, int maxBlockSize)
+        {
+            oversampler.prepare(numChannels, maxBlockSize);
+            fadeOversampler.prepare(numChannels, maxBlockSize);
+
+            // The most latency the governor can take away is all of the oversampling's, plus a sample of ADAA's
+            auto maxLatency = jmax(oversampler.getLatencyInSamples(Oversampler<T>::maxFactorLog2, Oversampler<T>::linearPhase),
+                                   oversampler.getLatencyInSamples(Oversampler<T>::maxFactorLog2, Oversampler<T>::minimumPhase));
+            latencyDelay.prepare(numChannels, (int) std::ceil(maxLatency) + 2);
+            fadeLatencyDelay.prepare(numChannels, (int) std::ceil(maxLatency) + 2);
+            rampBuffer.setSize(4, maxBlockSize << Oversampler<T>::maxFactorLog2);
+            typeFadeBuffer.setSize(1, maxBlockSize << Oversampler<T>::maxFactorLog2);
+            factorFadeBuffer.setSize(numChannels, maxBlockSize);
+            channelPointers.assign((size_t) numChannels, nullptr);
+            oversampledPointers.assign((size_t) numChannels, nullptr);
+            multiband.prepare(numChannels);
+            fadeMultiband.prepare(numChannels);
+            preTone.prepare(numChannels);
+            postTone.prepare(numChannels);
+        }
+
+        void release()
+        {
+            oversampler.release();
+            fadeOversampler.release();
+            latencyDelay.release();
+            fadeLatencyDelay.release();
+            rampBuffer.setSize(0, 0);
+            typeFadeBuffer.setSize(0, 0);
+            factorFadeBuffer.setSize(0, 0);
+            channelPointers = {};
+            oversampledPointers = {};
+            multiband.release();
+            fadeMultiband.release();
+            preTone.release();
+            postTone.release();
+        }
+
+        Oversampler<T> oversampler;
+        CompensationDelay<T> latencyDelay;
+        AudioBuffer<T> rampBuffer, typeFadeBuffer;
+        std::vector<T*> channelPointers, oversampledPointers;
+        MultibandDistortion<T> multiband;
+        ToneFilter<T> preTone, postTone;
+
+        // The outgoing factor's path while the governor changes it, with everything it has built up
+        Oversampler<T> fadeOversampler;
+        CompensationDelay<T> fadeLatencyDelay;
+        MultibandDistortion<T> fadeMultiband;
+        AudioBuffer<T> factorFadeBuffer;
+    };
+
+    template <typename T>
+    PrecisionState<T>& getPrecisionState() noexcept
+    {
+        if constexpr (std::is_same_v<T, float>)
+            return floatState;
+        else
+            return doubleState;
+    }
+
+    template <typename T>
+    void process (juce::AudioBuffer<T>& buffer);
+
+    template <typename T>
+    void processSegment (juce::AudioBuffer<T>& buffer, int segmentStart, int segmentLength, bool resuming);
+
+    /** Moves the oversampler towards factorLog2 and the OS_FILTER setting, and returns the factor now in use.
+        The host is told the latency at latencyFactorLog2, and lower factors are delayed to match it.
+        A new factor with the same latency crossfades from the old one. Anything else changes at the
+        bottom of a dip through silence, or straight away if immediate is true.
+    */
+    template <typename T>
+    int updateOversampling (PrecisionState<T>& state, int factorLog2, int latencyFactorLog2, bool immediate);
+
+    bool isChangingFactor() const noexcept      { return factorWarmupRemaining > 0 || factorFadeRemaining > 0; }
+
+    QualityGovernor::Quality getRequestedQuality() const noexcept;
+    QualityGovernor::Usage getQualityUsage (int type, int numBands) const noexcept;
+
+    void updateParameterRamps (int factor, bool snapToTargets);
+
+    using ToneParams = std::array<std::atomic<float>*, ToneDesign::numControls>;
+    static ToneDesign::Settings getToneSettings (const ToneParams& params) noexcept;
+
+    template <typename T>
+    void processBands (MultibandDistortion<T>& multiband, T* const* channels, int numChannels, int numSamples);
+
+    template <typename T>
+    void applyProgramFade (juce::AudioBuffer<T>& buffer, int numChannels, int switchOffset);
+
+    template <typename T>
+    void applyModeFade (juce::AudioBuffer<T>& buffer, int numChannels);
+
+    void applyParameterEvent (const ParameterEvent& event);
+    void applyParameters (const PresetBank::ParameterSet& values);
+    void setParameterOnAudioThread (int index, float normalisedValue) noexcept;
+    void applyProgramOnAudioThread (int program) noexcept;
+    bool programNeedsDip (const PresetBank::ParameterSet& values) const noexcept;
+    PresetBank::ParameterSet getParameterSet() const;
+    void timerCallback() override;
+
+    // resolved once in the constructor, processBlock never looks parameters up by name
+    std::atomic<float>* mixParam = nullptr;
+    std::atomic<float>* gainParam = nullptr;
+    std::atomic<float>* thresholdParam = nullptr;
+    std::atomic<float>* typeParam = nullptr;
+    std::atomic<float>* oversamplingParam = nullptr;
+    std::atomic<float>* osFilterParam = nullptr;
+    std::atomic<float>* antialiasParam = nullptr;
+    std::atomic<float>* engineParam = nullptr;
+    std::atomic<float>* tableSizeParam = nullptr;
+    std::atomic<float>* tableInterpParam = nullptr;
+    std::atomic<float>* curveAccuracyParam = nullptr;
+    std::atomic<float>* governorParam = nullptr;
+    std::atomic<float>* bandsParam = nullptr;
+    std::array<std::atomic<float>*, MultibandDesign::maxCrossovers> crossoverParams {};
+    std::array<std::atomic<float>*, MultibandDesign::maxBands> bandTypeParams {}, bandGainParams {}, bandThresholdParams {}, bandMixParams {};
+    ToneParams preToneParams {}, postToneParams {};
+    std::atomic<float>* cabParam = nullptr;
+    std::atomic<float>* cabMixParam = nullptr;
+    bool cabinetActive = false;
+
+    // MIX, GAIN and THRESHOLD glide to new values at the oversampled rate, as do each band's.
+    // While a band glides its curve is updated every bandRampStep oversampled samples.
+    static constexpr double rampLengthSeconds = 0.05;
+    static constexpr int bandRampStep = 32;
+    CurveRamps curveRamps;
+    std::array<CurveRamps, MultibandDesign::maxBands> bandRamps;
+    double currentSampleRate = 44100.0;
+    int rampFactor = 0;
+
+    // A new TYPE or curve accuracy fades in over typeFadeSeconds, with the previous curve still running until it's gone
+    static constexpr double typeFadeSeconds = 0.01;
+    int currentType = 0, previousType = 0;
+    int currentAccuracy = 0, previousAccuracy = 0;
+    int typeFadeLength = 1, typeFadeRemaining = 0;
+
+    // A new oversampling mode starts its filters over, so the output dips through silence while it changes
+    enum ModeSwitch
+    {
+        modeIdle,
+        modeFadingOut,
+        modeSwitching,      // silent, the next segment switches
+        modeFadingIn
+    };
+
+    static constexpr double modeFadeSeconds = 0.003;
+    int modeSwitch = modeIdle;
+    int modeFadeLength = 1, modeFadeRemaining = 0;
+
+    // Except for the governor's factor steps, which keep the latency: the new factor runs alongside the
+    // old one until its filters and delay have filled, then fades in over factorFadeSeconds
+    static constexpr double factorFadeSeconds = 0.01;
+    int factorWarmupRemaining = 0;
+    int factorFadeLength = 1, factorFadeRemaining = 0;
+
+    PrecisionState<float> floatState;
+    PrecisionState<double> doubleState;
+    ADAAKernels::Scratch adaaScratch;
+    std::vector<ADAAKernels::ChannelState> adaaState, fadeAdaaState;
+
+    // Input below -120 dBFS counts as silence, silentRun counts each channel's silent samples in a row
+    static constexpr float silenceThreshold = 1.0e-6f;
+    std::vector<int> silentRun;
+
+    // Written by the audio thread as the oversampling changes, read by the host through getTailLengthSeconds()
+    std::atomic<int> tailLengthSamples { 0 };
+    TransferTableBuilder tableBuilder;
+    int maxBlockSize = 0;
+
+    // Programs are staged by setCurrentProgram(), which may be called on the audio thread, and the
+    // audio thread applies them itself at the start of its next block. The settings then glide and
+    // crossfade from the old values as they would for automation. A program that changes the signal
+    // path, such as BANDS, is switched at the bottom of a short fade out instead, and fades back in.
+    enum ProgramSwitch
+    {
+        switchIdle,
+        switchFadingOut,    // stagedProgram is applied where the fade reaches silence
+        switchFadingIn
+    };
+
+    static constexpr double programFadeSeconds = 0.005;
+    juce::SharedResourcePointer<PresetBank> presetBank;
+    std::array<RangedAudioParameter*, PresetBank::numParameters> parameters {};
+    std::array<std::atomic<float>*, PresetBank::numParameters> rawValues {};
+    std::atomic<int> currentProgram { 0 }, pendingProgram { -1 };
+    int programSwitch = switchIdle, stagedProgram = -1;
+    int programFadeLength = 1, programFadeRemaining = 0;
+
+    // The audio thread doesn't notify anyone. The timer tells the editor and host about an applied
+    // program, and applies a staged one itself while no blocks are coming in.
+    std::atomic<bool> programApplied { false };
+    std::atomic<uint32> blocksProcessed { 0 };
+    uint32 lastBlocksProcessed = 0;
+
+    // Events for the next block, sorted by offset. Only touched on the audio thread.
+    std::array<ParameterEvent, maxParameterEvents> parameterEvents {};
+    int numParameterEvents = 0;
+
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EZDistortionAudioProcessor)
 };
@@ -0,0 +1,222 @@
+/*
+  ==============================================================================
+
+    PresetBank.h
+    The plugin's programs: the factory presets, then any user presets found
+    in the user preset folder. The bank is built once per process and shared
+    by every instance, and never changes afterwards, so the audio thread can
+    read it without locking.
+
+    Sessions and preset files use the same compact binary format: a magic
+    number, a format version, then each parameter's ID and real value. IDs
+    the reader doesn't know are skipped, and parameters the writer didn't
+    know are reported as missing, so old and new versions can read each
+    other's files. Anything after the parameters, such as the cabinet's
+    impulse response, is passed through as it is, and older readers ignore it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+
+class PresetBank
+{
+public:
+    /** Every parameter a preset or session can hold, in the processor's layout order. */
+    static constexpr const char* parameterIds[] = { "MIX", "GAIN", "THRESHOLD", "TYPE",
+                                                    "OVERSAMPLING", "OS_FILTER", "ANTIALIAS",
+                                                    "ENGINE", "TABLE_SIZE", "TABLE_INTERP", "CURVE_ACCURACY", "GOVERNOR",
+                                                    "BANDS", "CROSSOVER_1", "CROSSOVER_2", "CROSSOVER_3",
+                                                    "BAND1_TYPE", "BAND1_GAIN", "BAND1_THRESHOLD", "BAND1_MIX",
+                                                    "BAND2_TYPE", "BAND2_GAIN", "BAND2_THRESHOLD", "BAND2_MIX",
+                                                    "BAND3_TYPE", "BAND3_GAIN", "BAND3_THRESHOLD", "BAND3_MIX",
+                                                    "BAND4_TYPE", "BAND4_GAIN", "BAND4_THRESHOLD", "BAND4_MIX",
+                                                    "PRE_TILT", "PRE_LOW_CUT", "PRE_HIGH_CUT", "PRE_MID_FREQ", "PRE_MID_GAIN",
+                                                    "POST_TILT", "POST_LOW_CUT", "POST_HIGH_CUT", "POST_MID_FREQ", "POST_MID_GAIN",
+                                                    "CAB", "CAB_MIX" };
+
+    static constexpr int numParameters = (int) std::size (parameterIds);
+
+    /** Real parameter values, indexed like parameterIds. NaN marks a parameter the set doesn't include. */
+    struct ParameterSet
+    {
+        ParameterSet() noexcept     { values.fill (std::nanf ("")); }
+
+        bool contains (int index) const noexcept    { return ! std::isnan (values[(size_t) index]); }
+
+        std::array<float, numParameters> values;
+    };
+
+    struct Preset
+    {
+        juce::String name;
+        ParameterSet parameters;
+    };
+
+    static constexpr juce::uint32 magic = 0x53445a45;     // "EZDS" as stored, little endian
+    static constexpr int formatVersion = 1;
+
+    //==============================================================================
+    PresetBank()
+    {
+        addFactoryPresets();
+
+        // Preset files are in the session format, named after the preset
+        auto files = getUserPresetFolder().findChildFiles (juce::File::findFiles, false, "*" + juce::String (fileExtension));
+        files.sort();
+
+        for (auto& file : files)
+        {
+            juce::MemoryBlock data;
+            Preset preset;
+            int program;
+
+            if (file.loadFileAsData (data) && read (data.getData(), (int) data.getSize(), preset.parameters, program))
+            {
+                preset.name = file.getFileNameWithoutExtension();
+                presets.push_back (preset);
+            }
+        }
+    }
+
+    int size() const noexcept                           { return (int) presets.size(); }
+    const Preset& operator[] (int index) const noexcept { return presets[(size_t) index]; }
+
+    static constexpr const char* fileExtension = ".ezpreset";
+
+    static juce::File getUserPresetFolder()
+    {
+        return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+                   .getChildFile ("EZ Distortion").getChildFile ("Presets");
+    }
+
+    //==============================================================================
+    static void write (juce::MemoryBlock& destData, const ParameterSet& parameters, int program,
+                       const juce::MemoryBlock& extraData = {})
+    {
+        juce::MemoryOutputStream stream (destData, false);
+        stream.writeInt ((int) magic);
+        stream.writeCompressedInt (formatVersion);
+        stream.writeCompressedInt (program);
+        stream.writeCompressedInt (numParameters);
+
+        for (int i = 0; i < numParameters; ++i)
+        {
+            stream.writeString (parameterIds[i]);
+            stream.writeFloat (parameters.values[(size_t) i]);
+        }
+
+        stream.write (extraData.getData(), extraData.getSize());
+    }
+
+    /** Returns false if the data isn't in this format, e.g. an older XML session. What follows the
+        parameters goes into extraData if it is given.
+    */
+    static bool read (const void* data, int sizeInBytes, ParameterSet& parameters, int& program,
+                      juce::MemoryBlock* extraData = nullptr)
+    {
+        if (data == nullptr || sizeInBytes < 8)
+            return false;
+
+        juce::MemoryInputStream stream (data, (size_t) sizeInBytes, false);
+
+        if ((juce::uint32) stream.readInt() != magic)
+            return false;
+
+        // A newer format may have changed the layout, not just added parameters
+        if (stream.readCompressedInt() > formatVersion)
+            return false;
+
+        program = stream.readCompressedInt();
+        parameters = {};
+
+        for (int count = stream.readCompressedInt(); --count >= 0 && ! stream.isExhausted();)
+        {
+            auto id = stream.readString();
+            auto value = stream.readFloat();
+            auto index = indexOf (id);
+
+            if (index >= 0 && std::isfinite (value))
+                parameters.values[(size_t) index] = value;
+        }
+
+        if (extraData != nullptr)
+        {
+            extraData->reset();
+            stream.readIntoMemoryBlock (*extraData);
+        }
+
+        return true;
+    }
+
+    static int indexOf (const juce::String& id) noexcept
+    {
+        for (int i = 0; i < numParameters; ++i)
+            if (id == parameterIds[i])
+                return i;
+
+        return -1;
+    }
+
+private:
+    struct FactoryPreset
+    {
+        const char* name;
+        float mix, gainDb, thresholdDb;
+        int type;
+    };
+
+    /** Factory presets only set the sound, the quality settings stay as they are.
+        They are all single band with flat tone stages, and set those too so they sound as named.
+    */
+    void addFactoryPresets()
+    {
+        static constexpr FactoryPreset factory[] =
+        {
+            { "Default",            0.5f, -17.0f,   0.0f, 1 },
+            { "Warm Soft Clip",     0.6f, -10.0f,  -3.0f, 1 },
+            { "Driven Soft Clip",   1.0f,   0.0f,  -6.0f, 1 },
+            { "Gentle Hard Clip",   0.4f, -12.0f,  -6.0f, 2 },
+            { "Brick Wall",         1.0f,   6.0f, -12.0f, 2 },
+            { "Wavefolder",         0.8f,  -6.0f, -10.0f, 3 },
+            { "Deep Fold",          1.0f,   3.0f, -20.0f, 3 },
+            { "Scoop",              0.5f, -20.0f,  -6.0f, 4 },
+            { "Scoop Crush",        1.0f,  -3.0f, -12.0f, 4 },
+            { "Tape Tanh",          0.7f,  -8.0f,  -6.0f, 5 },
+            { "Smooth Arctan",      0.6f, -12.0f,  -4.0f, 6 },
+            { "Tube Warmth",        0.8f,  -6.0f,  -3.0f, 7 },
+            { "Diode Edge",         1.0f,   0.0f,  -9.0f, 8 }
+        };
+
+        for (auto& f : factory)
+        {
+            Preset preset;
+            preset.name = f.name;
+            preset.parameters.values[(size_t) indexOf ("MIX")] = f.mix;
+            preset.parameters.values[(size_t) indexOf ("GAIN")] = f.gainDb;
+            preset.parameters.values[(size_t) indexOf ("THRESHOLD")] = f.thresholdDb;
+            preset.parameters.values[(size_t) indexOf ("TYPE")] = (float) f.type;
+            preset.parameters.values[(size_t) indexOf ("BANDS")] = 0.0f;
+
+            for (auto* stage : { "PRE_", "POST_" })
+            {
+                auto set = [&] (const char* control, float value) { preset.parameters.values[(size_t) indexOf (juce::String (stage) + control)] = value; };
+                set ("TILT", 0.0f);
+                set ("LOW_CUT", 20.0f);
+                set ("HIGH_CUT", 20000.0f);
+                set ("MID_FREQ", 1000.0f);
+                set ("MID_GAIN", 0.0f);
+            }
+
+            presets.push_back (preset);
+        }
+    }
+
+    std::vector<Preset> presets;
+
+    JUCE_DECLARE_NON_COPYABLE (PresetBank)
+};
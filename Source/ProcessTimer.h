@@ -0,0 +1,207 @@
+/*
+  ==============================================================================
+
+    ProcessTimer.h
+    Times every processBlock call against the real-time budget of its block,
+    into histograms the audio thread updates without locks or waiting. Any
+    other thread can read min, mean, p99 and max of the cost, the share of
+    the budget used and how many blocks overran it, or append them to a CSV
+    file. Building with EZ_DISTORTION_PERF_STATS=0 compiles the timing out.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+
+#ifndef EZ_DISTORTION_PERF_STATS
+ #define EZ_DISTORTION_PERF_STATS 1
+#endif
+
+class ProcessTimer
+{
+public:
+    static constexpr bool isEnabled = EZ_DISTORTION_PERF_STATS != 0;
+
+    ProcessTimer() = default;
+
+    struct Stats
+    {
+        juce::uint64 numBlocks = 0, numOverruns = 0;
+        double minMicroseconds = 0, meanMicroseconds = 0, p99Microseconds = 0, maxMicroseconds = 0;
+        double meanLoad = 0, p99Load = 0, maxLoad = 0;      // percent of the block's real-time budget
+    };
+
+    /** Times the scope it lives in, normally all of processBlock. */
+    class ScopedMeasurement
+    {
+    public:
+       #if EZ_DISTORTION_PERF_STATS
+        ScopedMeasurement (ProcessTimer& timerToUse, int numSamplesInBlock) noexcept
+            : timer (timerToUse), numSamples (numSamplesInBlock), start (juce::Time::getHighResolutionTicks())
+        {
+        }
+
+        ~ScopedMeasurement()    { timer.record (juce::Time::getHighResolutionTicks() - start, numSamples); }
+
+    private:
+        ProcessTimer& timer;
+        int numSamples;
+        juce::int64 start;
+       #else
+        ScopedMeasurement (ProcessTimer&, int) noexcept {}
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedMeasurement)
+    };
+
+    /** Called from prepareToPlay. Starts the statistics over. */
+    void prepare (double newSampleRate) noexcept
+    {
+        sampleRate.store (newSampleRate);
+        reset();
+    }
+
+    /** Any thread: the audio thread clears everything before recording its next block. */
+    void reset() noexcept       { resetPending.store (true); }
+
+    //==============================================================================
+    /** Audio thread. */
+    void record (juce::int64 ticks, int numSamples) noexcept
+    {
+        if (resetPending.exchange (false))
+            clear();
+
+        auto rate = sampleRate.load (std::memory_order_relaxed);
+
+        if (numSamples <= 0 || rate <= 0)
+            return;
+
+        auto nanoseconds = (juce::int64) ((double) ticks * nanosecondsPerTick);
+        auto budget = 1.0e9 * numSamples / rate;
+        auto load = 100.0 * (double) nanoseconds / budget;
+
+        // Single writer, so plain loads and stores are enough for everything but the bins
+        auto blocks = numBlocks.load (std::memory_order_relaxed);
+        minNanoseconds.store (blocks == 0 ? nanoseconds : juce::jmin (minNanoseconds.load (std::memory_order_relaxed), nanoseconds), std::memory_order_relaxed);
+        maxNanoseconds.store (juce::jmax (maxNanoseconds.load (std::memory_order_relaxed), nanoseconds), std::memory_order_relaxed);
+        maxLoadPpm.store (juce::jmax (maxLoadPpm.load (std::memory_order_relaxed), (juce::int64) (load * 1.0e4)), std::memory_order_relaxed);
+        totalNanoseconds.store (totalNanoseconds.load (std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+        totalLoadPpm.store (totalLoadPpm.load (std::memory_order_relaxed) + (juce::int64) (load * 1.0e4), std::memory_order_relaxed);
+
+        if (load > 100.0)
+            numOverruns.store (numOverruns.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        timeBins[(size_t) getTimeBin (nanoseconds)].fetch_add (1, std::memory_order_relaxed);
+        loadBins[(size_t) juce::jlimit (0, numLoadBins - 1, (int) load)].fetch_add (1, std::memory_order_relaxed);
+
+        // published last, readers never see more blocks than have been binned
+        numBlocks.store (blocks + 1, std::memory_order_release);
+    }
+
+    //==============================================================================
+    /** Any thread. p99 values are the upper edge of the histogram bin they fall in. */
+    Stats getStats() const noexcept
+    {
+        Stats stats;
+        stats.numBlocks = (juce::uint64) numBlocks.load (std::memory_order_acquire);
+
+        if (stats.numBlocks == 0)
+            return stats;
+
+        auto blocks = (double) stats.numBlocks;
+        stats.numOverruns = (juce::uint64) numOverruns.load();
+        stats.minMicroseconds = (double) minNanoseconds.load() * 1.0e-3;
+        stats.maxMicroseconds = (double) maxNanoseconds.load() * 1.0e-3;
+        stats.meanMicroseconds = (double) totalNanoseconds.load() * 1.0e-3 / blocks;
+        stats.meanLoad = (double) totalLoadPpm.load() * 1.0e-4 / blocks;
+        stats.maxLoad = (double) maxLoadPpm.load() * 1.0e-4;
+
+        auto p99Bin = [&] (auto& bins)
+        {
+            auto target = std::ceil (0.99 * blocks);
+            double count = 0;
+
+            for (size_t i = 0; i < bins.size(); ++i)
+                if ((count += bins[i].load (std::memory_order_relaxed)) >= target)
+                    return (int) i;
+
+            return (int) bins.size() - 1;
+        };
+
+        // The top bins also collect everything past them, so the maximum is the better bound there
+        stats.p99Microseconds = juce::jmin (stats.maxMicroseconds, std::exp2 ((p99Bin (timeBins) + 1) / (double) timeBinsPerOctave));
+        stats.p99Load = juce::jmin (stats.maxLoad, (double) (p99Bin (loadBins) + 1));
+        return stats;
+    }
+
+    double getSampleRate() const noexcept   { return sampleRate.load(); }
+
+    static juce::String getCsvHeader()
+    {
+        return "time,sample_rate,blocks,overruns,min_us,mean_us,p99_us,max_us,mean_load_percent,p99_load_percent,max_load_percent";
+    }
+
+    juce::String toCsvRow (const Stats& stats) const
+    {
+        juce::StringArray fields { juce::Time::getCurrentTime().toISO8601 (true),
+                                   juce::String (getSampleRate()),
+                                   juce::String (stats.numBlocks),
+                                   juce::String (stats.numOverruns) };
+
+        for (auto value : { stats.minMicroseconds, stats.meanMicroseconds, stats.p99Microseconds, stats.maxMicroseconds,
+                            stats.meanLoad, stats.p99Load, stats.maxLoad })
+            fields.add (juce::String (value, 3));
+
+        return fields.joinIntoString (",");
+    }
+
+    /** Message thread: adds the current stats as a row, writing the header first if the file is new. */
+    bool appendToCsv (const juce::File& file) const
+    {
+        auto text = (file.existsAsFile() && file.getSize() > 0 ? juce::String() : getCsvHeader() + "\n")
+                      + toCsvRow (getStats()) + "\n";
+
+        return file.appendText (text, false, false, "\n");
+    }
+
+private:
+    // 1 us to about a second in eighth octaves, and 0 to 255 percent of the budget in 1% steps
+    static constexpr int timeBinsPerOctave = 8;
+    static constexpr int numTimeBins = 20 * timeBinsPerOctave;
+    static constexpr int numLoadBins = 256;
+
+    static int getTimeBin (juce::int64 nanoseconds) noexcept
+    {
+        auto microseconds = (double) nanoseconds * 1.0e-3;
+        return microseconds <= 1.0 ? 0 : juce::jmin (numTimeBins - 1, (int) (std::log2 (microseconds) * timeBinsPerOctave));
+    }
+
+    void clear() noexcept
+    {
+        for (auto& bin : timeBins) bin.store (0, std::memory_order_relaxed);
+        for (auto& bin : loadBins) bin.store (0, std::memory_order_relaxed);
+
+        for (auto* value : { &minNanoseconds, &maxNanoseconds, &totalNanoseconds, &totalLoadPpm, &maxLoadPpm, &numOverruns })
+            value->store (0, std::memory_order_relaxed);
+
+        numBlocks.store (0, std::memory_order_release);
+    }
+
+    const double nanosecondsPerTick = 1.0e9 / (double) juce::Time::getHighResolutionTicksPerSecond();
+    std::atomic<double> sampleRate { 0.0 };
+    std::atomic<bool> resetPending { true };
+
+    // loads are kept in millionths of the budget so they fit an integer atomic
+    std::atomic<juce::int64> numBlocks { 0 }, numOverruns { 0 };
+    std::atomic<juce::int64> minNanoseconds { 0 }, maxNanoseconds { 0 }, totalNanoseconds { 0 };
+    std::atomic<juce::int64> totalLoadPpm { 0 }, maxLoadPpm { 0 };
+
+    std::array<std::atomic<juce::uint32>, numTimeBins> timeBins {};
+    std::array<std::atomic<juce::uint32>, numLoadBins> loadBins {};
+
+    JUCE_DECLARE_NON_COPYABLE (ProcessTimer)
+};
@@ -0,0 +1,287 @@
+/*
+  ==============================================================================
+
+    QualityGovernor.h
+    Scales the internal quality to the CPU time processBlock gets. Every
+    block's cost is measured against its real-time budget. When the average
+    over a short window nears the budget, or blocks start to overrun, the
+    governor steps down a level, and after a longer stretch with headroom
+    it steps back up. Each level takes away one step of quality: the curve
+    accuracy tier first, then cubic table interpolation, then halving the
+    oversampling factor. Every step crossfades, so it is never heard as a
+    gap. Steps that wouldn't save anything with the current settings are
+    skipped, and it never goes above what the parameters ask for. In an
+    offline render nothing is measured, and everything runs at its top
+    quality whether the governor is on or not: the top accuracy tier,
+    cubic interpolation and the highest oversampling factor.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+#include "CurveApproximations.h"
+#include "Oversampler.h"
+#include "TransferTable.h"
+
+class QualityGovernor
+{
+public:
+    QualityGovernor() = default;
+
+    /** The settings that cost CPU time, as the parameters ask for them or as the governor lets them run. */
+    struct Quality
+    {
+        int factorLog2 = 0;
+        int interpolation = TransferTable::linear;
+        int accuracy = CurveApproximations::precise;
+    };
+
+    /** Which of the settings the current TYPE and ENGINE make any use of. */
+    struct Usage
+    {
+        bool table = false;
+        bool approximations = false;
+    };
+
+    /** Times the scope it lives in, normally all of processBlock. The clock isn't read
+        at all while the governor is off or rendering offline.
+    */
+    class ScopedMeasurement
+    {
+    public:
+        ScopedMeasurement (QualityGovernor& governorToUse, int numSamplesInBlock) noexcept
+            : governor (governorToUse), numSamples (numSamplesInBlock), measuring (governor.isMeasuring()),
+              start (measuring ? juce::Time::getHighResolutionTicks() : 0)
+        {
+        }
+
+        ~ScopedMeasurement()
+        {
+            if (measuring)
+                governor.record (juce::Time::getHighResolutionTicks() - start, numSamples);
+        }
+
+    private:
+        QualityGovernor& governor;
+        int numSamples;
+        bool measuring;
+        juce::int64 start;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedMeasurement)
+    };
+
+    /** Called from prepareToPlay. Starts again from full quality. */
+    void prepare (double newSampleRate) noexcept
+    {
+        sampleRate = newSampleRate;
+        level = 0;
+        clearWindow();
+        publishedLevel.store (0);
+    }
+
+    /** Audio thread, once per block. Off, the parameters are used as they are. */
+    void setMode (bool shouldBeEnabled, bool isNonRealtime) noexcept
+    {
+        enabled = shouldBeEnabled;
+        offline = isNonRealtime;
+
+        if (! enabled || offline)
+            level = 0;
+    }
+
+    bool isMeasuring() const noexcept   { return enabled && ! offline; }
+
+    /** The factor the latency reported to the host is based on. The governor only ever runs
+        this one or a lower one, which has less latency, so a delay can make up the difference.
+    */
+    int getLatencyFactorLog2 (const Quality& requested) const noexcept
+    {
+        return offline ? maxFactorLog2 : requested.factorLog2;
+    }
+
+    //==============================================================================
+    /** Audio thread: the quality to run with, given what the parameters ask for. */
+    Quality apply (const Quality& requested, Usage usage) noexcept
+    {
+        auto quality = requested;
+
+        // Offline renders take as long as they take, so they always get the best
+        if (offline)
+        {
+            quality.factorLog2 = maxFactorLog2;
+            quality.interpolation = TransferTable::cubic;
+            quality.accuracy = CurveApproximations::precise;
+            return quality;
+        }
+
+        if (! enabled)
+            return requested;
+
+        auto accuracySteps = usage.approximations ? requested.accuracy : 0;
+        auto interpolationSteps = usage.table && requested.interpolation == TransferTable::cubic ? 1 : 0;
+
+        // The settings may have changed since the last block, leaving fewer steps to take
+        maxLevel = accuracySteps + interpolationSteps + requested.factorLog2;
+        level = juce::jmin (level, maxLevel);
+        publishedLevel.store (level, std::memory_order_relaxed);
+        publishedMaxLevel.store (maxLevel, std::memory_order_relaxed);
+
+        auto steps = level;
+        auto take = [&steps] (int available) { auto taken = juce::jmin (steps, available); steps -= taken; return taken; };
+
+        quality.accuracy -= take (accuracySteps);
+        quality.interpolation = take (interpolationSteps) > 0 ? TransferTable::linear : quality.interpolation;
+        quality.factorLog2 -= take (requested.factorLog2);
+        return quality;
+    }
+
+    /** Audio thread. */
+    void record (juce::int64 ticks, int numSamples) noexcept
+    {
+        if (! enabled || offline || numSamples <= 0 || sampleRate <= 0)
+            return;
+
+        auto seconds = (double) ticks * secondsPerTick;
+        auto budget = numSamples / sampleRate;
+        windowSeconds += seconds;
+        windowBudget += budget;
+
+        if (seconds > budget)
+            ++windowOverruns;
+
+        if (windowBudget < windowLength)
+            return;
+
+        auto load = windowSeconds / windowBudget;
+
+        if ((load > stepDownLoad || windowOverruns > 1) && level < maxLevel)
+        {
+            ++level;
+            calmWindows = 0;
+        }
+        else if (load < stepUpLoad && level > 0)
+        {
+            // A step up can double the cost, so it waits for the headroom to last
+            if (++calmWindows >= calmWindowsToStepUp)
+            {
+                --level;
+                calmWindows = 0;
+            }
+        }
+        else
+        {
+            calmWindows = 0;
+        }
+
+        publishedLevel.store (level, std::memory_order_relaxed);
+        clearWindow();
+    }
+
+    /** Any thread: how many steps below the parameters it's running, out of how many it could take. */
+    int getLevel() const noexcept       { return publishedLevel.load (std::memory_order_relaxed); }
+    int getMaxLevel() const noexcept    { return publishedMaxLevel.load (std::memory_order_relaxed); }
+
+private:
+    // Decisions are made on windows of 0.2 s of audio. A step down happens above 70% of the budget,
+    // a step up after 2 s below 30%, low enough that doubling the oversampling doesn't come back down.
+    static constexpr double windowLength = 0.2;
+    static constexpr double stepDownLoad = 0.7;
+    static constexpr double stepUpLoad = 0.3;
+    static constexpr int calmWindowsToStepUp = 10;
+    static constexpr int maxFactorLog2 = Oversampler<float>::maxFactorLog2;
+
+    void clearWindow() noexcept
+    {
+        windowSeconds = windowBudget = 0.0;
+        windowOverruns = 0;
+    }
+
+    const double secondsPerTick = 1.0 / (double) juce::Time::getHighResolutionTicksPerSecond();
+    double sampleRate = 0.0;
+    bool enabled = false, offline = false;
+    int level = 0, maxLevel = 0, calmWindows = 0;
+    double windowSeconds = 0.0, windowBudget = 0.0;
+    int windowOverruns = 0;
+
+    std::atomic<int> publishedLevel { 0 }, publishedMaxLevel { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (QualityGovernor)
+};
+
+//==============================================================================
+/** Delays every channel by a whole number of samples, to make up the latency the
+    governor takes away when it lowers the oversampling factor. Allocated in prepare().
+*/
+template <typename T>
+class CompensationDelay
+{
+public:
+    void prepare (int numChannels, int newMaxDelay)
+    {
+        maxDelay = newMaxDelay;
+        lines.assign ((size_t) numChannels, std::vector<T> ((size_t) juce::jmax (1, maxDelay), T()));
+        delay = 0;
+        reset();
+    }
+
+    void release()
+    {
+        lines = {};
+        maxDelay = delay = 0;
+    }
+
+    void reset() noexcept
+    {
+        for (auto& line : lines)
+            std::fill (line.begin(), line.end(), T());
+
+        position = 0;
+    }
+
+    /** A new delay starts from silence. */
+    void setDelay (int newDelay) noexcept
+    {
+        newDelay = juce::jlimit (0, maxDelay, newDelay);
+
+        if (newDelay != delay)
+        {
+            delay = newDelay;
+            reset();
+        }
+    }
+
+    int getDelay() const noexcept   { return delay; }
+
+    void process (T* const* channels, int numChannels, int numSamples) noexcept
+    {
+        if (delay == 0)
+            return;
+
+        numChannels = juce::jmin (numChannels, (int) lines.size());
+        int end = position;
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            auto* line = lines[(size_t) channel].data();
+            auto* data = channels[channel];
+            end = position;
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                std::swap (data[i], line[end]);
+
+                if (++end == delay)
+                    end = 0;
+            }
+        }
+
+        position = end;
+    }
+
+private:
+    std::vector<std::vector<T>> lines;
+    int maxDelay = 0, delay = 0, position = 0;
+};
@@ -0,0 +1,462 @@
+/*
+  ==============================================================================
+
+    SIMDVec.h
+    A thin wrapper around the native float and double vectors of the target
+    (AVX2, SSE2 or NEON) with unaligned loads/stores, so the waveshaper kernels can run
+    straight over host channel pointers. ScalarVec has the same interface and
+    is used for the tail of each block and on targets without SIMD.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#if defined (__AVX2__)
+ #include <immintrin.h>
+ #define EZ_SIMD_AVX 1
+#elif defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+ #include <emmintrin.h>
+ #if defined (__SSE4_1__)
+  #include <smmintrin.h>
+ #endif
+ #define EZ_SIMD_SSE 1
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+ #include <arm_neon.h>
+ #define EZ_SIMD_NEON 1
+#endif
+
+//==============================================================================
+template <typename T>
+struct ScalarVec
+{
+    using Mask = bool;
+    static constexpr int size = 1;
+
+    T value;
+
+    static ScalarVec load (const T* p) noexcept                 { return { *p }; }
+    void store (T* p) const noexcept                            { *p = value; }
+    static ScalarVec broadcast (T x) noexcept                   { return { x }; }
+
+    friend ScalarVec operator+ (ScalarVec a, ScalarVec b) noexcept { return { a.value + b.value }; }
+    friend ScalarVec operator- (ScalarVec a, ScalarVec b) noexcept { return { a.value - b.value }; }
+    friend ScalarVec operator* (ScalarVec a, ScalarVec b) noexcept { return { a.value * b.value }; }
+    friend ScalarVec operator/ (ScalarVec a, ScalarVec b) noexcept { return { a.value / b.value }; }
+    friend ScalarVec operator- (ScalarVec a) noexcept              { return { -a.value }; }
+
+    static ScalarVec min (ScalarVec a, ScalarVec b) noexcept    { return { b.value < a.value ? b.value : a.value }; }
+    static ScalarVec max (ScalarVec a, ScalarVec b) noexcept    { return { a.value < b.value ? b.value : a.value }; }
+    static ScalarVec abs (ScalarVec a) noexcept                 { return { std::abs (a.value) }; }
+    static ScalarVec floor (ScalarVec a) noexcept               { return { std::floor (a.value) }; }
+    static ScalarVec trunc (ScalarVec a) noexcept               { return { std::trunc (a.value) }; }
+    static ScalarVec round (ScalarVec a) noexcept               { return { std::round (a.value) }; }
+
+    static Mask lessThan (ScalarVec a, ScalarVec b) noexcept            { return a.value < b.value; }
+    static Mask lessThanOrEqual (ScalarVec a, ScalarVec b) noexcept     { return a.value <= b.value; }
+    static Mask greaterThan (ScalarVec a, ScalarVec b) noexcept         { return a.value > b.value; }
+    static Mask greaterThanOrEqual (ScalarVec a, ScalarVec b) noexcept  { return a.value >= b.value; }
+
+    static ScalarVec select (Mask m, ScalarVec a, ScalarVec b) noexcept { return m ? a : b; }
+    static bool any (Mask m) noexcept                                   { return m; }
+    static bool all (Mask m) noexcept                                   { return m; }
+
+    /** Loads table[index] for an index vector holding whole numbers. */
+    static ScalarVec gather (const T* table, ScalarVec index) noexcept  { return { table[(int) index.value] }; }
+};
+
+//==============================================================================
+template <typename T>
+struct SIMDVec;
+
+#if EZ_SIMD_AVX
+
+template <>
+struct SIMDVec<float>
+{
+    using Mask = __m256;
+    static constexpr int size = 8;
+
+    __m256 value;
+
+    static SIMDVec load (const float* p) noexcept               { return { _mm256_loadu_ps (p) }; }
+    void store (float* p) const noexcept                        { _mm256_storeu_ps (p, value); }
+    static SIMDVec broadcast (float x) noexcept                 { return { _mm256_set1_ps (x) }; }
+
+    friend SIMDVec operator+ (SIMDVec a, SIMDVec b) noexcept    { return { _mm256_add_ps (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a, SIMDVec b) noexcept    { return { _mm256_sub_ps (a.value, b.value) }; }
+    friend SIMDVec operator* (SIMDVec a, SIMDVec b) noexcept    { return { _mm256_mul_ps (a.value, b.value) }; }
+    friend SIMDVec operator/ (SIMDVec a, SIMDVec b) noexcept    { return { _mm256_div_ps (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a) noexcept               { return { _mm256_xor_ps (a.value, _mm256_set1_ps (-0.0f)) }; }
+
+    static SIMDVec min (SIMDVec a, SIMDVec b) noexcept          { return { _mm256_min_ps (a.value, b.value) }; }
+    static SIMDVec max (SIMDVec a, SIMDVec b) noexcept          { return { _mm256_max_ps (a.value, b.value) }; }
+    static SIMDVec abs (SIMDVec a) noexcept                     { return { _mm256_andnot_ps (_mm256_set1_ps (-0.0f), a.value) }; }
+    static SIMDVec floor (SIMDVec a) noexcept                   { return { _mm256_round_ps (a.value, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC) }; }
+    static SIMDVec trunc (SIMDVec a) noexcept                   { return { _mm256_round_ps (a.value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC) }; }
+
+    static Mask lessThan (SIMDVec a, SIMDVec b) noexcept            { return _mm256_cmp_ps (a.value, b.value, _CMP_LT_OQ); }
+    static Mask lessThanOrEqual (SIMDVec a, SIMDVec b) noexcept     { return _mm256_cmp_ps (a.value, b.value, _CMP_LE_OQ); }
+    static Mask greaterThan (SIMDVec a, SIMDVec b) noexcept         { return _mm256_cmp_ps (a.value, b.value, _CMP_GT_OQ); }
+    static Mask greaterThanOrEqual (SIMDVec a, SIMDVec b) noexcept  { return _mm256_cmp_ps (a.value, b.value, _CMP_GE_OQ); }
+
+    static SIMDVec select (Mask m, SIMDVec a, SIMDVec b) noexcept   { return { _mm256_blendv_ps (b.value, a.value, m) }; }
+    static bool any (Mask m) noexcept                               { return _mm256_movemask_ps (m) != 0; }
+    static bool all (Mask m) noexcept                               { return _mm256_movemask_ps (m) == 0xff; }
+
+    static SIMDVec gather (const float* table, SIMDVec index) noexcept
+    {
+        return { _mm256_i32gather_ps (table, _mm256_cvttps_epi32 (index.value), 4) };
+    }
+
+    // std::round semantics: halfway cases away from zero
+    static SIMDVec round (SIMDVec a) noexcept
+    {
+        auto sign = _mm256_and_ps (a.value, _mm256_set1_ps (-0.0f));
+        auto r = floor (abs (a) + broadcast (0.5f));
+        return { _mm256_or_ps (r.value, sign) };
+    }
+};
+
+template <>
+struct SIMDVec<double>
+{
+    using Mask = __m256d;
+    static constexpr int size = 4;
+
+    __m256d value;
+
+    static SIMDVec load (const double* p) noexcept              { return { _mm256_loadu_pd (p) }; }
+    void store (double* p) const noexcept                       { _mm256_storeu_pd (p, value); }
+    static SIMDVec broadcast (double x) noexcept                { return { _mm256_set1_pd (x) }; }
+
+    friend SIMDVec operator+ (SIMDVec a, SIMDVec b) noexcept    { return { _mm256_add_pd (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a, SIMDVec b) noexcept    { return { _mm256_sub_pd (a.value, b.value) }; }
+    friend SIMDVec operator* (SIMDVec a, SIMDVec b) noexcept    { return { _mm256_mul_pd (a.value, b.value) }; }
+    friend SIMDVec operator/ (SIMDVec a, SIMDVec b) noexcept    { return { _mm256_div_pd (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a) noexcept               { return { _mm256_xor_pd (a.value, _mm256_set1_pd (-0.0)) }; }
+
+    static SIMDVec min (SIMDVec a, SIMDVec b) noexcept          { return { _mm256_min_pd (a.value, b.value) }; }
+    static SIMDVec max (SIMDVec a, SIMDVec b) noexcept          { return { _mm256_max_pd (a.value, b.value) }; }
+    static SIMDVec abs (SIMDVec a) noexcept                     { return { _mm256_andnot_pd (_mm256_set1_pd (-0.0), a.value) }; }
+    static SIMDVec floor (SIMDVec a) noexcept                   { return { _mm256_round_pd (a.value, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC) }; }
+    static SIMDVec trunc (SIMDVec a) noexcept                   { return { _mm256_round_pd (a.value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC) }; }
+
+    static Mask lessThan (SIMDVec a, SIMDVec b) noexcept            { return _mm256_cmp_pd (a.value, b.value, _CMP_LT_OQ); }
+    static Mask lessThanOrEqual (SIMDVec a, SIMDVec b) noexcept     { return _mm256_cmp_pd (a.value, b.value, _CMP_LE_OQ); }
+    static Mask greaterThan (SIMDVec a, SIMDVec b) noexcept         { return _mm256_cmp_pd (a.value, b.value, _CMP_GT_OQ); }
+    static Mask greaterThanOrEqual (SIMDVec a, SIMDVec b) noexcept  { return _mm256_cmp_pd (a.value, b.value, _CMP_GE_OQ); }
+
+    static SIMDVec select (Mask m, SIMDVec a, SIMDVec b) noexcept   { return { _mm256_blendv_pd (b.value, a.value, m) }; }
+    static bool any (Mask m) noexcept                               { return _mm256_movemask_pd (m) != 0; }
+    static bool all (Mask m) noexcept                               { return _mm256_movemask_pd (m) == 0xf; }
+
+    static SIMDVec gather (const double* table, SIMDVec index) noexcept
+    {
+        // the masked form, as GCC warns about the undefined source of the plain one
+        auto all = _mm256_castsi256_pd (_mm256_set1_epi64x (-1));
+        return { _mm256_mask_i32gather_pd (_mm256_setzero_pd(), table, _mm256_cvttpd_epi32 (index.value), all, 8) };
+    }
+
+    static SIMDVec round (SIMDVec a) noexcept
+    {
+        auto sign = _mm256_and_pd (a.value, _mm256_set1_pd (-0.0));
+        auto r = floor (abs (a) + broadcast (0.5));
+        return { _mm256_or_pd (r.value, sign) };
+    }
+};
+
+#elif EZ_SIMD_SSE
+
+template <>
+struct SIMDVec<float>
+{
+    using Mask = __m128;
+    static constexpr int size = 4;
+
+    __m128 value;
+
+    static SIMDVec load (const float* p) noexcept               { return { _mm_loadu_ps (p) }; }
+    void store (float* p) const noexcept                        { _mm_storeu_ps (p, value); }
+    static SIMDVec broadcast (float x) noexcept                 { return { _mm_set1_ps (x) }; }
+
+    friend SIMDVec operator+ (SIMDVec a, SIMDVec b) noexcept    { return { _mm_add_ps (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a, SIMDVec b) noexcept    { return { _mm_sub_ps (a.value, b.value) }; }
+    friend SIMDVec operator* (SIMDVec a, SIMDVec b) noexcept    { return { _mm_mul_ps (a.value, b.value) }; }
+    friend SIMDVec operator/ (SIMDVec a, SIMDVec b) noexcept    { return { _mm_div_ps (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a) noexcept               { return { _mm_xor_ps (a.value, _mm_set1_ps (-0.0f)) }; }
+
+    static SIMDVec min (SIMDVec a, SIMDVec b) noexcept          { return { _mm_min_ps (a.value, b.value) }; }
+    static SIMDVec max (SIMDVec a, SIMDVec b) noexcept          { return { _mm_max_ps (a.value, b.value) }; }
+    static SIMDVec abs (SIMDVec a) noexcept                     { return { _mm_andnot_ps (_mm_set1_ps (-0.0f), a.value) }; }
+
+    static Mask lessThan (SIMDVec a, SIMDVec b) noexcept            { return _mm_cmplt_ps (a.value, b.value); }
+    static Mask lessThanOrEqual (SIMDVec a, SIMDVec b) noexcept     { return _mm_cmple_ps (a.value, b.value); }
+    static Mask greaterThan (SIMDVec a, SIMDVec b) noexcept         { return _mm_cmpgt_ps (a.value, b.value); }
+    static Mask greaterThanOrEqual (SIMDVec a, SIMDVec b) noexcept  { return _mm_cmpge_ps (a.value, b.value); }
+
+    static SIMDVec select (Mask m, SIMDVec a, SIMDVec b) noexcept
+    {
+        return { _mm_or_ps (_mm_and_ps (m, a.value), _mm_andnot_ps (m, b.value)) };
+    }
+
+    static bool any (Mask m) noexcept                               { return _mm_movemask_ps (m) != 0; }
+    static bool all (Mask m) noexcept                               { return _mm_movemask_ps (m) == 0xf; }
+
+    static SIMDVec gather (const float* table, SIMDVec index) noexcept
+    {
+        alignas (16) int i[4];
+        _mm_store_si128 ((__m128i*) i, _mm_cvttps_epi32 (index.value));
+        return { _mm_setr_ps (table[i[0]], table[i[1]], table[i[2]], table[i[3]]) };
+    }
+
+   #if defined (__SSE4_1__)
+    static SIMDVec floor (SIMDVec a) noexcept                   { return { _mm_floor_ps (a.value) }; }
+    static SIMDVec trunc (SIMDVec a) noexcept                   { return { _mm_round_ps (a.value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC) }; }
+   #else
+    // Anything at or beyond 2^23 is already integral (and would overflow the int conversion)
+    static SIMDVec trunc (SIMDVec a) noexcept
+    {
+        auto t = _mm_cvtepi32_ps (_mm_cvttps_epi32 (a.value));
+        return select (lessThan (abs (a), broadcast (8388608.0f)), { t }, a);
+    }
+
+    static SIMDVec floor (SIMDVec a) noexcept
+    {
+        auto t = trunc (a);
+        return t - SIMDVec { _mm_and_ps (_mm_cmpgt_ps (t.value, a.value), _mm_set1_ps (1.0f)) };
+    }
+   #endif
+
+    static SIMDVec round (SIMDVec a) noexcept
+    {
+        auto sign = _mm_and_ps (a.value, _mm_set1_ps (-0.0f));
+        auto r = floor (abs (a) + broadcast (0.5f));
+        return { _mm_or_ps (r.value, sign) };
+    }
+};
+
+template <>
+struct SIMDVec<double>
+{
+    using Mask = __m128d;
+    static constexpr int size = 2;
+
+    __m128d value;
+
+    static SIMDVec load (const double* p) noexcept              { return { _mm_loadu_pd (p) }; }
+    void store (double* p) const noexcept                       { _mm_storeu_pd (p, value); }
+    static SIMDVec broadcast (double x) noexcept                { return { _mm_set1_pd (x) }; }
+
+    friend SIMDVec operator+ (SIMDVec a, SIMDVec b) noexcept    { return { _mm_add_pd (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a, SIMDVec b) noexcept    { return { _mm_sub_pd (a.value, b.value) }; }
+    friend SIMDVec operator* (SIMDVec a, SIMDVec b) noexcept    { return { _mm_mul_pd (a.value, b.value) }; }
+    friend SIMDVec operator/ (SIMDVec a, SIMDVec b) noexcept    { return { _mm_div_pd (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a) noexcept               { return { _mm_xor_pd (a.value, _mm_set1_pd (-0.0)) }; }
+
+    static SIMDVec min (SIMDVec a, SIMDVec b) noexcept          { return { _mm_min_pd (a.value, b.value) }; }
+    static SIMDVec max (SIMDVec a, SIMDVec b) noexcept          { return { _mm_max_pd (a.value, b.value) }; }
+    static SIMDVec abs (SIMDVec a) noexcept                     { return { _mm_andnot_pd (_mm_set1_pd (-0.0), a.value) }; }
+
+    static Mask lessThan (SIMDVec a, SIMDVec b) noexcept            { return _mm_cmplt_pd (a.value, b.value); }
+    static Mask lessThanOrEqual (SIMDVec a, SIMDVec b) noexcept     { return _mm_cmple_pd (a.value, b.value); }
+    static Mask greaterThan (SIMDVec a, SIMDVec b) noexcept         { return _mm_cmpgt_pd (a.value, b.value); }
+    static Mask greaterThanOrEqual (SIMDVec a, SIMDVec b) noexcept  { return _mm_cmpge_pd (a.value, b.value); }
+
+    static SIMDVec select (Mask m, SIMDVec a, SIMDVec b) noexcept
+    {
+        return { _mm_or_pd (_mm_and_pd (m, a.value), _mm_andnot_pd (m, b.value)) };
+    }
+
+    static bool any (Mask m) noexcept                               { return _mm_movemask_pd (m) != 0; }
+    static bool all (Mask m) noexcept                               { return _mm_movemask_pd (m) == 0x3; }
+
+    static SIMDVec gather (const double* table, SIMDVec index) noexcept
+    {
+        alignas (16) int i[4];
+        _mm_store_si128 ((__m128i*) i, _mm_cvttpd_epi32 (index.value));
+        return { _mm_setr_pd (table[i[0]], table[i[1]]) };
+    }
+
+   #if defined (__SSE4_1__)
+    static SIMDVec floor (SIMDVec a) noexcept                   { return { _mm_floor_pd (a.value) }; }
+    static SIMDVec trunc (SIMDVec a) noexcept                   { return { _mm_round_pd (a.value, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC) }; }
+   #else
+    // Adding and taking away 2^52 rounds the magnitude to an integer, which is stepped back where it
+    // rounded up. Anything at or beyond 2^52 is already integral. (The int32 conversion the float
+    // version uses would pass doubles between 2^31 and 2^52 through with their fractions.)
+    static SIMDVec trunc (SIMDVec a) noexcept
+    {
+        auto magnitude = abs (a);
+        auto twoToThe52 = broadcast (4503599627370496.0);
+        auto rounded = (magnitude + twoToThe52) - twoToThe52;
+        auto truncated = rounded - SIMDVec { _mm_and_pd (_mm_cmpgt_pd (rounded.value, magnitude.value), _mm_set1_pd (1.0)) };
+        auto sign = _mm_and_pd (a.value, _mm_set1_pd (-0.0));
+        return select (lessThan (magnitude, twoToThe52), { _mm_or_pd (truncated.value, sign) }, a);
+    }
+
+    static SIMDVec floor (SIMDVec a) noexcept
+    {
+        auto t = trunc (a);
+        return t - SIMDVec { _mm_and_pd (_mm_cmpgt_pd (t.value, a.value), _mm_set1_pd (1.0)) };
+    }
+   #endif
+
+    static SIMDVec round (SIMDVec a) noexcept
+    {
+        auto sign = _mm_and_pd (a.value, _mm_set1_pd (-0.0));
+        auto r = floor (abs (a) + broadcast (0.5));
+        return { _mm_or_pd (r.value, sign) };
+    }
+};
+
+#elif EZ_SIMD_NEON
+
+template <>
+struct SIMDVec<float>
+{
+    using Mask = uint32x4_t;
+    static constexpr int size = 4;
+
+    float32x4_t value;
+
+    static SIMDVec load (const float* p) noexcept               { return { vld1q_f32 (p) }; }
+    void store (float* p) const noexcept                        { vst1q_f32 (p, value); }
+    static SIMDVec broadcast (float x) noexcept                 { return { vdupq_n_f32 (x) }; }
+
+    friend SIMDVec operator+ (SIMDVec a, SIMDVec b) noexcept    { return { vaddq_f32 (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a, SIMDVec b) noexcept    { return { vsubq_f32 (a.value, b.value) }; }
+    friend SIMDVec operator* (SIMDVec a, SIMDVec b) noexcept    { return { vmulq_f32 (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a) noexcept               { return { vnegq_f32 (a.value) }; }
+
+    static SIMDVec min (SIMDVec a, SIMDVec b) noexcept          { return { vminq_f32 (a.value, b.value) }; }
+    static SIMDVec max (SIMDVec a, SIMDVec b) noexcept          { return { vmaxq_f32 (a.value, b.value) }; }
+    static SIMDVec abs (SIMDVec a) noexcept                     { return { vabsq_f32 (a.value) }; }
+
+    static Mask lessThan (SIMDVec a, SIMDVec b) noexcept            { return vcltq_f32 (a.value, b.value); }
+    static Mask lessThanOrEqual (SIMDVec a, SIMDVec b) noexcept     { return vcleq_f32 (a.value, b.value); }
+    static Mask greaterThan (SIMDVec a, SIMDVec b) noexcept         { return vcgtq_f32 (a.value, b.value); }
+    static Mask greaterThanOrEqual (SIMDVec a, SIMDVec b) noexcept  { return vcgeq_f32 (a.value, b.value); }
+
+    static SIMDVec select (Mask m, SIMDVec a, SIMDVec b) noexcept   { return { vbslq_f32 (m, a.value, b.value) }; }
+
+    static bool any (Mask m) noexcept
+    {
+        auto pairs = vorr_u32 (vget_low_u32 (m), vget_high_u32 (m));
+        return (vget_lane_u32 (pairs, 0) | vget_lane_u32 (pairs, 1)) != 0;
+    }
+
+    static bool all (Mask m) noexcept
+    {
+        auto pairs = vand_u32 (vget_low_u32 (m), vget_high_u32 (m));
+        return (vget_lane_u32 (pairs, 0) & vget_lane_u32 (pairs, 1)) != 0;
+    }
+
+    static SIMDVec gather (const float* table, SIMDVec index) noexcept
+    {
+        alignas (16) int32_t i[4];
+        vst1q_s32 (i, vcvtq_s32_f32 (index.value));
+        float values[4] = { table[i[0]], table[i[1]], table[i[2]], table[i[3]] };
+        return { vld1q_f32 (values) };
+    }
+
+   #if defined (__aarch64__)
+    friend SIMDVec operator/ (SIMDVec a, SIMDVec b) noexcept    { return { vdivq_f32 (a.value, b.value) }; }
+    static SIMDVec floor (SIMDVec a) noexcept                   { return { vrndmq_f32 (a.value) }; }
+    static SIMDVec trunc (SIMDVec a) noexcept                   { return { vrndq_f32 (a.value) }; }
+    static SIMDVec round (SIMDVec a) noexcept                   { return { vrndaq_f32 (a.value) }; }
+   #else
+    friend SIMDVec operator/ (SIMDVec a, SIMDVec b) noexcept
+    {
+        // two Newton-Raphson steps on the reciprocal estimate, armv7 has no vector divide
+        auto r = vrecpeq_f32 (b.value);
+        r = vmulq_f32 (vrecpsq_f32 (b.value, r), r);
+        r = vmulq_f32 (vrecpsq_f32 (b.value, r), r);
+        return { vmulq_f32 (a.value, r) };
+    }
+
+    static SIMDVec trunc (SIMDVec a) noexcept
+    {
+        auto t = vcvtq_f32_s32 (vcvtq_s32_f32 (a.value));
+        return select (lessThan (abs (a), broadcast (8388608.0f)), { t }, a);
+    }
+
+    static SIMDVec floor (SIMDVec a) noexcept
+    {
+        auto t = trunc (a);
+        auto adjust = vreinterpretq_f32_u32 (vandq_u32 (vcgtq_f32 (t.value, a.value),
+                                                        vreinterpretq_u32_f32 (vdupq_n_f32 (1.0f))));
+        return { vsubq_f32 (t.value, adjust) };
+    }
+
+    static SIMDVec round (SIMDVec a) noexcept
+    {
+        auto r = floor (abs (a) + broadcast (0.5f));
+        return select (lessThan (a, broadcast (0.0f)), -r, r);
+    }
+   #endif
+};
+
+#if defined (__aarch64__)
+template <>
+struct SIMDVec<double>
+{
+    using Mask = uint64x2_t;
+    static constexpr int size = 2;
+
+    float64x2_t value;
+
+    static SIMDVec load (const double* p) noexcept              { return { vld1q_f64 (p) }; }
+    void store (double* p) const noexcept                       { vst1q_f64 (p, value); }
+    static SIMDVec broadcast (double x) noexcept                { return { vdupq_n_f64 (x) }; }
+
+    friend SIMDVec operator+ (SIMDVec a, SIMDVec b) noexcept    { return { vaddq_f64 (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a, SIMDVec b) noexcept    { return { vsubq_f64 (a.value, b.value) }; }
+    friend SIMDVec operator* (SIMDVec a, SIMDVec b) noexcept    { return { vmulq_f64 (a.value, b.value) }; }
+    friend SIMDVec operator/ (SIMDVec a, SIMDVec b) noexcept    { return { vdivq_f64 (a.value, b.value) }; }
+    friend SIMDVec operator- (SIMDVec a) noexcept               { return { vnegq_f64 (a.value) }; }
+
+    static SIMDVec min (SIMDVec a, SIMDVec b) noexcept          { return { vminq_f64 (a.value, b.value) }; }
+    static SIMDVec max (SIMDVec a, SIMDVec b) noexcept          { return { vmaxq_f64 (a.value, b.value) }; }
+    static SIMDVec abs (SIMDVec a) noexcept                     { return { vabsq_f64 (a.value) }; }
+    static SIMDVec floor (SIMDVec a) noexcept                   { return { vrndmq_f64 (a.value) }; }
+    static SIMDVec trunc (SIMDVec a) noexcept                   { return { vrndq_f64 (a.value) }; }
+    static SIMDVec round (SIMDVec a) noexcept                   { return { vrndaq_f64 (a.value) }; }
+
+    static Mask lessThan (SIMDVec a, SIMDVec b) noexcept            { return vcltq_f64 (a.value, b.value); }
+    static Mask lessThanOrEqual (SIMDVec a, SIMDVec b) noexcept     { return vcleq_f64 (a.value, b.value); }
+    static Mask greaterThan (SIMDVec a, SIMDVec b) noexcept         { return vcgtq_f64 (a.value, b.value); }
+    static Mask greaterThanOrEqual (SIMDVec a, SIMDVec b) noexcept  { return vcgeq_f64 (a.value, b.value); }
+
+    static SIMDVec select (Mask m, SIMDVec a, SIMDVec b) noexcept   { return { vbslq_f64 (m, a.value, b.value) }; }
+    static bool any (Mask m) noexcept                               { return (vgetq_lane_u64 (m, 0) | vgetq_lane_u64 (m, 1)) != 0; }
+    static bool all (Mask m) noexcept                               { return (vgetq_lane_u64 (m, 0) & vgetq_lane_u64 (m, 1)) != 0; }
+
+    static SIMDVec gather (const double* table, SIMDVec index) noexcept
+    {
+        auto i = vcvtq_s64_f64 (index.value);
+        double values[2] = { table[vgetq_lane_s64 (i, 0)], table[vgetq_lane_s64 (i, 1)] };
+        return { vld1q_f64 (values) };
+    }
+};
+#endif
+
+#endif
+
+//==============================================================================
+/** The widest vector type available for T on this target, or ScalarVec<T>. */
+template <typename T>
+struct NativeVec { using Type = ScalarVec<T>; };
+
+#if EZ_SIMD_AVX || EZ_SIMD_SSE || EZ_SIMD_NEON
+template <>
+struct NativeVec<float> { using Type = SIMDVec<float>; };
+#endif
+
+#if EZ_SIMD_AVX || EZ_SIMD_SSE || (EZ_SIMD_NEON && defined (__aarch64__))
+template <>
+struct NativeVec<double> { using Type = SIMDVec<double>; };
+#endif
@@ -0,0 +1,87 @@
+/*
+  ==============================================================================
+
+    SharedCache.h
+    Immutable DSP data shared by every instance in the process: transfer
+    tables, cabinet responses. Each value is built once per key and handed
+    out as a shared_ptr to const. The cache only keeps weak references, so
+    a value is freed with the last instance using it, and the cache itself
+    lives in a SharedResourcePointer, so it goes with the last instance.
+
+    Lookups lock, so they belong on background threads, never the audio
+    thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+template <typename Key, typename Value>
+class SharedCache
+{
+public:
+    using Pointer = std::shared_ptr<const Value>;
+
+    SharedCache() = default;
+
+    /** Returns the value for key, calling build() to make it if no instance holds one.
+        build() runs outside the lock, so two threads may race to build the same key;
+        the first to finish is kept and both get it.
+    */
+    template <typename Builder>
+    Pointer getOrBuild (const Key& key, Builder&& build)
+    {
+        {
+            const juce::ScopedLock sl (lock);
+
+            if (auto existing = find (key))
+                return existing;
+        }
+
+        Pointer value (build());
+
+        const juce::ScopedLock sl (lock);
+
+        if (auto existing = find (key))
+            return existing;
+
+        entries.erase (std::remove_if (entries.begin(), entries.end(), [] (const Entry& e) { return e.value.expired(); }),
+                       entries.end());
+        entries.push_back ({ key, value });
+        return value;
+    }
+
+    /** How many values some instance is still holding. */
+    int getNumLiveEntries() const
+    {
+        const juce::ScopedLock sl (lock);
+        return (int) std::count_if (entries.begin(), entries.end(), [] (const Entry& e) { return ! e.value.expired(); });
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        std::weak_ptr<const Value> value;
+    };
+
+    Pointer find (const Key& key) const
+    {
+        for (auto& e : entries)
+            if (e.key == key)
+                if (auto value = e.value.lock())
+                    return value;
+
+        return {};
+    }
+
+    juce::CriticalSection lock;
+    std::vector<Entry> entries;
+
+    JUCE_DECLARE_NON_COPYABLE (SharedCache)
+};
@@ -0,0 +1,117 @@
+/*
+  ==============================================================================
+
+    SignalTap.h
+    Carries block levels and a decimated scope trace from the audio thread to
+    the editor through wait-free single producer, single consumer FIFOs. The
+    audio thread only measures and pushes while an editor is open, and drops
+    values rather than waiting when the editor falls behind.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class SignalTap
+{
+public:
+    SignalTap() = default;
+
+    struct Levels
+    {
+        float inputPeak = 0, inputRms = 0;
+        float outputPeak = 0, outputRms = 0;
+    };
+
+    /** Scope points per second of audio, whatever the sample rate. */
+    static constexpr double scopeRate = 4800.0;
+
+    /** Message thread: an open editor switches the tap on, and off again when it closes. */
+    void setActive (bool shouldBeActive) noexcept   { active.store (shouldBeActive, std::memory_order_release); }
+    bool isActive() const noexcept                  { return active.load (std::memory_order_acquire); }
+
+    /** Called from prepareToPlay. */
+    void prepare (double sampleRate) noexcept
+    {
+        decimation = juce::jmax (1, juce::roundToInt (sampleRate / scopeRate));
+        nextScopeSample = 0;
+    }
+
+    //==============================================================================
+    /** Audio thread. */
+    void pushLevels (const Levels& newLevels) noexcept
+    {
+        auto scope = levelFifo.write (1);
+
+        if (scope.blockSize1 > 0)
+            levels[(size_t) scope.startIndex1] = newLevels;
+    }
+
+    /** Audio thread: keeps every decimation-th sample, counting on from the previous block. */
+    template <typename T>
+    void pushScope (const T* samples, int numSamples) noexcept
+    {
+        auto numPoints = nextScopeSample < numSamples ? (numSamples - 1 - nextScopeSample) / decimation + 1 : 0;
+        auto position = nextScopeSample;
+        nextScopeSample += numPoints * decimation - numSamples;
+
+        auto scope = scopeFifo.write (numPoints);
+
+        for (int i = 0; i < scope.blockSize1; ++i, position += decimation)
+            scopeData[(size_t) (scope.startIndex1 + i)] = (float) samples[position];
+
+        for (int i = 0; i < scope.blockSize2; ++i, position += decimation)
+            scopeData[(size_t) (scope.startIndex2 + i)] = (float) samples[position];
+    }
+
+    //==============================================================================
+    /** Message thread: the oldest levels not yet read, false once there are none. */
+    bool popLevels (Levels& dest) noexcept
+    {
+        auto scope = levelFifo.read (1);
+
+        if (scope.blockSize1 == 0)
+            return false;
+
+        dest = levels[(size_t) scope.startIndex1];
+        return true;
+    }
+
+    /** Message thread: reads up to maxPoints scope points, returning how many were read. */
+    int popScope (float* dest, int maxPoints) noexcept
+    {
+        auto scope = scopeFifo.read (maxPoints);
+
+        std::copy_n (scopeData.begin() + scope.startIndex1, scope.blockSize1, dest);
+        std::copy_n (scopeData.begin() + scope.startIndex2, scope.blockSize2, dest + scope.blockSize1);
+        return scope.blockSize1 + scope.blockSize2;
+    }
+
+    /** Message thread: throws away anything left over from when the editor was last open. */
+    void drain() noexcept
+    {
+        Levels unused;
+        while (popLevels (unused)) {}
+
+        float points[256];
+        while (popScope (points, (int) std::size (points)) > 0) {}
+    }
+
+private:
+    static constexpr int levelFifoSize = 128;
+    static constexpr int scopeFifoSize = 8192;
+
+    std::atomic<bool> active { false };
+
+    juce::AbstractFifo levelFifo { levelFifoSize };
+    std::array<Levels, levelFifoSize> levels;
+
+    juce::AbstractFifo scopeFifo { scopeFifoSize };
+    std::array<float, scopeFifoSize> scopeData {};
+
+    int decimation = 10, nextScopeSample = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (SignalTap)
+};
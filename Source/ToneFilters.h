@@ -0,0 +1,370 @@
+/*
+  ==============================================================================
+
+    ToneFilters.h
+    The optional tone stages before and after the distortion: a tilt around
+    1 kHz, a low cut, a mid peak and a high cut, as a cascade of biquads in
+    transposed direct form II. All channels share the coefficients, so each
+    channel is a lane of a SIMD vector of doubles and the cascade runs once
+    for all of them. A control that moves glides to its new value, and only
+    the stages it touches are redesigned along the way. Stages left flat are
+    skipped.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+#include "MultibandDistortion.h"
+
+namespace ToneDesign
+{
+    /** The parameter ID suffixes of one stage, after PRE_ or POST_, in Settings order. */
+    constexpr const char* controlIds[] = { "TILT", "LOW_CUT", "HIGH_CUT", "MID_FREQ", "MID_GAIN" };
+    constexpr int numControls = (int) std::size (controlIds);
+
+    // At these values a control is flat and its filter is skipped
+    constexpr float lowCutOff = 20.0f;
+    constexpr float highCutOff = 20000.0f;
+
+    constexpr double tiltPivot = 1000.0;
+    constexpr double midQ = 0.7;
+
+    struct Settings
+    {
+        float tiltDb = 0, lowCut = lowCutOff, highCut = highCutOff, midFrequency = 1000.0f, midGainDb = 0;
+
+        bool operator== (const Settings& other) const noexcept
+        {
+            return tiltDb == other.tiltDb && lowCut == other.lowCut && highCut == other.highCut
+                && midFrequency == other.midFrequency && midGainDb == other.midGainDb;
+        }
+
+        bool operator!= (const Settings& other) const noexcept     { return ! operator== (other); }
+    };
+
+    using MultibandDesign::Biquad;
+    using MultibandDesign::glideSeconds;
+    using MultibandDesign::glideStep;
+
+    /** First order: sqrt (A) (s + wc / sqrt (A)) / (s + wc sqrt (A)), flat at the pivot,
+        -dB/2 below it and +dB/2 above it.
+    */
+    inline Biquad designTilt (double dB, double sampleRate)
+    {
+        const double pi = 3.14159265358979323846;
+        const double rootA = std::pow (10.0, dB / 40.0);
+        const double k = std::tan (pi * std::min (tiltPivot, 0.45 * sampleRate) / sampleRate);
+        const double zero = k / rootA, pole = k * rootA;
+        const double norm = 1.0 / (1.0 + pole);
+        return { rootA * (1.0 + zero) * norm, rootA * (zero - 1.0) * norm, 0.0, (pole - 1.0) * norm, 0.0 };
+    }
+
+    /** The RBJ cookbook peaking filter. */
+    inline Biquad designPeak (double frequency, double dB, double sampleRate)
+    {
+        const double pi = 3.14159265358979323846;
+        const double a = std::pow (10.0, dB / 40.0);
+        const double w0 = 2.0 * pi * std::min (frequency, 0.45 * sampleRate) / sampleRate;
+        const double alpha = std::sin (w0) / (2.0 * midQ);
+        const double norm = 1.0 / (1.0 + alpha / a);
+        return { (1.0 + alpha * a) * norm, -2.0 * std::cos (w0) * norm, (1.0 - alpha * a) * norm,
+                 -2.0 * std::cos (w0) * norm, (1.0 - alpha / a) * norm };
+    }
+
+    // The cuts are the Butterworth halves of a crossover
+    inline Biquad designLowCut (double frequency, double sampleRate)
+    {
+        return MultibandDesign::designCrossover (std::min (frequency, 0.45 * sampleRate), sampleRate).highpass;
+    }
+
+    inline Biquad designHighCut (double frequency, double sampleRate)
+    {
+        return MultibandDesign::designCrossover (std::min (frequency, 0.45 * sampleRate), sampleRate).lowpass;
+    }
+}
+
+//==============================================================================
+template <typename T>
+class ToneFilter
+{
+public:
+    // The filters run in double whatever T is. With a cutoff this low against the rate, as a 20 Hz low
+    // cut is at 96 or 192 kHz, float coefficients and state would be out by as much as the signal.
+    using Vec = typename NativeVec<double>::Type;
+
+    void prepare (int newNumChannels)
+    {
+        numChannels = newNumChannels;
+        numLanes = (numChannels + Vec::size - 1) / Vec::size * Vec::size;
+        z1.assign ((size_t) (numStages * numLanes), 0.0);
+        z2.assign ((size_t) (numStages * numLanes), 0.0);
+        lanes.assign ((size_t) (chunkSize * numLanes), 0.0);
+
+        // forces the next setSettings() to jump to its settings and design the filters
+        designedRate = 0.0;
+    }
+
+    void release()
+    {
+        for (auto* v : { &z1, &z2, &lanes })
+            *v = {};
+
+        numChannels = numLanes = numActive = 0;
+    }
+
+    void reset() noexcept
+    {
+        std::fill (z1.begin(), z1.end(), 0.0);
+        std::fill (z2.begin(), z2.end(), 0.0);
+    }
+
+    /** Glides the controls to new settings, or jumps to them when snapToTargets is set or the
+        rate changed. A stage that comes back from flat starts from silence.
+    */
+    void setSettings (const ToneDesign::Settings& newSettings, double sampleRate, bool snapToTargets) noexcept
+    {
+        const auto snap = snapToTargets || sampleRate != designedRate;
+
+        if (! snap && newSettings == settings)
+            return;
+
+        if (sampleRate != designedRate)
+        {
+            designedRate = sampleRate;
+            const auto length = (int) std::lround (sampleRate * ToneDesign::glideSeconds);
+
+            for (auto* ramp : { &tiltDb, &midGainDb })
+                ramp->reset (length);
+
+            for (auto* ramp : { &lowCutFrequency, &highCutFrequency, &midFrequency })
+                ramp->reset (length);
+        }
+
+        settings = newSettings;
+
+        // the frequencies move at a constant rate in octaves, the gains in dB
+        auto setTarget = [snap] (auto& ramp, float value)
+        {
+            if (snap)
+                ramp.setCurrentAndTargetValue (value);
+            else
+                ramp.setTargetValue (value);
+        };
+
+        setTarget (tiltDb, settings.tiltDb);
+        setTarget (lowCutFrequency, settings.lowCut);
+        setTarget (highCutFrequency, settings.highCut);
+        setTarget (midFrequency, settings.midFrequency);
+        setTarget (midGainDb, settings.midGainDb);
+        design (snap);
+    }
+
+    /** False while every control is flat, when process() would leave the signal as it is. */
+    bool isActive() const noexcept      { return numActive > 0; }
+
+    /** Filters numSamples samples from startSample of each channel, in place. */
+    void process (T* const* channels, int numChannelsToProcess, int startSample, int numSamples) noexcept
+    {
+        if (numActive == 0 && ! isGliding())
+            return;
+
+        numChannelsToProcess = std::min (numChannelsToProcess, numChannels);
+
+        // While the controls glide, the stages they touch are redesigned every glideStep samples
+        for (int done = 0; done < numSamples;)
+        {
+            const auto gliding = isGliding();
+            const int n = std::min (gliding ? ToneDesign::glideStep : chunkSize, numSamples - done);
+
+            if (gliding)
+            {
+                for (auto* ramp : { &tiltDb, &midGainDb })
+                    ramp->skip (n);
+
+                for (auto* ramp : { &lowCutFrequency, &highCutFrequency, &midFrequency })
+                    ramp->skip (n);
+
+                design (false);
+            }
+
+            if (numActive > 0)
+            {
+                interleave (channels, numChannelsToProcess, startSample + done, n);
+                filter (numChannelsToProcess, n);
+                deinterleave (channels, numChannelsToProcess, startSample + done, n);
+            }
+
+            done += n;
+        }
+    }
+
+private:
+    enum Stage
+    {
+        tilt,
+        lowCut,
+        midPeak,
+        highCut,
+        numStages
+    };
+
+    // samples per channel that go through the lane buffer at a time
+    static constexpr int chunkSize = 256;
+
+    bool isGliding() const noexcept
+    {
+        return tiltDb.isSmoothing() || midGainDb.isSmoothing()
+            || lowCutFrequency.isSmoothing() || highCutFrequency.isSmoothing() || midFrequency.isSmoothing();
+    }
+
+    /** Redesigns the stages whose controls moved since the last design. A stage stays active
+        until its controls have arrived at flat, not just been set there.
+    */
+    void design (bool redesignAll) noexcept
+    {
+        using namespace ToneDesign;
+
+        Settings now;
+        now.tiltDb = tiltDb.getCurrentValue();
+        now.lowCut = lowCutFrequency.getCurrentValue();
+        now.highCut = highCutFrequency.getCurrentValue();
+        now.midFrequency = midFrequency.getCurrentValue();
+        now.midGainDb = midGainDb.getCurrentValue();
+
+        auto update = [&] (int stage, bool moved, bool isActive, auto designStage)
+        {
+            if (redesignAll || moved || isActive != active[(size_t) stage])
+                setStage (stage, isActive, designStage());
+        };
+
+        update (tilt, now.tiltDb != designed.tiltDb, now.tiltDb != 0.0f || settings.tiltDb != 0.0f,
+                [&] { return designTilt (now.tiltDb, designedRate); });
+
+        update (lowCut, now.lowCut != designed.lowCut, now.lowCut > lowCutOff || settings.lowCut > lowCutOff,
+                [&] { return designLowCut (now.lowCut, designedRate); });
+
+        update (midPeak, now.midFrequency != designed.midFrequency || now.midGainDb != designed.midGainDb,
+                now.midGainDb != 0.0f || settings.midGainDb != 0.0f,
+                [&] { return designPeak (now.midFrequency, now.midGainDb, designedRate); });
+
+        update (highCut, now.highCut != designed.highCut, now.highCut < highCutOff || settings.highCut < highCutOff,
+                [&] { return designHighCut (now.highCut, designedRate); });
+
+        designed = now;
+        numActive = 0;
+
+        for (int s = 0; s < numStages; ++s)
+            if (active[(size_t) s])
+                activeStages[(size_t) numActive++] = s;
+    }
+
+    void setStage (int stage, bool isActive, const ToneDesign::Biquad& c) noexcept
+    {
+        if (isActive && ! active[(size_t) stage])
+        {
+            std::fill_n (z1.begin() + stage * numLanes, numLanes, 0.0);
+            std::fill_n (z2.begin() + stage * numLanes, numLanes, 0.0);
+        }
+
+        active[(size_t) stage] = isActive;
+        coefficients[(size_t) stage] = { c.b0, c.b1, c.b2, c.a1, c.a2 };
+    }
+
+    void interleave (T* const* channels, int numChannelsToProcess, int start, int n) noexcept
+    {
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+        {
+            const T* in = channels[channel] + start;
+
+            for (int i = 0; i < n; ++i)
+                lanes[(size_t) (i * numLanes + channel)] = (double) in[i];
+        }
+    }
+
+    void deinterleave (T* const* channels, int numChannelsToProcess, int start, int n) const noexcept
+    {
+        for (int channel = 0; channel < numChannelsToProcess; ++channel)
+        {
+            T* out = channels[channel] + start;
+
+            for (int i = 0; i < n; ++i)
+                out[i] = (T) lanes[(size_t) (i * numLanes + channel)];
+        }
+    }
+
+    void filter (int numChannelsToProcess, int n) noexcept
+    {
+        Vec cb0[numStages], cb1[numStages], cb2[numStages], ca1[numStages], ca2[numStages];
+
+        for (int k = 0; k < numActive; ++k)
+        {
+            auto& c = coefficients[(size_t) activeStages[(size_t) k]];
+            cb0[k] = Vec::broadcast (c[0]);
+            cb1[k] = Vec::broadcast (c[1]);
+            cb2[k] = Vec::broadcast (c[2]);
+            ca1[k] = Vec::broadcast (c[3]);
+            ca2[k] = Vec::broadcast (c[4]);
+        }
+
+        // Padding lanes are never written, so they carry zeros through the filters
+        for (int lane = 0; lane < numChannelsToProcess; lane += Vec::size)
+        {
+            Vec s1[numStages], s2[numStages];
+
+            for (int k = 0; k < numActive; ++k)
+            {
+                const int index = activeStages[(size_t) k] * numLanes + lane;
+                s1[k] = Vec::load (z1.data() + index);
+                s2[k] = Vec::load (z2.data() + index);
+            }
+
+            for (int i = 0; i < n; ++i)
+            {
+                auto x = Vec::load (lanes.data() + i * numLanes + lane);
+
+                for (int k = 0; k < numActive; ++k)
+                {
+                    const auto y = cb0[k] * x + s1[k];
+                    s1[k] = cb1[k] * x - ca1[k] * y + s2[k];
+                    s2[k] = cb2[k] * x - ca2[k] * y;
+                    x = y;
+                }
+
+                x.store (lanes.data() + i * numLanes + lane);
+            }
+
+            for (int k = 0; k < numActive; ++k)
+            {
+                const int index = activeStages[(size_t) k] * numLanes + lane;
+                s1[k].store (z1.data() + index);
+                s2[k].store (z2.data() + index);
+            }
+        }
+    }
+
+    //==============================================================================
+    int numChannels = 0, numLanes = 0;
+
+    // settings are the targets, designed the values the coefficients were last designed for
+    ToneDesign::Settings settings, designed;
+    double designedRate = 0.0;
+    ParameterRamp<false> tiltDb, midGainDb;
+    ParameterRamp<true> lowCutFrequency, highCutFrequency, midFrequency;
+
+    std::array<std::array<double, 5>, numStages> coefficients {};
+    std::array<bool, numStages> active {};
+    std::array<int, numStages> activeStages {};
+    int numActive = 0;
+
+    // stage-major: stage s of lane l is at s * numLanes + l
+    std::vector<double> z1, z2;
+
+    // sample-major: sample i of lane l is at i * numLanes + l
+    std::vector<double> lanes;
+};
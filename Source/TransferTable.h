@@ -0,0 +1,238 @@
+/*
+  ==============================================================================
+
+    TransferTable.h
+    A sampled copy of one distortion curve for a fixed type, gain and
+    threshold, plus the block kernels that read it back with linear or cubic
+    interpolation. Inputs outside the table's range fall back to the exact
+    curve, so only the common case is approximated. The curve is sampled in
+    double precision and kept in both sample types.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <vector>
+#include <type_traits>
+#include "WaveshaperKernels.h"
+
+/** What a table was built for. The audio thread only uses a table whose spec matches its own parameters.
+    The interpolation isn't part of it: every table has the guard points cubic needs, and the kernel picks either.
+*/
+struct TableSpec
+{
+    int type = 0;
+    float gainDb = 0, threshold = 0;
+    int size = 0;
+
+    bool operator== (const TableSpec& other) const noexcept
+    {
+        return type == other.type && gainDb == other.gainDb && threshold == other.threshold
+            && size == other.size;
+    }
+
+    bool operator!= (const TableSpec& other) const noexcept    { return ! operator== (other); }
+};
+
+//==============================================================================
+class TransferTable
+{
+public:
+    enum Interpolation
+    {
+        linear = 0,
+        cubic
+    };
+
+    /** Input range covered by the table, roughly +12 dBFS. */
+    static constexpr float inputRange = 4.0f;
+
+    /** Samples the curve at size + 1 points across the range, plus one guard point
+        either side for cubic interpolation. Allocates, so never call this on the audio thread.
+    */
+    void build (const TableSpec& newSpec)
+    {
+        spec = newSpec;
+        values.resize ((size_t) spec.size + 4);
+        floatValues.resize (values.size());
+        step = 2.0f * inputRange / (float) spec.size;
+
+        WaveshaperKernels::BlockParams p;
+        p.preGain = 1.0f + std::pow (10.0f, spec.gainDb * 0.05f);
+        p.gainDb = spec.gainDb;
+        p.threshold = spec.threshold;
+        p.mix = 1.0f;
+
+        // tables are built once, so the saturation curves can always have the precise tier
+        auto curve = WaveshaperKernels::getCurve<double> (spec.type, CurveApproximations::precise);
+
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            values[i] = curve != nullptr ? curve (-inputRange + ((double) i - 1.0) * step, p) : 0.0;
+            floatValues[i] = (float) values[i];
+        }
+    }
+
+    const TableSpec& getSpec() const noexcept   { return spec; }
+    float getScale() const noexcept             { return 1.0f / step; }
+
+    template <typename T>
+    const T* getValues() const noexcept
+    {
+        if constexpr (std::is_same_v<T, float>)
+            return floatValues.data();
+        else
+            return values.data();
+    }
+
+private:
+    TableSpec spec;
+    std::vector<double> values;
+    std::vector<float> floatValues;
+    float step = 1.0f;
+};
+
+//==============================================================================
+namespace TransferTableKernels
+{
+    using WaveshaperKernels::BlockParams;
+    using WaveshaperKernels::CurveParams;
+    using WaveshaperKernels::ParamRamps;
+
+    template <typename T, typename Vec, int interpolation>
+    Vec lookUp (const TransferTable& table, Vec x) noexcept
+    {
+        const auto* values = table.getValues<T>();
+
+        // index 1 holds -inputRange, see TransferTable::build()
+        auto position = (x + Vec::broadcast (TransferTable::inputRange)) * Vec::broadcast (table.getScale()) + Vec::broadcast (1.0f);
+        auto index = Vec::floor (position);
+        auto frac = position - index;
+        auto one = Vec::broadcast (1.0f);
+
+        auto p1 = Vec::gather (values, index);
+        auto p2 = Vec::gather (values, index + one);
+
+        if (interpolation == TransferTable::linear)
+            return p1 + frac * (p2 - p1);
+
+        // Catmull-Rom
+        auto p0 = Vec::gather (values, index - one);
+        auto p3 = Vec::gather (values, index + one + one);
+        auto half = Vec::broadcast (0.5f);
+        auto c1 = half * (p2 - p0);
+        auto c2 = p0 - Vec::broadcast (2.5f) * p1 + Vec::broadcast (2.0f) * p2 - half * p3;
+        auto c3 = half * (p3 - p0) + Vec::broadcast (1.5f) * (p1 - p2);
+        return p1 + frac * (c1 + frac * (c2 + frac * c3));
+    }
+
+    template <typename T, typename Vec, typename Curve, int interpolation>
+    Vec shape (const TransferTable& table, Vec x, const CurveParams<Vec>& p) noexcept
+    {
+        // NaN fails the range check as well, and takes the exact path
+        auto inRange = Vec::lessThanOrEqual (Vec::abs (x), Vec::broadcast (TransferTable::inputRange));
+
+        if (Vec::all (inRange))
+            return lookUp<T, Vec, interpolation> (table, x);
+
+        auto clamped = Vec::select (inRange, x, Vec::broadcast (0.0f));
+        return Vec::select (inRange, lookUp<T, Vec, interpolation> (table, clamped), Curve::apply (x, p));
+    }
+
+    /** Table lookup plus the dry/wet blend over a channel. in and out may alias.
+        A table only matches fixed GAIN and THRESHOLD values, so only the mix is read from ramps.
+    */
+    template <typename Curve, int interpolation, typename T>
+    void processChannel (const TransferTable& table, const T* in, T* out, int numSamples,
+                         const BlockParams& p, const ParamRamps<T>* ramps) noexcept
+    {
+        using Vec = typename NativeVec<T>::Type;
+        using Scalar = ScalarVec<T>;
+
+        const auto curve = CurveParams<Vec>::fromBlock (p);
+        const auto scalarCurve = CurveParams<Scalar>::fromBlock (p);
+        int i = 0;
+
+        if (ramps != nullptr)
+        {
+            for (; i + Vec::size <= numSamples; i += Vec::size)
+            {
+                auto x = Vec::load (in + i);
+                auto wet = Vec::load (ramps->mix + i);
+                (x * (Vec::broadcast (1.0f) - wet) + shape<T, Vec, Curve, interpolation> (table, x, curve) * wet).store (out + i);
+            }
+
+            for (; i < numSamples; ++i)
+            {
+                auto x = Scalar::load (in + i);
+                auto wet = Scalar::load (ramps->mix + i);
+                (x * (Scalar::broadcast (1.0f) - wet) + shape<T, Scalar, Curve, interpolation> (table, x, scalarCurve) * wet).store (out + i);
+            }
+
+            return;
+        }
+
+        if (p.mix <= 0.0f)
+        {
+            if (in != out)
+                std::copy (in, in + numSamples, out);
+
+            return;
+        }
+
+        if (p.mix >= 1.0f)
+        {
+            for (; i + Vec::size <= numSamples; i += Vec::size)
+                shape<T, Vec, Curve, interpolation> (table, Vec::load (in + i), curve).store (out + i);
+
+            for (; i < numSamples; ++i)
+                shape<T, Scalar, Curve, interpolation> (table, Scalar::load (in + i), scalarCurve).store (out + i);
+
+            return;
+        }
+
+        const auto wet = Vec::broadcast (p.mix);
+        const auto dry = Vec::broadcast (1.0f - p.mix);
+
+        for (; i + Vec::size <= numSamples; i += Vec::size)
+        {
+            auto x = Vec::load (in + i);
+            (x * dry + shape<T, Vec, Curve, interpolation> (table, x, curve) * wet).store (out + i);
+        }
+
+        for (; i < numSamples; ++i)
+        {
+            auto x = Scalar::load (in + i);
+            (x * Scalar::broadcast (1.0f - p.mix) + shape<T, Scalar, Curve, interpolation> (table, x, scalarCurve) * Scalar::broadcast (p.mix)).store (out + i);
+        }
+    }
+
+    template <typename T>
+    using ChannelKernel = void (*) (const TransferTable&, const T*, T*, int, const BlockParams&, const ParamRamps<T>*);
+
+    template <typename Curve, typename T>
+    ChannelKernel<T> getKernelForInterpolation (int interpolation) noexcept
+    {
+        return interpolation == TransferTable::cubic ? processChannel<Curve, TransferTable::cubic, T>
+                                                     : processChannel<Curve, TransferTable::linear, T>;
+    }
+
+    /** Picks the kernel for a TYPE value and interpolation, once per block. */
+    template <typename T>
+    ChannelKernel<T> getKernel (int type, int interpolation) noexcept
+    {
+        switch (type)
+        {
+            case WaveshaperKernels::softClip:   return getKernelForInterpolation<WaveshaperKernels::SoftClip, T> (interpolation);
+            case WaveshaperKernels::hardClip:   return getKernelForInterpolation<WaveshaperKernels::HardClip, T> (interpolation);
+            case WaveshaperKernels::foldback:   return getKernelForInterpolation<WaveshaperKernels::Foldback, T> (interpolation);
+            case WaveshaperKernels::scoopFold:  return getKernelForInterpolation<WaveshaperKernels::ScoopFold, T> (interpolation);
+            case WaveshaperKernels::tanhClip:   return getKernelForInterpolation<WaveshaperKernels::TanhClip<CurveApproximations::precise>, T> (interpolation);
+            case WaveshaperKernels::arctanClip: return getKernelForInterpolation<WaveshaperKernels::ArctanClip<CurveApproximations::precise>, T> (interpolation);
+            case WaveshaperKernels::tube:       return getKernelForInterpolation<WaveshaperKernels::Tube<CurveApproximations::precise>, T> (interpolation);
+            case WaveshaperKernels::diode:      return getKernelForInterpolation<WaveshaperKernels::Diode<CurveApproximations::precise>, T> (interpolation);
+            default:                            return nullptr;
+        }
+    }
+}
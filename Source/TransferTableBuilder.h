@@ -0,0 +1,131 @@
+/*
+  ==============================================================================
+
+    TransferTableBuilder.h
+    Rebuilds an instance's TransferTable off the audio thread. All instances
+    share one low-priority TimeSliceThread. The audio thread posts the spec it
+    wants and picks up whichever table has been published, without locking
+    or allocating. Two table slots are swapped: the builder only overwrites
+    the slot the audio thread has stopped reading.
+
+    Tables are read-only once built, so instances with the same spec share
+    one through a process-wide SharedCache instead of each building its own.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "TransferTable.h"
+#include "SharedCache.h"
+
+class TransferTableBuilder  : private juce::TimeSliceClient
+{
+public:
+    TransferTableBuilder()
+    {
+        thread->addTimeSliceClient (this);
+    }
+
+    ~TransferTableBuilder() override
+    {
+        thread->removeTimeSliceClient (this);
+    }
+
+    /** Audio thread: asks for a table matching spec. Never blocks. */
+    void request (const TableSpec& spec) noexcept
+    {
+        if (spec == lastRequested)
+            return;
+
+        lastRequested = spec;
+
+        // Odd while the fields are being written, the builder retries if it catches that
+        requestVersion.fetch_add (1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+        requestedType.store (spec.type, std::memory_order_relaxed);
+        requestedGainDb.store (spec.gainDb, std::memory_order_relaxed);
+        requestedThreshold.store (spec.threshold, std::memory_order_relaxed);
+        requestedSize.store (spec.size, std::memory_order_relaxed);
+        requestVersion.fetch_add (1, std::memory_order_release);
+    }
+
+    /** Audio thread: the published table if it was built for spec, otherwise nullptr.
+        The returned table stays valid until the next call.
+    */
+    const TransferTable* acquire (const TableSpec& spec) noexcept
+    {
+        auto slot = published.load (std::memory_order_acquire);
+        inUse.store (slot, std::memory_order_release);
+
+        if (slot < 0 || tables[slot]->getSpec() != spec)
+            return nullptr;
+
+        return tables[slot].get();
+    }
+
+    using Cache = SharedCache<TableSpec, TransferTable>;
+
+private:
+    struct SharedThread  : public juce::TimeSliceThread
+    {
+        SharedThread() : juce::TimeSliceThread ("EZ Distortion Tables")   { startThread (Priority::low); }
+        ~SharedThread() override                                         { stopThread (1000); }
+    };
+
+    int useTimeSlice() override
+    {
+        TableSpec spec;
+        auto version = requestVersion.load (std::memory_order_acquire);
+
+        if ((version & 1) != 0)
+            return 1;
+
+        spec.type = requestedType.load (std::memory_order_relaxed);
+        spec.gainDb = requestedGainDb.load (std::memory_order_relaxed);
+        spec.threshold = requestedThreshold.load (std::memory_order_relaxed);
+        spec.size = requestedSize.load (std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_acquire);
+
+        if (requestVersion.load (std::memory_order_relaxed) != version)
+            return 1;
+
+        if (spec.size <= 0 || spec == built)
+            return 20;
+
+        // Wait until the audio thread has moved on to the newest table before reusing the other slot
+        auto slot = published.load (std::memory_order_acquire);
+
+        if (slot >= 0 && inUse.load (std::memory_order_acquire) != slot)
+            return 5;
+
+        // Replacing the slot's pointer here frees the old table if no other instance holds it
+        auto target = slot == 0 ? 1 : 0;
+        tables[target] = cache->getOrBuild (spec, [&spec]
+        {
+            auto table = std::make_unique<TransferTable>();
+            table->build (spec);
+            return table;
+        });
+
+        published.store (target, std::memory_order_release);
+        built = spec;
+        return 5;
+    }
+
+    juce::SharedResourcePointer<SharedThread> thread;
+    juce::SharedResourcePointer<Cache> cache;
+
+    Cache::Pointer tables[2];
+    std::atomic<int> published { -1 }, inUse { -1 };
+    TableSpec built;
+
+    // written by the audio thread only
+    TableSpec lastRequested;
+    std::atomic<unsigned int> requestVersion { 0 };
+    std::atomic<int> requestedType { 0 }, requestedSize { 0 };
+    std::atomic<float> requestedGainDb { 0 }, requestedThreshold { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (TransferTableBuilder)
+};
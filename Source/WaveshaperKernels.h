@@ -0,0 +1,363 @@
+/*
+  ==============================================================================
+
+    WaveshaperKernels.h
+    Branchless block kernels for the distortion types. Each curve is
+    written once against the SIMDVec/ScalarVec interface, so the vector body
+    and the scalar tail of a block evaluate exactly the same expression, and
+    the float and double kernels are both instantiated from the same code.
+    The saturation curves from Tanh on take a CURVE_ACCURACY tier, see
+    CurveApproximations.h.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "CurveApproximations.h"
+#include "SIMDVec.h"
+
+namespace WaveshaperKernels
+{
+    enum Type
+    {
+        softClip = 1,
+        hardClip,
+        foldback,
+        scoopFold,
+        tanhClip,
+        arctanClip,
+        tube,
+        diode,
+        lastType = diode
+    };
+
+    /** Everything a kernel needs for one block, resolved from the parameters once. */
+    struct BlockParams
+    {
+        float preGain;      // 1 + GAIN as linear gain
+        float gainDb;       // raw GAIN in dB, ScoopFold scales by it directly
+        float threshold;    // THRESHOLD as linear gain
+        float mix;
+    };
+
+    /** Per-sample values of the same parameters while any of them is still ramping,
+        in the sample type being processed.
+    */
+    template <typename T>
+    struct ParamRamps
+    {
+        const T* preGain;
+        const T* gainDb;
+        const T* threshold;
+        const T* mix;
+    };
+
+    /** The curve parameters for one vector of samples, plus the values the curves derive from them. */
+    template <typename Vec>
+    struct CurveParams
+    {
+        CurveParams (Vec newPreGain, Vec newGainDb, Vec newThreshold) noexcept
+            : preGain (newPreGain),
+              threshold (newThreshold),
+              foldRatio (Vec::broadcast (1.0f) / (newThreshold * Vec::broadcast (10.0f))),
+              scoopGain (newGainDb * (newThreshold * Vec::broadcast (10.0f))),
+              drive (newPreGain / newThreshold)
+        {
+        }
+
+        static CurveParams fromBlock (const BlockParams& p) noexcept
+        {
+            return { Vec::broadcast (p.preGain), Vec::broadcast (p.gainDb), Vec::broadcast (p.threshold) };
+        }
+
+        template <typename T>
+        static CurveParams fromRamps (const ParamRamps<T>& r, int index) noexcept
+        {
+            return { Vec::load (r.preGain + index), Vec::load (r.gainDb + index), Vec::load (r.threshold + index) };
+        }
+
+        Vec preGain, threshold;
+        Vec foldRatio;      // ScoopFold: 1 / (10 * threshold)
+        Vec scoopGain;      // ScoopFold: GAIN in dB * 10 * threshold
+        Vec drive;          // saturation curves: preGain / threshold
+    };
+
+    //==============================================================================
+    struct SoftClip
+    {
+        template <typename Vec>
+        static Vec apply (Vec x, const CurveParams<Vec>& p) noexcept
+        {
+            auto g = x * p.preGain;
+
+            // Outside the threshold the curve holds at +-2/3, where the cubic levels off.
+            // The level is divided in the vector's own precision, so doubles get the full 2/3.
+            auto level = Vec::broadcast (2.0f) / Vec::broadcast (3.0f);
+            auto cubic = g - (g * g * g) / Vec::broadcast (3.0f);
+            auto clipped = Vec::select (Vec::lessThan (g, Vec::broadcast (0.0f)), -level, level);
+            return Vec::select (Vec::lessThan (Vec::abs (g), p.threshold), cubic, clipped);
+        }
+    };
+
+    struct HardClip
+    {
+        template <typename Vec>
+        static Vec apply (Vec x, const CurveParams<Vec>& p) noexcept
+        {
+            auto g = x * p.preGain;
+            auto t = p.threshold;
+
+            auto upper = Vec::select (Vec::greaterThanOrEqual (g, t), Vec::broadcast (1.0f), g);
+            return Vec::select (Vec::lessThanOrEqual (g, -t), Vec::broadcast (-1.0f), upper);
+        }
+    };
+
+    struct Foldback
+    {
+        template <typename Vec>
+        static Vec apply (Vec x, const CurveParams<Vec>& p) noexcept
+        {
+            auto g = x * p.preGain;
+            auto t = p.threshold;
+            auto period = t * Vec::broadcast (4.0f);
+
+            // fmod (g - t, 4t), then fold as in EZDistortionAudioProcessor::foldback()
+            auto shifted = g - t;
+            auto wrapped = shifted - period * Vec::trunc (shifted / period);
+            auto folded = Vec::abs (Vec::abs (wrapped) - t * Vec::broadcast (2.0f)) - t;
+            return Vec::select (Vec::greaterThan (Vec::abs (g), t), folded, g);
+        }
+    };
+
+    struct ScoopFold
+    {
+        template <typename Vec>
+        static Vec apply (Vec x, const CurveParams<Vec>& p) noexcept
+        {
+            auto scaled = p.foldRatio * (x * p.scoopGain) + p.foldRatio;
+            return p.foldRatio * Vec::abs (scaled - Vec::round (scaled) - Vec::broadcast (0.25f));
+        }
+    };
+
+    //==============================================================================
+    /** The saturation curves below all have a slope of 1 at zero and level off at around
+        +-threshold, so THRESHOLD sets where they start to bend.
+    */
+    template <int accuracy>
+    struct TanhClip
+    {
+        template <typename Vec>
+        static Vec apply (Vec x, const CurveParams<Vec>& p) noexcept
+        {
+            return p.threshold * CurveApproximations::tanh<accuracy> (x * p.drive);
+        }
+    };
+
+    template <int accuracy>
+    struct ArctanClip
+    {
+        template <typename Vec>
+        static Vec apply (Vec x, const CurveParams<Vec>& p) noexcept
+        {
+            // scaled so it heads for +-threshold with the same slope at zero as tanh
+            auto u = x * p.drive * Vec::broadcast (1.57079632679489662);
+            return p.threshold * Vec::broadcast (0.636619772367581343) * CurveApproximations::atan<accuracy> (u);
+        }
+    };
+
+    /** tanh moved along by a bias, then shifted and scaled back to pass through zero with a
+        slope of 1. The positive half levels off at threshold / (1 + tanh b), the negative half
+        at threshold / (1 - tanh b), which brings in even harmonics, and some DC for the POST
+        low cut to take out.
+    */
+    template <int accuracy>
+    struct Tube
+    {
+        static constexpr float bias = 0.25f;
+
+        template <typename Vec>
+        static Vec apply (Vec x, const CurveParams<Vec>& p) noexcept
+        {
+            // the bias goes through the same approximation, so 0 still maps to exactly 0
+            auto b = Vec::broadcast (bias);
+            auto tb = CurveApproximations::tanh<accuracy> (b);
+            auto shaped = CurveApproximations::tanh<accuracy> (x * p.drive + b) - tb;
+            return p.threshold * shaped / (Vec::broadcast (1.0f) - tb * tb);
+        }
+    };
+
+    /** k (1 - e^(-|v| / k)) with k = 1 forward and 1/2 reverse, so negative peaks give out at
+        half the level. Written as 2k h / (1 + h) with h = tanh (|v| / 2k), which is the same
+        thing exactly and keeps to the one approximation.
+    */
+    template <int accuracy>
+    struct Diode
+    {
+        template <typename Vec>
+        static Vec apply (Vec x, const CurveParams<Vec>& p) noexcept
+        {
+            auto v = x * p.drive;
+            auto reverse = Vec::lessThan (v, Vec::broadcast (0.0f));
+            auto k = Vec::select (reverse, Vec::broadcast (0.5f), Vec::broadcast (1.0f));
+            auto h = CurveApproximations::tanh<accuracy> (Vec::abs (v) * Vec::select (reverse, Vec::broadcast (1.0f), Vec::broadcast (0.5f)));
+            auto level = p.threshold * k * Vec::broadcast (2.0f) * h / (Vec::broadcast (1.0f) + h);
+            return Vec::select (reverse, -level, level);
+        }
+    };
+
+    /** The largest difference from the exact curve, as a fraction of THRESHOLD, for a type
+        and accuracy. 0 for the types that don't approximate anything.
+    */
+    inline double getMaxError (int type, int accuracy) noexcept
+    {
+        switch (type)
+        {
+            case tanhClip:   return CurveApproximations::getTanhError (accuracy);
+            case arctanClip: return CurveApproximations::getAtanError (accuracy);
+            case tube:       return CurveApproximations::getTanhError (accuracy) * 2.0;
+            case diode:      return CurveApproximations::getTanhError (accuracy);
+            default:         return 0.0;
+        }
+    }
+
+    //==============================================================================
+    /** Runs one curve plus the dry/wet blend over a channel. in and out may alias.
+        ramps is nullptr while no parameter is moving, and the block values are used throughout.
+    */
+    template <typename Curve, typename T>
+    void processChannel (const T* in, T* out, int numSamples, const BlockParams& p, const ParamRamps<T>* ramps) noexcept
+    {
+        using Vec = typename NativeVec<T>::Type;
+        using Scalar = ScalarVec<T>;
+        int i = 0;
+
+        if (ramps != nullptr)
+        {
+            for (; i + Vec::size <= numSamples; i += Vec::size)
+            {
+                auto x = Vec::load (in + i);
+                auto wet = Vec::load (ramps->mix + i);
+                (x * (Vec::broadcast (1.0f) - wet) + Curve::apply (x, CurveParams<Vec>::fromRamps (*ramps, i)) * wet).store (out + i);
+            }
+
+            for (; i < numSamples; ++i)
+            {
+                auto x = Scalar::load (in + i);
+                auto wet = Scalar::load (ramps->mix + i);
+                (x * (Scalar::broadcast (1.0f) - wet) + Curve::apply (x, CurveParams<Scalar>::fromRamps (*ramps, i)) * wet).store (out + i);
+            }
+
+            return;
+        }
+
+        // Fully dry is a plain copy, fully wet skips the blend
+        if (p.mix <= 0.0f)
+        {
+            if (in != out)
+                std::copy (in, in + numSamples, out);
+
+            return;
+        }
+
+        const auto curve = CurveParams<Vec>::fromBlock (p);
+        const auto scalarCurve = CurveParams<Scalar>::fromBlock (p);
+
+        if (p.mix >= 1.0f)
+        {
+            for (; i + Vec::size <= numSamples; i += Vec::size)
+                Curve::apply (Vec::load (in + i), curve).store (out + i);
+
+            for (; i < numSamples; ++i)
+                Curve::apply (Scalar::load (in + i), scalarCurve).store (out + i);
+
+            return;
+        }
+
+        const auto wet = Vec::broadcast (p.mix);
+        const auto dry = Vec::broadcast (1.0f - p.mix);
+
+        for (; i + Vec::size <= numSamples; i += Vec::size)
+        {
+            auto x = Vec::load (in + i);
+            (x * dry + Curve::apply (x, curve) * wet).store (out + i);
+        }
+
+        for (; i < numSamples; ++i)
+        {
+            auto x = Scalar::load (in + i);
+            (x * Scalar::broadcast (1.0f - p.mix) + Curve::apply (x, scalarCurve) * Scalar::broadcast (p.mix)).store (out + i);
+        }
+    }
+
+    template <typename T>
+    using ChannelKernel = void (*) (const T*, T*, int, const BlockParams&, const ParamRamps<T>*);
+
+    template <typename T>
+    using CurveFunction = T (*) (T, const BlockParams&);
+
+    /** One sample of a curve, without the blend. */
+    template <typename Curve, typename T>
+    T applyCurve (T x, const BlockParams& p) noexcept
+    {
+        using Scalar = ScalarVec<T>;
+        return Curve::apply (Scalar::broadcast (x), CurveParams<Scalar>::fromBlock (p)).value;
+    }
+
+    template <template <int> class Curve, typename T>
+    ChannelKernel<T> getKernelForAccuracy (int accuracy) noexcept
+    {
+        switch (accuracy)
+        {
+            case CurveApproximations::fast:     return processChannel<Curve<CurveApproximations::fast>, T>;
+            case CurveApproximations::balanced: return processChannel<Curve<CurveApproximations::balanced>, T>;
+            default:                            return processChannel<Curve<CurveApproximations::precise>, T>;
+        }
+    }
+
+    template <template <int> class Curve, typename T>
+    CurveFunction<T> getCurveForAccuracy (int accuracy) noexcept
+    {
+        switch (accuracy)
+        {
+            case CurveApproximations::fast:     return applyCurve<Curve<CurveApproximations::fast>, T>;
+            case CurveApproximations::balanced: return applyCurve<Curve<CurveApproximations::balanced>, T>;
+            default:                            return applyCurve<Curve<CurveApproximations::precise>, T>;
+        }
+    }
+
+    /** Picks the kernel for a TYPE value, once per block. accuracy only matters from Tanh on. */
+    template <typename T>
+    ChannelKernel<T> getKernel (int type, int accuracy) noexcept
+    {
+        switch (type)
+        {
+            case softClip:   return processChannel<SoftClip, T>;
+            case hardClip:   return processChannel<HardClip, T>;
+            case foldback:   return processChannel<Foldback, T>;
+            case scoopFold:  return processChannel<ScoopFold, T>;
+            case tanhClip:   return getKernelForAccuracy<TanhClip, T> (accuracy);
+            case arctanClip: return getKernelForAccuracy<ArctanClip, T> (accuracy);
+            case tube:       return getKernelForAccuracy<Tube, T> (accuracy);
+            case diode:      return getKernelForAccuracy<Diode, T> (accuracy);
+            default:         return nullptr;
+        }
+    }
+
+    template <typename T>
+    CurveFunction<T> getCurve (int type, int accuracy) noexcept
+    {
+        switch (type)
+        {
+            case softClip:   return applyCurve<SoftClip, T>;
+            case hardClip:   return applyCurve<HardClip, T>;
+            case foldback:   return applyCurve<Foldback, T>;
+            case scoopFold:  return applyCurve<ScoopFold, T>;
+            case tanhClip:   return getCurveForAccuracy<TanhClip, T> (accuracy);
+            case arctanClip: return getCurveForAccuracy<ArctanClip, T> (accuracy);
+            case tube:       return getCurveForAccuracy<Tube, T> (accuracy);
+            case diode:      return getCurveForAccuracy<Diode, T> (accuracy);
+            default:         return nullptr;
+        }
+    }
+}
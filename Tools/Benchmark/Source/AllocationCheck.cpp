@@ -0,0 +1,332 @@
+/*
+  ==============================================================================
+
+    AllocationCheck.cpp
+    The processBlock half of ezbench --check. Heap allocations are counted
+    on the thread that asked for them, so the table builder's thread can
+    allocate freely. On Linux malloc and its relatives are wrapped, which
+    catches everything. Elsewhere only operator new is replaced, which misses
+    JUCE's HeapBlock, as that calls std::malloc directly.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <cerrno>
+#include <iostream>
+#include "Conformance.h"
+#include "PluginProcessor.h"
+
+namespace
+{
+    thread_local bool countingAllocations = false;
+    std::atomic<int> numAllocations { 0 };
+
+    void noteAllocation() noexcept
+    {
+        if (countingAllocations)
+            numAllocations.fetch_add (1, std::memory_order_relaxed);
+    }
+
+    /** Counts this thread's allocations for as long as it exists. */
+    struct ScopedAllocationCount
+    {
+        ScopedAllocationCount() noexcept     { numAllocations = 0; countingAllocations = true; }
+        ~ScopedAllocationCount() noexcept    { countingAllocations = false; }
+    };
+}
+
+#if defined (__GLIBC__)
+extern "C"
+{
+    void* __libc_malloc (size_t);
+    void* __libc_calloc (size_t, size_t);
+    void* __libc_realloc (void*, size_t);
+    void* __libc_memalign (size_t, size_t);
+
+    void* malloc (size_t size) noexcept                         { noteAllocation(); return __libc_malloc (size); }
+    void* calloc (size_t count, size_t size) noexcept           { noteAllocation(); return __libc_calloc (count, size); }
+    void* realloc (void* block, size_t size) noexcept           { noteAllocation(); return __libc_realloc (block, size); }
+    void* memalign (size_t alignment, size_t size) noexcept     { noteAllocation(); return __libc_memalign (alignment, size); }
+    void* aligned_alloc (size_t alignment, size_t size) noexcept { noteAllocation(); return __libc_memalign (alignment, size); }
+
+    int posix_memalign (void** result, size_t alignment, size_t size) noexcept
+    {
+        noteAllocation();
+        *result = __libc_memalign (alignment, size);
+        return *result != nullptr ? 0 : ENOMEM;
+    }
+}
+#else
+void* operator new (std::size_t size)
+{
+    noteAllocation();
+
+    if (auto* block = std::malloc (size > 0 ? size : 1))
+        return block;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size)     { return operator new (size); }
+void operator delete (void* block) noexcept     { std::free (block); }
+void operator delete[] (void* block) noexcept   { std::free (block); }
+#endif
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 512;
+    constexpr int numBlocks = 48;
+
+    /** What changes between runs, on top of every TYPE in both precisions. */
+    struct Setting
+    {
+        const char* oversampling;
+        const char* filter;
+        const char* antialiasing;
+        const char* engine;
+        const char* bands;
+        const char* accuracy;
+        bool tone;          // shapes both tone stages and moves them in the first half
+        bool cabinet;       // loads a response, and another at the halfway point
+        bool governor;
+        bool programs;      // switches program a third and two thirds of the way through
+    };
+
+    const Setting settings[] = {
+        { "1x",  "Minimum Phase", "Off",            "Direct", "Off",     "Balanced", false, false, false, false },
+        { "4x",  "Linear Phase",  "Off",            "Direct", "Off",     "Fast",     false, false, false, false },
+        { "16x", "Minimum Phase", "Off",            "Direct", "Off",     "Precise",  false, false, false, false },
+        { "2x",  "Minimum Phase", "ADAA 1st Order", "Direct", "Off",     "Balanced", false, false, false, false },
+        { "4x",  "Linear Phase",  "ADAA 2nd Order", "Direct", "Off",     "Balanced", false, false, false, false },
+        { "1x",  "Minimum Phase", "Off",            "Table",  "Off",     "Balanced", false, false, false, false },
+        { "4x",  "Minimum Phase", "Off",            "Table",  "Off",     "Fast",     false, false, false, false },
+        { "1x",  "Minimum Phase", "Off",            "Direct", "4 Bands", "Precise",  false, false, false, false },
+        { "8x",  "Linear Phase",  "Off",            "Direct", "3 Bands", "Fast",     false, false, false, false },
+        { "2x",  "Minimum Phase", "Off",            "Direct", "Off",     "Balanced", true,  false, false, false },
+        { "1x",  "Minimum Phase", "Off",            "Direct", "Off",     "Balanced", false, true,  false, false },
+        { "8x",  "Minimum Phase", "Off",            "Direct", "Off",     "Precise",  false, false, true,  false },
+        { "4x",  "Minimum Phase", "ADAA 1st Order", "Direct", "2 Bands", "Balanced", false, false, false, true },
+        { "4x",  "Linear Phase",  "Off",            "Table",  "4 Bands", "Balanced", true,  true,  true,  true }
+    };
+
+    void setParameter (EZDistortionAudioProcessor& processor, const juce::String& id, const juce::String& text)
+    {
+        if (auto* parameter = processor.apvts.getParameter (id))
+            parameter->setValueNotifyingHost (parameter->getValueForText (text));
+    }
+
+    /** Two channels of decaying noise, stored the way a session stores a cabinet response. */
+    juce::MemoryBlock makeResponse (int numSamples, juce::int64 seed)
+    {
+        juce::MemoryBlock state;
+        juce::Random random (seed);
+
+        {
+            juce::MemoryOutputStream stream (state, false);
+            stream.writeString ({});
+            stream.writeDouble (sampleRate);
+            stream.writeCompressedInt (2);
+            stream.writeCompressedInt (numSamples);
+
+            for (int channel = 0; channel < 2; ++channel)
+                for (int i = 0; i < numSamples; ++i)
+                    stream.writeFloat ((random.nextFloat() - 0.5f) * std::exp (-6.0f * (float) i / (float) numSamples));
+        }
+
+        return state;
+    }
+
+    /** Cycles through noise, full-scale square waves, denormals, silence and +-1e30. */
+    template <typename T>
+    void fillInput (juce::AudioBuffer<T>& buffer, int block, juce::Random& random)
+    {
+        auto kind = block % 5;
+        auto denormal = std::numeric_limits<T>::min() * (T) 0.01;
+
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            auto* data = buffer.getWritePointer (channel);
+
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+            {
+                auto sign = (i / 16) % 2 == 0 ? (T) 1 : (T) -1;
+
+                switch (kind)
+                {
+                    case 0:  data[i] = (T) (random.nextFloat() - 0.5f); break;
+                    case 1:  data[i] = sign; break;
+                    case 2:  data[i] = sign * denormal; break;
+                    case 3:  data[i] = 0; break;
+                    default: data[i] = sign * (T) 1.0e30; break;
+                }
+            }
+        }
+    }
+
+    /** The first half of a run moves GAIN, THRESHOLD and MIX between their limits and switches
+        TYPE partway through blocks, along with the tone controls if they're in use. The second
+        half is steady, so tables get used as well.
+    */
+    void queueEvents (EZDistortionAudioProcessor& processor, const Setting& setting, int block)
+    {
+        if (block >= numBlocks / 2)
+            return;
+
+        auto queue = [&] (int offset, const char* id, float value)
+        {
+            auto index = PresetBank::indexOf (id);
+            auto* parameter = processor.apvts.getParameter (id);
+            processor.queueParameterEvent ({ offset, index, parameter->convertTo0to1 (value) });
+        };
+
+        auto high = block % 2 == 0;
+        queue (0, "GAIN", high ? 6.0f : -40.0f);
+        queue (blockSize / 3, "THRESHOLD", high ? -40.0f : 6.0f);
+        queue (blockSize / 2, "BAND1_GAIN", high ? 6.0f : -40.0f);
+        queue (blockSize / 2, "MIX", high ? 1.0f : 0.0f);
+        queue (blockSize - 1, "TYPE", (float) (block % WaveshaperKernels::lastType + 1));
+
+        if (setting.tone)
+        {
+            queue (blockSize / 4, "PRE_LOW_CUT", high ? 2000.0f : 20.0f);
+            queue (blockSize / 4, "PRE_MID_GAIN", high ? 12.0f : -12.0f);
+            queue (blockSize * 3 / 4, "POST_HIGH_CUT", high ? 1000.0f : 20000.0f);
+            queue (blockSize * 3 / 4, "POST_TILT", high ? -12.0f : 12.0f);
+        }
+    }
+
+    template <typename T>
+    bool isFinite (const juce::AudioBuffer<T>& buffer)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                if (! std::isfinite (buffer.getSample (channel, i)))
+                    return false;
+
+        return true;
+    }
+
+    /** Returns an empty string if the run neither allocated nor produced NaN or Inf. */
+    template <typename T>
+    juce::String run (const Setting& setting, int type)
+    {
+        EZDistortionAudioProcessor processor;
+        setParameter (processor, "TYPE", juce::String (type));
+        setParameter (processor, "OVERSAMPLING", setting.oversampling);
+        setParameter (processor, "OS_FILTER", setting.filter);
+        setParameter (processor, "ANTIALIAS", setting.antialiasing);
+        setParameter (processor, "ENGINE", setting.engine);
+        setParameter (processor, "BANDS", setting.bands);
+        setParameter (processor, "CURVE_ACCURACY", setting.accuracy);
+        setParameter (processor, "GOVERNOR", setting.governor ? "On" : "Off");
+        setParameter (processor, "CAB", setting.cabinet ? "On" : "Off");
+
+        if (setting.tone)
+        {
+            for (auto* stage : { "PRE_", "POST_" })
+            {
+                setParameter (processor, juce::String (stage) + "TILT", "3");
+                setParameter (processor, juce::String (stage) + "LOW_CUT", "120");
+                setParameter (processor, juce::String (stage) + "HIGH_CUT", "9000");
+                setParameter (processor, juce::String (stage) + "MID_GAIN", "-6");
+            }
+        }
+
+        processor.setProcessingPrecision (std::is_same_v<T, double> ? juce::AudioProcessor::doublePrecision
+                                                                    : juce::AudioProcessor::singlePrecision);
+        processor.prepareToPlay (sampleRate, blockSize);
+
+        if (setting.cabinet)
+        {
+            auto response = makeResponse (4096, 1213);
+            processor.cabinet.readState (response.getData(), response.getSize());
+
+            if (! processor.cabinet.waitUntilReady (10000))
+                return "the cabinet response wasn't built";
+        }
+
+        juce::AudioBuffer<T> buffer (2, blockSize);
+        juce::MidiBuffer midi;
+        juce::Random random (91011);
+        int allocations = 0;
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            // Hosts don't always fill the block, so every third one is shorter
+            juce::AudioBuffer<T> part (buffer.getArrayOfWritePointers(), 2, block % 3 == 2 ? blockSize / 3 + block : blockSize);
+            fillInput (part, block, random);
+
+            // gives the builder thread time to publish a table for the steady half
+            if (block == numBlocks / 2)
+                juce::Thread::sleep (50);
+
+            // a longer response, so the new one fades in over the steady half
+            if (setting.cabinet && block == numBlocks / 2)
+            {
+                auto response = makeResponse (24000, 1415);
+                processor.cabinet.readState (response.getData(), response.getSize());
+
+                if (! processor.cabinet.waitUntilReady (10000))
+                    return "the second cabinet response wasn't built";
+            }
+
+            {
+                const ScopedAllocationCount counting;
+                queueEvents (processor, setting, block);
+
+                // hosts may call this on the audio thread. The factory presets turn BANDS off,
+                // so multiband runs dip the output for the switch and the others switch at once.
+                if (setting.programs && (block == numBlocks / 3 || block == numBlocks * 2 / 3))
+                    processor.setCurrentProgram (block == numBlocks / 3 ? 6 : 9);
+
+                processor.processBlock (part, midi);
+                allocations += numAllocations.load();
+            }
+
+            if (! isFinite (part))
+                return "NaN or Inf output in block " + juce::String (block);
+        }
+
+        processor.releaseResources();
+        return allocations > 0 ? juce::String (allocations) + " allocations on the audio thread" : juce::String();
+    }
+}
+
+//==============================================================================
+int checkProcessBlock()
+{
+    int numFailed = 0;
+    std::cout << "\nprecision  type  oversampling  filter         antialiasing    engine  bands    accuracy  tone  cab  governor  programs" << std::endl;
+
+    for (auto& setting : settings)
+    {
+        for (int type = 1; type <= WaveshaperKernels::lastType; ++type)
+        {
+            for (auto isDouble : { false, true })
+            {
+                auto problem = isDouble ? run<double> (setting, type) : run<float> (setting, type);
+
+                std::cout << juce::String (isDouble ? "double" : "float").paddedRight (' ', 11)
+                          << juce::String (type).paddedRight (' ', 6)
+                          << juce::String (setting.oversampling).paddedRight (' ', 14)
+                          << juce::String (setting.filter).paddedRight (' ', 15)
+                          << juce::String (setting.antialiasing).paddedRight (' ', 16)
+                          << juce::String (setting.engine).paddedRight (' ', 8)
+                          << juce::String (setting.bands).paddedRight (' ', 9)
+                          << juce::String (setting.accuracy).paddedRight (' ', 10)
+                          << juce::String (setting.tone ? "on" : "off").paddedRight (' ', 6)
+                          << juce::String (setting.cabinet ? "on" : "off").paddedRight (' ', 5)
+                          << juce::String (setting.governor ? "on" : "off").paddedRight (' ', 10)
+                          << juce::String (setting.programs ? "on" : "off").paddedRight (' ', 10)
+                          << (problem.isEmpty() ? "ok" : "FAILED: " + problem) << std::endl;
+
+                if (problem.isNotEmpty())
+                    ++numFailed;
+            }
+        }
+    }
+
+    return numFailed;
+}
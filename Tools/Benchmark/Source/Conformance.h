@@ -0,0 +1,30 @@
+/*
+  ==============================================================================
+
+    Conformance.h
+    ezbench --check: numerical conformance of the optimised kernels against
+    ReferenceCurves, the float crossovers against the double ones, and a
+    fuzzed run of processBlock that fails if the
+    audio thread allocates or produces NaN or Inf from finite input.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+/** Compares the direct, table and ADAA kernels with the reference curves in both
+    sample types, across the parameter limits and fuzzed inputs. Prints a line per
+    kernel and curve, and returns the number of checks that failed.
+*/
+int checkKernels();
+
+/** Runs the multiband crossovers fully dry, so the bands sum to an allpass, in float and in double
+    at 16x oversampling. Fails where the float sum strays from the double one. Returns the number of
+    failed checks.
+*/
+int checkBandSums();
+
+/** Runs processBlock over a grid of settings with extreme input and mid-block parameter
+    events, counting heap allocations on the calling thread. Returns the number of failed runs.
+*/
+int checkProcessBlock();
@@ -0,0 +1,546 @@
+/*
+  ==============================================================================
+
+    KernelConformance.cpp
+    The kernel half of ezbench --check. Every fast path runs over the same
+    fuzzed input in chunks of uneven length, so vector bodies, scalar tails
+    and unaligned starts are all covered. Each output is compared with the
+    reference twice: its error against the size of the values the curve
+    went through, and its distance in ulps where no cancellation is expected.
+    The saturation curves are approximations, and may also be out by the
+    maximum error documented for their accuracy tier, scaled by THRESHOLD.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include "Conformance.h"
+#include "ReferenceCurves.h"
+#include "ADAAKernels.h"
+#include "TransferTable.h"
+#include "MultibandDistortion.h"
+
+namespace
+{
+    using WaveshaperKernels::BlockParams;
+    using WaveshaperKernels::ParamRamps;
+    using ReferenceCurves::Params;
+
+    // Errors may reach errorLimit epsilons of the sample type times the reference's magnitude.
+    // Outputs of at least a quarter of that magnitude may also be at most ulpLimit ulps out.
+    constexpr double errorLimit = 16.0;
+    constexpr juce::int64 ulpLimit = 8;
+
+    // Inputs this close to a jump, relative to the sample type's epsilon, may land on either side of it
+    constexpr double jumpDistance = 64.0;
+
+    const char* const typeNames[] = { "", "soft clip", "hard clip", "foldback", "scoopfold", "tanh", "arctan", "tube", "diode" };
+    const char* const accuracyNames[] = { "fast", "balanced", "precise" };
+
+    // The parameter limits and a value in between
+    const float gainValues[] = { -40.0f, -17.0f, 0.0f, 6.0f };
+    const float thresholdValues[] = { -40.0f, -12.0f, 0.0f, 6.0f };
+    const float mixValues[] = { 0.0f, 0.5f, 1.0f };
+
+    // Cycled through, so chunks start at every alignment and end in every tail length
+    const int chunkLengths[] = { 1, 3, 7, 8, 16, 37, 64, 129 };
+
+    BlockParams makeParams (float gainDb, float thresholdDb, float mix) noexcept
+    {
+        // as CurveRamps converts them
+        return { 1.0f + std::pow (10.0f, gainDb * 0.05f), gainDb, std::pow (10.0f, thresholdDb * 0.05f), mix };
+    }
+
+    //==============================================================================
+    struct Result
+    {
+        int numChecked = 0, numSkipped = 0, numFailed = 0;
+        double maxError = 0.0;      // in epsilons of the reference's magnitude
+        juce::int64 maxUlps = 0;
+        juce::String firstFailure;
+    };
+
+    /** Representable values between a and b, counting through zero. */
+    template <typename T>
+    juce::int64 ulpDistance (T a, T b) noexcept
+    {
+        using Bits = std::conditional_t<std::is_same_v<T, float>, juce::uint32, juce::uint64>;
+        constexpr auto signBit = (Bits) 1 << (sizeof (Bits) * 8 - 1);
+
+        // Orders the bit patterns the same way as the values they hold
+        auto toOrdered = [] (T value)
+        {
+            Bits bits;
+            std::memcpy (&bits, &value, sizeof (bits));
+            return (bits & signBit) != 0 ? (Bits) ~bits : (Bits) (bits | signBit);
+        };
+
+        auto ua = toOrdered (a), ub = toOrdered (b);
+        auto distance = (juce::uint64) (ua > ub ? ua - ub : ub - ua);
+        return (juce::int64) juce::jmin (distance, (juce::uint64) std::numeric_limits<juce::int64>::max());
+    }
+
+    /** The approximation error a curve may have on top of rounding, for a given blend. */
+    double getAllowance (int type, int accuracy, const Params& p) noexcept
+    {
+        return WaveshaperKernels::getMaxError (type, accuracy) * p.threshold * juce::jlimit (0.0, 1.0, p.mix);
+    }
+
+    /** allowance is taken off the difference first. An approximated output isn't expected to be
+        within a few ulps, so then only the error is checked.
+    */
+    template <typename T>
+    void compare (Result& result, T input, T actual, double expected, double magnitude, double allowance = 0.0)
+    {
+        auto epsilon = (double) std::numeric_limits<T>::epsilon();
+        auto difference = std::abs ((double) actual - expected) - allowance;
+
+        // written so that NaN gets through
+        if (difference < 0.0)
+            difference = 0.0;
+
+        // Below the normal range values are denorm_min apart, however small the magnitude
+        auto resolution = juce::jmax (magnitude * epsilon, (double) std::numeric_limits<T>::denorm_min());
+        auto error = difference == 0.0 ? 0.0 : difference / resolution;
+        auto ulps = allowance == 0.0 && std::abs (expected) >= 0.25 * magnitude ? ulpDistance (actual, (T) expected) : 0;
+
+        if (std::isnan (error))
+            error = std::numeric_limits<double>::infinity();
+
+        ++result.numChecked;
+        result.maxError = juce::jmax (result.maxError, error);
+        result.maxUlps = juce::jmax (result.maxUlps, ulps);
+
+        if (error <= errorLimit && ulps <= ulpLimit)
+            return;
+
+        if (result.numFailed++ == 0)
+            result.firstFailure = "x = " + juce::String ((double) input, 9, true) + " gave " + juce::String ((double) actual, 9, true)
+                                    + ", expected " + juce::String (expected, 9, true);
+    }
+
+    /** Checks one output against the reference curve. Non-finite inputs are only there to show
+        they don't reach their neighbours, and inputs at a jump may round to either side of it.
+    */
+    template <typename T>
+    void checkSample (Result& result, int type, int accuracy, T input, T actual, const Params& p)
+    {
+        auto epsilon = (double) std::numeric_limits<T>::epsilon();
+
+        if (! std::isfinite (input) || ReferenceCurves::isNearJump (type, input, p, jumpDistance * epsilon))
+        {
+            ++result.numSkipped;
+            return;
+        }
+
+        compare (result, input, actual, ReferenceCurves::process (type, input, p), ReferenceCurves::getMagnitude (type, input, p),
+                 getAllowance (type, accuracy, p));
+    }
+
+    //==============================================================================
+    /** A sweep across and beyond the tables' range, random magnitudes from denormal to 1e30,
+        values either side of the threshold and the range, and NaN and Inf scattered through.
+    */
+    template <typename T>
+    std::vector<T> makeInputs (const BlockParams& p)
+    {
+        std::vector<T> inputs;
+
+        for (int i = 0; i <= 2048; ++i)
+            inputs.push_back ((T) (-6.0 + 12.0 * i / 2048.0));
+
+        juce::Random random (5678);
+
+        for (int i = 0; i < 1024; ++i)
+        {
+            auto magnitude = (T) std::pow (10.0, -45.0 + 75.0 * random.nextDouble());
+            inputs.push_back (random.nextBool() ? magnitude : -magnitude);
+        }
+
+        auto atThreshold = (double) p.threshold / (double) p.preGain;
+
+        for (auto edge : { 0.0, 1.0, atThreshold, (double) TransferTable::inputRange, 1.0e30 })
+        {
+            for (auto value : { (T) edge, (T) -edge })
+            {
+                inputs.push_back (value);
+                inputs.push_back (std::nextafter (value, (T) 0));
+                inputs.push_back (std::nextafter (value, std::numeric_limits<T>::infinity()));
+            }
+        }
+
+        for (auto value : { std::numeric_limits<T>::denorm_min(), std::numeric_limits<T>::min() })
+        {
+            inputs.push_back (value);
+            inputs.push_back (-value);
+        }
+
+        const T nonFinite[] = { std::numeric_limits<T>::quiet_NaN(), std::numeric_limits<T>::infinity(), -std::numeric_limits<T>::infinity() };
+
+        for (size_t i = 30; i < inputs.size(); i += 61)
+            inputs[i] = nonFinite[(i / 61) % 3];
+
+        return inputs;
+    }
+
+    /** Calls process (in, out, numSamples, offset) over the input in chunks of every length in chunkLengths. */
+    template <typename T, typename Process>
+    std::vector<T> runInChunks (const std::vector<T>& inputs, Process&& process)
+    {
+        std::vector<T> outputs (inputs.size());
+        auto total = (int) inputs.size();
+
+        for (int offset = 0, chunk = 0; offset < total; ++chunk)
+        {
+            auto numSamples = juce::jmin (chunkLengths[(size_t) chunk % std::size (chunkLengths)], total - offset);
+            process (inputs.data() + offset, outputs.data() + offset, numSamples, offset);
+            offset += numSamples;
+        }
+
+        return outputs;
+    }
+
+    template <typename Function>
+    void forEachSetting (Function&& function)
+    {
+        for (auto gainDb : gainValues)
+            for (auto thresholdDb : thresholdValues)
+                for (auto mix : mixValues)
+                    function (makeParams (gainDb, thresholdDb, mix));
+    }
+
+    //==============================================================================
+    template <typename T>
+    void checkDirect (int type, int accuracy, Result& steady, Result& ramped)
+    {
+        auto kernel = WaveshaperKernels::getKernel<T> (type, accuracy);
+
+        forEachSetting ([&] (const BlockParams& block)
+        {
+            auto inputs = makeInputs<T> (block);
+            auto params = Params::fromBlock (block);
+            auto outputs = runInChunks (inputs, [&] (const T* in, T* out, int numSamples, int)
+            {
+                kernel (in, out, numSamples, block, nullptr);
+            });
+
+            for (size_t i = 0; i < inputs.size(); ++i)
+                checkSample (steady, type, accuracy, inputs[i], outputs[i], params);
+
+            // The same input while every parameter glides from the block's values to the middle of its range
+            auto numSamples = inputs.size();
+            std::vector<T> preGain (numSamples), gainDb (numSamples), threshold (numSamples), mix (numSamples);
+
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                auto position = (float) i / (float) numSamples;
+                auto thresholdDb = 20.0f * std::log10 (block.threshold);
+                auto p = makeParams (block.gainDb + position * (-17.0f - block.gainDb),
+                                     thresholdDb + position * (-12.0f - thresholdDb),
+                                     block.mix + position * (0.5f - block.mix));
+                preGain[i] = (T) p.preGain;
+                gainDb[i] = (T) p.gainDb;
+                threshold[i] = (T) p.threshold;
+                mix[i] = (T) p.mix;
+            }
+
+            outputs = runInChunks (inputs, [&] (const T* in, T* out, int length, int offset)
+            {
+                ParamRamps<T> ramps { preGain.data() + offset, gainDb.data() + offset, threshold.data() + offset, mix.data() + offset };
+                kernel (in, out, length, block, &ramps);
+            });
+
+            // The ramped kernels always blend, so fully dry and fully wet are blended here too
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                Params p { (double) preGain[i], (double) gainDb[i], (double) threshold[i], (double) mix[i] };
+                auto blend = [&] (double x) { return x * (1.0 - p.mix) + ReferenceCurves::shape (type, x, p) * p.mix; };
+
+                if (! std::isfinite (inputs[i]) || ReferenceCurves::isNearJump (type, inputs[i], p, jumpDistance * std::numeric_limits<T>::epsilon()))
+                    ++ramped.numSkipped;
+                else
+                    compare (ramped, inputs[i], outputs[i], blend (inputs[i]), ReferenceCurves::getMagnitude (type, inputs[i], p),
+                             getAllowance (type, accuracy, p));
+            }
+        });
+    }
+
+    //==============================================================================
+    /** TransferTableKernels::lookUp in double, from the table's double values. magnitude is set to
+        the size of the values involved, including how far a rounded table position can move the result.
+    */
+    double lookUpReference (const TransferTable& table, double x, int interpolation, double& magnitude)
+    {
+        const auto* values = table.getValues<double>();
+        auto position = (x + TransferTable::inputRange) * (double) table.getScale() + 1.0;
+        auto index = std::floor (position);
+        auto frac = position - index;
+        auto i = (size_t) index;
+
+        auto p0 = values[i - 1], p1 = values[i], p2 = values[i + 1], p3 = values[i + 2];
+        auto steepest = juce::jmax (std::abs (p1 - p0), std::abs (p2 - p1), std::abs (p3 - p2));
+        magnitude = std::abs (p0) + std::abs (p1) + std::abs (p2) + std::abs (p3) + position * steepest;
+
+        if (interpolation == TransferTable::linear)
+            return p1 + frac * (p2 - p1);
+
+        auto c1 = 0.5 * (p2 - p0);
+        auto c2 = p0 - 2.5 * p1 + 2.0 * p2 - 0.5 * p3;
+        auto c3 = 0.5 * (p3 - p0) + 1.5 * (p1 - p2);
+        return p1 + frac * (c1 + frac * (c2 + frac * c3));
+    }
+
+    /** How far an interpolated table may be from the curve itself at x, from the curve's values at
+        the table points around it. Interpolation is out by about a second difference of them, where
+        a table built or sampled wrongly is out by a first difference. Rounding of the table position
+        in the sample type moves the result along the steepest first difference.
+    */
+    template <typename T>
+    double getTableAllowance (const TransferTable& table, int type, double x, const Params& p)
+    {
+        auto step = 1.0 / (double) table.getScale();
+        auto position = (x + TransferTable::inputRange) / step + 1.0;
+        auto index = std::floor (position);
+
+        double y[4];
+
+        for (int k = 0; k < 4; ++k)
+            y[k] = ReferenceCurves::shape (type, -TransferTable::inputRange + (index - 2.0 + k) * step, p);
+
+        auto secondDifference = juce::jmax (std::abs (y[0] - 2.0 * y[1] + y[2]), std::abs (y[1] - 2.0 * y[2] + y[3]));
+        auto steepest = juce::jmax (std::abs (y[1] - y[0]), std::abs (y[2] - y[1]), std::abs (y[3] - y[2]));
+        auto mix = juce::jlimit (0.0, 1.0, p.mix);
+
+        return (secondDifference + position * (double) std::numeric_limits<T>::epsilon() * steepest) * mix
+                 + getAllowance (type, CurveApproximations::precise, p);
+    }
+
+    /** arithmetic compares the kernel with the same interpolation in double, accuracy with the curve itself. */
+    template <typename T>
+    void checkTable (int type, int interpolation, Result& arithmetic, Result& accuracy)
+    {
+        auto kernel = TransferTableKernels::getKernel<T> (type, interpolation);
+        TransferTable table;
+
+        forEachSetting ([&] (const BlockParams& block)
+        {
+            for (auto size : { 1024, 65536 })
+            {
+                TableSpec spec;
+                spec.type = type;
+                spec.gainDb = block.gainDb;
+                spec.threshold = block.threshold;
+                spec.size = size;
+                table.build (spec);
+
+                auto inputs = makeInputs<T> (block);
+                auto params = Params::fromBlock (block);
+                auto outputs = runInChunks (inputs, [&] (const T* in, T* out, int numSamples, int)
+                {
+                    kernel (table, in, out, numSamples, block, nullptr);
+                });
+
+                // Inside the range the table is the reference, outside it the exact curve takes over
+                for (size_t i = 0; i < inputs.size(); ++i)
+                {
+                    auto x = (double) inputs[i];
+
+                    // outside the range the curves run at the precise tier, the one the tables are built with
+                    if (! (std::abs (x) <= TransferTable::inputRange))
+                    {
+                        checkSample (arithmetic, type, CurveApproximations::precise, inputs[i], outputs[i], params);
+                        continue;
+                    }
+
+                    // Linear interpolation reads the points either side of x, cubic one more on each side
+                    auto support = (interpolation == TransferTable::cubic ? 2.0 : 1.0) / (double) table.getScale();
+
+                    if (ReferenceCurves::isNearFold (type, x, params, support))
+                        ++accuracy.numSkipped;
+                    else
+                        compare (accuracy, inputs[i], outputs[i], ReferenceCurves::process (type, x, params),
+                                 ReferenceCurves::getMagnitude (type, x, params), getTableAllowance<T> (table, type, x, params));
+
+                    double magnitude;
+                    auto shaped = lookUpReference (table, x, interpolation, magnitude);
+                    auto mix = params.mix;
+
+                    if (mix <= 0.0)
+                        compare (arithmetic, inputs[i], outputs[i], x, std::abs (x) + 1.0);
+                    else if (mix >= 1.0)
+                        compare (arithmetic, inputs[i], outputs[i], shaped, magnitude);
+                    else
+                        compare (arithmetic, inputs[i], outputs[i], x * (1.0 - mix) + shaped * mix, std::abs (x) * (1.0 - mix) + magnitude * mix);
+                }
+            }
+        });
+    }
+
+    //==============================================================================
+    /** With a steady input the divided differences collapse and ADAA must give the curve's own value. */
+    template <typename T>
+    void checkAntialiasing (int type, int order, Result& result)
+    {
+        auto kernel = ADAAKernels::getKernel<T> (type, order);
+        ADAAKernels::Scratch scratch;
+        scratch.prepare (16);
+
+        forEachSetting ([&] (const BlockParams& block)
+        {
+            auto params = Params::fromBlock (block);
+
+            for (auto x : makeInputs<T> (block))
+            {
+                ADAAKernels::ChannelState state { (double) x, (double) x };
+                T in[4] = { x, x, x, x }, out[4];
+                kernel (state, scratch, in, out, 4, block, nullptr);
+
+                for (auto y : out)
+                    checkSample (result, type, CurveApproximations::precise, x, y, params);
+            }
+        });
+    }
+
+    //==============================================================================
+    /** A stereo input through MultibandDistortion with every band fully dry, in blocks of 512. */
+    template <typename T>
+    std::vector<T> sumBands (int numBands, const float* crossovers, double sampleRate, const std::vector<double>& input)
+    {
+        MultibandDistortion<T> multiband;
+        multiband.prepare (2);
+        multiband.setCrossovers (numBands, crossovers, sampleRate, true);
+
+        for (int band = 0; band < MultibandDesign::maxBands; ++band)
+            multiband.setBand (band, WaveshaperKernels::softClip, makeParams (0.0f, 0.0f, 0.0f));
+
+        std::vector<T> left (input.begin(), input.end()), right (left);
+        T* channels[] = { left.data(), right.data() };
+
+        for (int start = 0; start < (int) input.size(); start += 512)
+            multiband.process (channels, 2, start, juce::jmin (512, (int) input.size() - start));
+
+        return left;
+    }
+
+    //==============================================================================
+    template <typename T>
+    void checkPrecision (const char* precision, int& numFailed)
+    {
+        auto report = [&] (const char* kernel, const juce::String& name, const Result& result)
+        {
+            std::cout << juce::String (kernel).paddedRight (' ', 15)
+                      << juce::String (precision).paddedRight (' ', 11)
+                      << name.paddedRight (' ', 18)
+                      << juce::String (result.numChecked).paddedRight (' ', 10)
+                      << juce::String (result.numSkipped).paddedRight (' ', 10)
+                      << juce::String (result.maxError, 2).paddedRight (' ', 12)
+                      << juce::String (result.maxUlps).paddedRight (' ', 10)
+                      << (result.numFailed == 0 ? "ok" : "FAILED") << std::endl;
+
+            if (result.numFailed > 0)
+            {
+                std::cout << "    " << result.numFailed << " failures, first: " << result.firstFailure << std::endl;
+                ++numFailed;
+            }
+        };
+
+        for (int type = WaveshaperKernels::softClip; type <= WaveshaperKernels::lastType; ++type)
+        {
+            // The saturation curves have a direct kernel per accuracy tier, the rest just the one
+            auto approximated = WaveshaperKernels::getMaxError (type, CurveApproximations::fast) > 0.0;
+            auto firstAccuracy = approximated ? (int) CurveApproximations::fast : (int) CurveApproximations::precise;
+
+            for (int accuracy = firstAccuracy; accuracy < CurveApproximations::numAccuracies; ++accuracy)
+            {
+                Result steady, ramped;
+                checkDirect<T> (type, accuracy, steady, ramped);
+
+                auto name = juce::String (typeNames[type]) + (approximated ? " " + juce::String (accuracyNames[accuracy]) : juce::String());
+                report ("direct", name, steady);
+                report ("direct ramped", name, ramped);
+            }
+
+            Result linear, cubic, linearAccuracy, cubicAccuracy;
+            checkTable<T> (type, TransferTable::linear, linear, linearAccuracy);
+            checkTable<T> (type, TransferTable::cubic, cubic, cubicAccuracy);
+            report ("table linear", typeNames[type], linear);
+            report ("table cubic", typeNames[type], cubic);
+            report ("table accuracy", juce::String (typeNames[type]) + " linear", linearAccuracy);
+            report ("table accuracy", juce::String (typeNames[type]) + " cubic", cubicAccuracy);
+
+            // and only the original four have antialiasing
+            if (ADAAKernels::getKernel<T> (type, 1) == nullptr)
+                continue;
+
+            Result firstOrder, secondOrder;
+            checkAntialiasing<T> (type, 1, firstOrder);
+            checkAntialiasing<T> (type, 2, secondOrder);
+            report ("adaa 1st", typeNames[type], firstOrder);
+            report ("adaa 2nd", typeNames[type], secondOrder);
+        }
+    }
+}
+
+//==============================================================================
+int checkKernels()
+{
+    int numFailed = 0;
+    std::cout << "kernel         precision  type              checked   skipped   max error   max ulps" << std::endl;
+
+    checkPrecision<float> ("float", numFailed);
+    checkPrecision<double> ("double", numFailed);
+    return numFailed;
+}
+
+int checkBandSums()
+{
+    // The lower a crossover against the rate, the closer its poles are to 1 and the more bits float
+    // coefficients would lose. The sine sits a quarter of the way up to the lowest crossover.
+    constexpr double sampleRate = 48000.0 * 16;
+    constexpr double errorLimitDb = -120.0;
+    int numFailed = 0;
+
+    std::cout << std::endl << "band sum       crossovers (Hz)         error vs double (dB)" << std::endl;
+
+    for (auto lowest : { 20.0f, 200.0f })
+    {
+        for (int numBands : { 2, 4 })
+        {
+            const float crossovers[] = { lowest, 1000.0f, 5000.0f };
+            std::vector<double> input ((size_t) sampleRate);
+
+            for (size_t i = 0; i < input.size(); ++i)
+                input[i] = 0.5 * std::sin (juce::MathConstants<double>::twoPi * lowest * 0.25 * (double) i / sampleRate);
+
+            auto single = sumBands<float> (numBands, crossovers, sampleRate, input);
+            auto reference = sumBands<double> (numBands, crossovers, sampleRate, input);
+
+            // the second half, once the filters have settled
+            double error = 0.0, signal = 0.0;
+
+            for (auto i = input.size() / 2; i < input.size(); ++i)
+            {
+                error += juce::square ((double) single[i] - reference[i]);
+                signal += juce::square (reference[i]);
+            }
+
+            auto errorDb = 10.0 * std::log10 (juce::jmax (error, 1.0e-300) / signal);
+            auto failed = ! (errorDb <= errorLimitDb);
+            numFailed += failed ? 1 : 0;
+
+            juce::String name;
+
+            for (int k = 0; k < numBands - 1; ++k)
+                name << (k > 0 ? ", " : "") << juce::String (crossovers[k]);
+
+            std::cout << (juce::String (numBands) + " bands, 16x").paddedRight (' ', 15) << name.paddedRight (' ', 24)
+                      << juce::String (errorDb, 1).paddedRight (' ', 21) << (failed ? "FAILED" : "ok") << std::endl;
+        }
+    }
+
+    return numFailed;
+}
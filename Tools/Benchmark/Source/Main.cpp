@@ -0,0 +1,326 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    ezbench: times EZDistortionAudioProcessor::processBlock on synthetic
+    buffers. Every TYPE is run at each block size, channel layout,
+    automation mode and kind of input. Results are printed as a table, and
+    can also be written as JSON to diff two builds against each other.
+    --check runs the conformance checks in Conformance.h instead, and
+    --scaling the multi-instance run in Scaling.h.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <iostream>
+#include "PluginProcessor.h"
+#include "Conformance.h"
+#include "Scaling.h"
+
+namespace
+{
+    struct Case
+    {
+        int type, blockSize, numChannels;
+        bool automated, denormals;
+    };
+
+    struct Timing
+    {
+        double nsPerSample, realtimeFactor;
+    };
+
+    struct Options
+    {
+        double sampleRate = 48000.0;
+        double seconds = 2.0;               // audio rendered per repeat
+        int repeats = 3;                    // the fastest repeat is reported
+        juce::StringPairArray parameters;   // fixed for every case, e.g. OVERSAMPLING
+        juce::File jsonFile;
+        bool check = false;
+
+        bool scaling = false;
+        ScalingOptions scalingOptions;      // the counts and block size, the rest is copied in
+    };
+
+    /** Parses a comma-separated list of positive counts, e.g. 1,8,64. */
+    juce::Array<int> parseCounts (const juce::String& text)
+    {
+        juce::Array<int> counts;
+
+        for (auto& token : juce::StringArray::fromTokens (text, ",", {}))
+            if (token.getIntValue() > 0)
+                counts.add (token.getIntValue());
+
+        return counts;
+    }
+
+    void fillInput (juce::AudioBuffer<float>& buffer, bool denormals, juce::Random& random)
+    {
+        // Denormal input sits just below FLT_MIN, normal input is noise at about -6 dBFS
+        auto scale = denormals ? 1.0e-39f : 0.5f;
+
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample (channel, i, (random.nextFloat() * 2.0f - 1.0f) * scale);
+    }
+
+    void setParameter (EZDistortionAudioProcessor& processor, const juce::String& id, float value)
+    {
+        if (auto* parameter = processor.apvts.getParameter (id))
+            parameter->setValueNotifyingHost (parameter->convertTo0to1 (value));
+    }
+
+    /** Moves MIX, GAIN and THRESHOLD every block, like a host playing back automation,
+        and each band's GAIN for runs with BANDS set.
+    */
+    void automate (EZDistortionAudioProcessor& processor, double phase)
+    {
+        auto lfo = (float) std::sin (juce::MathConstants<double>::twoPi * phase);
+        setParameter (processor, "MIX", 0.5f + 0.4f * lfo);
+        setParameter (processor, "GAIN", -17.0f + 12.0f * lfo);
+        setParameter (processor, "THRESHOLD", -6.0f - 6.0f * lfo);
+
+        for (int band = 1; band <= 4; ++band)
+            setParameter (processor, "BAND" + juce::String (band) + "_GAIN", -17.0f + 12.0f * lfo);
+    }
+
+    /** Returns false when the processor doesn't support the channel count. */
+    bool run (const Case& c, const Options& options, Timing& timing)
+    {
+        EZDistortionAudioProcessor processor;
+
+        // Times the settings asked for, unless --set turns the governor back on
+        setParameter (processor, "GOVERNOR", 0.0f);
+
+        auto& keys = options.parameters.getAllKeys();
+        for (int i = 0; i < keys.size(); ++i)
+            if (auto* parameter = processor.apvts.getParameter (keys[i]))
+                parameter->setValueNotifyingHost (parameter->getValueForText (options.parameters.getAllValues()[i]));
+
+        setParameter (processor, "TYPE", (float) c.type);
+
+        auto channelSet = juce::AudioChannelSet::canonicalChannelSet (c.numChannels);
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add (channelSet);
+        layout.outputBuses.add (channelSet);
+
+        if (! processor.setBusesLayout (layout))
+            return false;
+
+        processor.prepareToPlay (options.sampleRate, c.blockSize);
+
+        // A few different input blocks, so the timing isn't of one cached block
+        juce::Random random (1234);
+        juce::OwnedArray<juce::AudioBuffer<float>> inputs;
+
+        for (int i = 0; i < 8; ++i)
+            fillInput (*inputs.add (new juce::AudioBuffer<float> (c.numChannels, c.blockSize)), c.denormals, random);
+
+        juce::AudioBuffer<float> buffer (c.numChannels, c.blockSize);
+        juce::MidiBuffer midi;
+        auto numBlocks = juce::jmax (1, (int) (options.seconds * options.sampleRate / c.blockSize));
+        auto blocksPerSecond = options.sampleRate / c.blockSize;
+        auto best = std::numeric_limits<double>::max();
+
+        // The first pass only warms up the caches and branch predictors
+        for (int repeat = 0; repeat <= options.repeats; ++repeat)
+        {
+            double total = 0.0;
+
+            for (int block = 0; block < numBlocks; ++block)
+            {
+                if (c.automated)
+                    automate (processor, block / blocksPerSecond);
+
+                buffer.makeCopyOf (*inputs[block % inputs.size()], true);
+
+                auto start = juce::Time::getHighResolutionTicks();
+                processor.processBlock (buffer, midi);
+                total += juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start);
+            }
+
+            if (repeat > 0)
+                best = juce::jmin (best, total);
+        }
+
+        processor.releaseResources();
+
+        auto numSamples = (double) numBlocks * c.blockSize;
+        timing.nsPerSample = best * 1.0e9 / numSamples;
+        timing.realtimeFactor = (numSamples / options.sampleRate) / best;
+        return true;
+    }
+
+    juce::var toJson (const Case& c, const Timing& timing)
+    {
+        auto* result = new juce::DynamicObject();
+        result->setProperty ("type", c.type);
+        result->setProperty ("blockSize", c.blockSize);
+        result->setProperty ("channels", c.numChannels);
+        result->setProperty ("automated", c.automated);
+        result->setProperty ("input", c.denormals ? "denormal" : "noise");
+        result->setProperty ("nsPerSample", timing.nsPerSample);
+        result->setProperty ("realtimeFactor", timing.realtimeFactor);
+        return result;
+    }
+
+    /** Every TYPE at each block size, channel layout, automation mode and kind of input. */
+    juce::Array<juce::var> runCases (const Options& options)
+    {
+        juce::Array<juce::var> results;
+        std::cout << "type  block  channels  automated  input        ns/sample   realtime x" << std::endl;
+
+        for (int type = 1; type <= WaveshaperKernels::lastType; ++type)
+            for (int blockSize = 16; blockSize <= 4096; blockSize *= 2)
+                for (int numChannels : { 1, 2, 8, 16 })
+                    for (bool automated : { false, true })
+                        for (bool denormals : { false, true })
+                        {
+                            Case c { type, blockSize, numChannels, automated, denormals };
+                            Timing timing;
+
+                            if (! run (c, options, timing))
+                                continue;
+
+                            results.add (toJson (c, timing));
+                            std::cout << juce::String (type).paddedRight (' ', 6)
+                                      << juce::String (blockSize).paddedRight (' ', 7)
+                                      << juce::String (numChannels).paddedRight (' ', 10)
+                                      << juce::String (automated ? "yes" : "no").paddedRight (' ', 11)
+                                      << juce::String (denormals ? "denormal" : "noise").paddedRight (' ', 13)
+                                      << juce::String (timing.nsPerSample, 3).paddedRight (' ', 12)
+                                      << juce::String (timing.realtimeFactor, 1) << std::endl;
+                        }
+
+        return results;
+    }
+
+    void printUsage()
+    {
+        std::cout << "Usage: ezbench [options]\n"
+                     "\n"
+                     "  -p, --set <ID=value>     Fixes a parameter for every case, e.g. OVERSAMPLING=4x. Repeatable\n"
+                     "      --seconds <s>        Audio rendered per repeat (default: 2)\n"
+                     "      --repeats <n>        Timed repeats, the fastest is reported (default: 3)\n"
+                     "      --sample-rate <hz>   (default: 48000)\n"
+                     "      --json <file>        Also writes the results as JSON\n"
+                     "      --check              Checks the kernels against the reference curves and processBlock\n"
+                     "                           for allocations and NaN, instead of timing anything\n"
+                     "      --scaling            Times many stereo instances processed by a pool of threads instead\n"
+                     "      --instances <list>   Instance counts for --scaling (default: 1,8,64,256)\n"
+                     "      --threads <list>     Thread counts for --scaling (default: powers of two up to the cores)\n"
+                     "      --block-size <n>     Block size for --scaling (default: 128)\n"
+                     "  -h, --help\n";
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        juce::String arg (juce::CharPointer_UTF8 (argv[i]));
+
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+
+        if (arg == "--check")
+        {
+            options.check = true;
+            continue;
+        }
+
+        if (arg == "--scaling")
+        {
+            options.scaling = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            std::cerr << "ezbench: missing value for " << arg << std::endl;
+            return 1;
+        }
+
+        juce::String value (juce::CharPointer_UTF8 (argv[++i]));
+
+        if (arg == "-p" || arg == "--set")  options.parameters.set (value.upToFirstOccurrenceOf ("=", false, false),
+                                                                    value.fromFirstOccurrenceOf ("=", false, false));
+        else if (arg == "--seconds")        options.seconds = value.getDoubleValue();
+        else if (arg == "--repeats")        options.repeats = juce::jmax (1, value.getIntValue());
+        else if (arg == "--sample-rate")    options.sampleRate = value.getDoubleValue();
+        else if (arg == "--json")           options.jsonFile = juce::File::getCurrentWorkingDirectory().getChildFile (value);
+        else if (arg == "--instances")      options.scalingOptions.instanceCounts = parseCounts (value);
+        else if (arg == "--threads")        options.scalingOptions.threadCounts = parseCounts (value);
+        else if (arg == "--block-size")     options.scalingOptions.blockSize = juce::jmax (1, value.getIntValue());
+        else
+        {
+            std::cerr << "ezbench: unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (options.seconds <= 0.0 || options.sampleRate <= 0.0)
+    {
+        std::cerr << "ezbench: seconds and sample rate must be positive" << std::endl;
+        return 1;
+    }
+
+    if (options.check)
+    {
+        auto numFailed = checkKernels() + checkBandSums() + checkProcessBlock();
+        std::cout << std::endl << (numFailed == 0 ? juce::String ("All checks passed") : juce::String (numFailed) + " checks failed") << std::endl;
+        return numFailed == 0 ? 0 : 1;
+    }
+
+    juce::Array<juce::var> results;
+
+    if (options.scaling)
+    {
+        auto scaling = options.scalingOptions;
+        scaling.sampleRate = options.sampleRate;
+        scaling.seconds = options.seconds;
+        scaling.parameters = options.parameters;
+        results = runScaling (scaling);
+    }
+    else
+    {
+        results = runCases (options);
+    }
+
+    if (options.jsonFile != juce::File())
+    {
+        auto* build = new juce::DynamicObject();
+        build->setProperty ("juce", juce::SystemStats::getJUCEVersion());
+        build->setProperty ("cpu", juce::SystemStats::getCpuModel());
+        build->setProperty ("compiled", juce::String (__DATE__) + " " + __TIME__);
+        build->setProperty ("floatLanes", NativeVec<float>::Type::size);
+
+        auto* parameters = new juce::DynamicObject();
+        for (auto& key : options.parameters.getAllKeys())
+            parameters->setProperty (key, options.parameters[key]);
+
+        auto* root = new juce::DynamicObject();
+        root->setProperty ("build", build);
+        root->setProperty ("sampleRate", options.sampleRate);
+        root->setProperty ("mode", options.scaling ? "scaling" : "cases");
+        root->setProperty ("parameters", parameters);
+        root->setProperty ("results", results);
+
+        if (! options.jsonFile.replaceWithText (juce::JSON::toString (juce::var (root))))
+        {
+            std::cerr << "ezbench: can't write " << options.jsonFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
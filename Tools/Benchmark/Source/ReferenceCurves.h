@@ -0,0 +1,193 @@
+/*
+  ==============================================================================
+
+    ReferenceCurves.h
+    Plain scalar double-precision versions of the curves, written the way
+    the original processBlock() and foldback() computed them, with no
+    vectors, tables or shortcuts. The saturation curves use libm's tanh, atan
+    and exp. The fast paths are checked against these.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cmath>
+#include "WaveshaperKernels.h"
+
+namespace ReferenceCurves
+{
+    /** The block or ramp values a kernel was given, widened to double. */
+    struct Params
+    {
+        double preGain, gainDb, threshold, mix;
+
+        static Params fromBlock (const WaveshaperKernels::BlockParams& p) noexcept
+        {
+            return { p.preGain, p.gainDb, p.threshold, p.mix };
+        }
+    };
+
+    /** One sample of a curve, without the blend. */
+    inline double shape (int type, double x, const Params& p) noexcept
+    {
+        auto g = x * p.preGain;
+        auto t = p.threshold;
+
+        switch (type)
+        {
+            case WaveshaperKernels::softClip:
+                if (std::abs (g) < t)
+                    return g - (g * g * g) / 3.0;
+
+                return g < 0.0 ? -2.0 / 3.0 : 2.0 / 3.0;
+
+            case WaveshaperKernels::hardClip:
+                if (g <= -t)
+                    return -1.0;
+
+                return g >= t ? 1.0 : g;
+
+            case WaveshaperKernels::foldback:
+                if (g > t || g < -t)
+                    return std::abs (std::abs (std::fmod (g - t, t * 4.0)) - t * 2.0) - t;
+
+                return g;
+
+            case WaveshaperKernels::scoopFold:
+            {
+                auto foldThreshold = t * 10.0;
+                auto foldRatio = 1.0 / foldThreshold;
+                auto scaled = foldRatio * (x * p.gainDb * foldThreshold) + foldRatio;
+                return foldRatio * std::abs (scaled - std::round (scaled) - 0.25);
+            }
+
+            case WaveshaperKernels::tanhClip:
+                return t * std::tanh (g / t);
+
+            case WaveshaperKernels::arctanClip:
+            {
+                constexpr double pi = 3.14159265358979324;
+                return t * 2.0 / pi * std::atan (pi / 2.0 * g / t);
+            }
+
+            case WaveshaperKernels::tube:
+            {
+                auto bias = (double) WaveshaperKernels::Tube<CurveApproximations::precise>::bias;
+                return t * (std::tanh (g / t + bias) - std::tanh (bias)) / (1.0 - std::tanh (bias) * std::tanh (bias));
+            }
+
+            case WaveshaperKernels::diode:
+                return g < 0.0 ? -0.5 * t * -std::expm1 (2.0 * g / t) : t * -std::expm1 (-g / t);
+
+            default:
+                return 0.0;
+        }
+    }
+
+    /** The curve plus the dry/wet blend. Fully dry and fully wet skip the blend, as the kernels do. */
+    inline double process (int type, double x, const Params& p) noexcept
+    {
+        if (p.mix <= 0.0)
+            return x;
+
+        if (p.mix >= 1.0)
+            return shape (type, x, p);
+
+        return x * (1.0 - p.mix) + shape (type, x, p) * p.mix;
+    }
+
+    /** Size of the values a curve goes through on the way to its output. A fast path's rounding
+        error grows with it, e.g. with foldback's fmod of a large input, so tolerances are scaled by it.
+    */
+    inline double getMagnitude (int type, double x, const Params& p) noexcept
+    {
+        auto g = std::abs (x * p.preGain);
+        double curve = 1.0;
+
+        switch (type)
+        {
+            case WaveshaperKernels::softClip:   curve = 1.0 + std::pow (std::min (g, p.threshold), 3.0); break;
+            case WaveshaperKernels::hardClip:   curve = 1.0 + std::min (g, p.threshold); break;
+            case WaveshaperKernels::foldback:   curve = 1.0 + g; break;
+            case WaveshaperKernels::scoopFold:
+            {
+                auto foldRatio = 1.0 / (p.threshold * 10.0);
+                curve = foldRatio * (1.0 + foldRatio + std::abs (x * p.gainDb));
+                break;
+            }
+            case WaveshaperKernels::tanhClip:
+            case WaveshaperKernels::arctanClip:
+            case WaveshaperKernels::tube:
+            case WaveshaperKernels::diode:      curve = 1.0 + 2.0 * p.threshold; break;
+            default: break;
+        }
+
+        auto dry = p.mix >= 1.0 ? 0.0 : std::abs (x) * (1.0 - std::max (0.0, p.mix));
+        return dry + curve * std::max (0.0, std::min (1.0, p.mix));
+    }
+
+    /** True where the curve jumps within a relative distance of x. The clippers jump at the
+        threshold and ScoopFold wherever its fold wraps, and a fast path that rounds its way to
+        the other side of a jump is still correct.
+    */
+    inline bool isNearJump (int type, double x, const Params& p, double relativeDistance) noexcept
+    {
+        auto g = x * p.preGain;
+
+        switch (type)
+        {
+            case WaveshaperKernels::softClip:
+            case WaveshaperKernels::hardClip:
+                return std::abs (std::abs (g) - p.threshold) <= relativeDistance * (std::abs (g) + p.threshold);
+
+            case WaveshaperKernels::scoopFold:
+            {
+                auto foldThreshold = p.threshold * 10.0;
+                auto foldRatio = 1.0 / foldThreshold;
+                auto scaled = foldRatio * (x * p.gainDb * foldThreshold) + foldRatio;
+                auto fraction = scaled - std::floor (scaled);
+                return std::abs (fraction - 0.5) <= relativeDistance * (1.0 + foldRatio + std::abs (scaled));
+            }
+
+            default:
+                return false;
+        }
+    }
+
+    /** True where the curve jumps or folds back within distance of x, in units of the input: the
+        clippers' thresholds, foldback's folds and ScoopFold's wraps. An interpolated table only has
+        values either side of such a point, and isn't expected to follow the curve there.
+    */
+    inline bool isNearFold (int type, double x, const Params& p, double distance) noexcept
+    {
+        auto g = x * p.preGain;
+        auto gainDistance = distance * std::abs (p.preGain);
+
+        switch (type)
+        {
+            case WaveshaperKernels::softClip:
+            case WaveshaperKernels::hardClip:
+                return std::abs (std::abs (g) - p.threshold) <= gainDistance;
+
+            case WaveshaperKernels::foldback:
+            {
+                // folds at odd multiples of the threshold
+                auto folds = (g + p.threshold) / (2.0 * p.threshold);
+                return std::abs (g) >= p.threshold - gainDistance && std::abs (folds - std::round (folds)) <= gainDistance / (2.0 * p.threshold);
+            }
+
+            case WaveshaperKernels::scoopFold:
+            {
+                // scaled moves by gainDb per unit of input, and wraps where its fraction passes 0.5
+                auto foldThreshold = p.threshold * 10.0;
+                auto foldRatio = 1.0 / foldThreshold;
+                auto scaled = foldRatio * (x * p.gainDb * foldThreshold) + foldRatio;
+                return std::abs (scaled - std::floor (scaled) - 0.5) <= distance * std::abs (p.gainDb);
+            }
+
+            default:
+                return false;
+        }
+    }
+}
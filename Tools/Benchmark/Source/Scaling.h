@@ -0,0 +1,29 @@
+/*
+  ==============================================================================
+
+    Scaling.h
+    ezbench --scaling: many instances driven from a pool of threads, the way
+    a host runs a large session in parallel. Shows how throughput, memory and
+    cache misses change as instances and threads are added.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+struct ScalingOptions
+{
+    double sampleRate = 48000.0;
+    double seconds = 2.0;               // audio rendered per run
+    int blockSize = 128;
+    juce::StringPairArray parameters;   // applied to every instance
+    juce::Array<int> instanceCounts { 1, 8, 64, 256 };
+    juce::Array<int> threadCounts;      // empty for 1, 2, 4... up to the number of cores
+};
+
+/** Runs every combination of instance and thread count, printing a line for each,
+    and returns the results for the JSON output.
+*/
+juce::Array<juce::var> runScaling (const ScalingOptions& options);
@@ -0,0 +1,367 @@
+/*
+  ==============================================================================
+
+    ScalingBenchmark.cpp
+    ezbench --scaling. Each cycle the calling thread and numThreads - 1
+    helpers take instances off a shared counter and process one block of
+    each, until all have been done, as a host's graph does for nodes with
+    no dependencies between them. Cycles are timed against the real-time
+    budget of a block.
+
+    Resident memory comes from /proc and cache misses from perf events, so
+    both are Linux only. perf events can also be turned off by the kernel's
+    perf_event_paranoid setting, which is common in containers.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include "PluginProcessor.h"
+#include "Scaling.h"
+
+#if JUCE_LINUX
+ #include <linux/perf_event.h>
+ #include <sys/ioctl.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+namespace
+{
+    /** The calling thread's last-level cache references and misses, in user space. */
+    class CacheCounters
+    {
+    public:
+        struct Counts
+        {
+            juce::uint64 references = 0, misses = 0;
+            bool counted = false;
+        };
+
+        CacheCounters()
+        {
+           #if JUCE_LINUX
+            descriptors[0] = openCounter (PERF_COUNT_HW_CACHE_REFERENCES);
+            descriptors[1] = openCounter (PERF_COUNT_HW_CACHE_MISSES);
+           #endif
+        }
+
+        ~CacheCounters()
+        {
+           #if JUCE_LINUX
+            for (auto fd : descriptors)
+                if (fd >= 0)
+                    close (fd);
+           #endif
+        }
+
+        void start() noexcept
+        {
+           #if JUCE_LINUX
+            for (auto fd : descriptors)
+            {
+                ioctl (fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl (fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+           #endif
+        }
+
+        Counts stop() noexcept
+        {
+            Counts counts;
+
+           #if JUCE_LINUX
+            if (descriptors[0] < 0 || descriptors[1] < 0)
+                return counts;
+
+            for (auto fd : descriptors)
+                ioctl (fd, PERF_EVENT_IOC_DISABLE, 0);
+
+            counts.counted = read (descriptors[0], &counts.references, sizeof (counts.references)) == sizeof (counts.references)
+                          && read (descriptors[1], &counts.misses, sizeof (counts.misses)) == sizeof (counts.misses);
+           #endif
+
+            return counts;
+        }
+
+    private:
+       #if JUCE_LINUX
+        static int openCounter (juce::uint64 event) noexcept
+        {
+            perf_event_attr attributes {};
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.size = sizeof (attributes);
+            attributes.config = event;
+            attributes.disabled = 1;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+
+            // this thread, on whichever CPU it runs
+            return (int) syscall (SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+        }
+       #endif
+
+        int descriptors[2] { -1, -1 };
+
+        JUCE_DECLARE_NON_COPYABLE (CacheCounters)
+    };
+
+    /** Resident memory of the whole process, or -1 where it can't be read. */
+    juce::int64 getResidentBytes()
+    {
+       #if JUCE_LINUX
+        std::ifstream statm ("/proc/self/statm");
+        juce::int64 size = 0, resident = 0;
+
+        if (statm >> size >> resident)
+            return resident * (juce::int64) sysconf (_SC_PAGESIZE);
+       #endif
+
+        return -1;
+    }
+
+    //==============================================================================
+    /** A node of the graph, with its own buffers as a host would give it. */
+    struct Instance
+    {
+        explicit Instance (const ScalingOptions& options)
+        {
+            // every instance runs the settings asked for, unless --set turns the governor back on
+            if (auto* governor = processor.apvts.getParameter ("GOVERNOR"))
+                governor->setValueNotifyingHost (0.0f);
+
+            auto& keys = options.parameters.getAllKeys();
+            for (int i = 0; i < keys.size(); ++i)
+                if (auto* parameter = processor.apvts.getParameter (keys[i]))
+                    parameter->setValueNotifyingHost (parameter->getValueForText (options.parameters.getAllValues()[i]));
+
+            juce::AudioProcessor::BusesLayout layout;
+            layout.inputBuses.add (juce::AudioChannelSet::stereo());
+            layout.outputBuses.add (juce::AudioChannelSet::stereo());
+            processor.setBusesLayout (layout);
+            processor.prepareToPlay (options.sampleRate, options.blockSize);
+            buffer.setSize (2, options.blockSize);
+        }
+
+        ~Instance()
+        {
+            processor.releaseResources();
+        }
+
+        void process (const juce::AudioBuffer<float>& input)
+        {
+            buffer.makeCopyOf (input, true);
+            processor.processBlock (buffer, midi);
+        }
+
+        EZDistortionAudioProcessor processor;
+        juce::AudioBuffer<float> buffer;
+        juce::MidiBuffer midi;
+    };
+
+    struct Result
+    {
+        double seconds = 0.0, worstCycle = 0.0;
+        int numOverruns = 0;
+        CacheCounters::Counts cache;
+    };
+
+    /** Processes every instance numWarmUpCycles + numCycles times on numThreads threads,
+        timing the last numCycles.
+    */
+    Result drive (juce::OwnedArray<Instance>& instances, const juce::OwnedArray<juce::AudioBuffer<float>>& inputs,
+                  int numThreads, int numWarmUpCycles, int numCycles, double budget)
+    {
+        auto numTotalCycles = numWarmUpCycles + numCycles;
+        std::atomic<int> started { 0 }, finished { 0 }, next { 0 };
+        std::vector<CacheCounters::Counts> counts ((size_t) numThreads);
+
+        auto work = [&] (int cycle)
+        {
+            for (int i; (i = next.fetch_add (1, std::memory_order_relaxed)) < instances.size();)
+                instances[i]->process (*inputs[cycle % inputs.size()]);
+        };
+
+        // Helpers spin rather than wait on an event, as a host's workers do within a cycle
+        auto helper = [&] (int index)
+        {
+            CacheCounters counters;
+
+            for (int cycle = 1; cycle <= numTotalCycles; ++cycle)
+            {
+                while (started.load (std::memory_order_acquire) < cycle)
+                    std::this_thread::yield();
+
+                if (cycle == numWarmUpCycles + 1)
+                    counters.start();
+
+                work (cycle);
+                finished.fetch_add (1, std::memory_order_acq_rel);
+            }
+
+            counts[(size_t) index] = counters.stop();
+        };
+
+        std::vector<std::thread> helpers;
+
+        for (int index = 1; index < numThreads; ++index)
+            helpers.emplace_back (helper, index);
+
+        CacheCounters counters;
+        Result result;
+
+        for (int cycle = 1; cycle <= numTotalCycles; ++cycle)
+        {
+            if (cycle == numWarmUpCycles + 1)
+                counters.start();
+
+            // Every helper has finished the last cycle, so nobody is reading these
+            next.store (0, std::memory_order_relaxed);
+            finished.store (0, std::memory_order_relaxed);
+
+            auto start = juce::Time::getHighResolutionTicks();
+            started.store (cycle, std::memory_order_release);
+            work (cycle);
+
+            while (finished.load (std::memory_order_acquire) < numThreads - 1)
+                std::this_thread::yield();
+
+            auto elapsed = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start);
+
+            if (cycle > numWarmUpCycles)
+            {
+                result.seconds += elapsed;
+                result.worstCycle = juce::jmax (result.worstCycle, elapsed);
+                result.numOverruns += elapsed > budget ? 1 : 0;
+            }
+        }
+
+        counts[0] = counters.stop();
+
+        for (auto& thread : helpers)
+            thread.join();
+
+        result.cache.counted = true;
+
+        for (auto& c : counts)
+        {
+            result.cache.references += c.references;
+            result.cache.misses += c.misses;
+            result.cache.counted = result.cache.counted && c.counted;
+        }
+
+        return result;
+    }
+
+    /** Runs a block through each new instance, so its buffers are touched and its table
+        requested, then gives the table builders a moment.
+    */
+    void addInstances (juce::OwnedArray<Instance>& instances, int numInstances, const ScalingOptions& options,
+                       const juce::AudioBuffer<float>& input)
+    {
+        for (int i = instances.size(); i < numInstances; ++i)
+            instances.add (new Instance (options))->process (input);
+
+        juce::Thread::sleep (100);
+    }
+
+    juce::String formatKilobytes (juce::int64 bytes)
+    {
+        return bytes < 0 ? juce::String ("n/a") : juce::String ((double) bytes / 1024.0, 0) + " kB";
+    }
+}
+
+//==============================================================================
+juce::Array<juce::var> runScaling (const ScalingOptions& options)
+{
+    auto threadCounts = options.threadCounts;
+
+    if (threadCounts.isEmpty())
+    {
+        auto numCores = juce::jmax (1, (int) std::thread::hardware_concurrency());
+
+        for (int n = 1; n < numCores; n *= 2)
+            threadCounts.add (n);
+
+        threadCounts.add (numCores);
+    }
+
+    juce::Random random (1234);
+    juce::OwnedArray<juce::AudioBuffer<float>> inputs;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        auto* input = inputs.add (new juce::AudioBuffer<float> (2, options.blockSize));
+
+        for (int channel = 0; channel < 2; ++channel)
+            for (int sample = 0; sample < options.blockSize; ++sample)
+                input->setSample (channel, sample, random.nextFloat() - 0.5f);
+    }
+
+    auto budget = options.blockSize / options.sampleRate;
+    auto numCycles = juce::jmax (1, (int) (options.seconds / budget));
+    auto numWarmUpCycles = juce::jmax (1, numCycles / 10);
+    juce::SharedResourcePointer<TransferTableBuilder::Cache> tables;
+    juce::Array<juce::var> results;
+
+    for (auto numInstances : options.instanceCounts)
+    {
+        juce::OwnedArray<Instance> instances;
+        auto before = getResidentBytes();
+        addInstances (instances, 1, options, *inputs[0]);
+        auto withOne = getResidentBytes();
+        addInstances (instances, numInstances, options, *inputs[0]);
+        auto withAll = getResidentBytes();
+
+        // The first instance also pays for what the others share
+        auto first = before < 0 ? -1 : withOne - before;
+        auto each = before < 0 || numInstances < 2 ? first : (withAll - withOne) / (numInstances - 1);
+
+        std::cout << std::endl << numInstances << " instances: " << formatKilobytes (first) << " resident for the first, "
+                  << formatKilobytes (each) << " for each after it, " << tables->getNumLiveEntries() << " shared tables" << std::endl
+                  << "threads  ns/sample   realtime instances  worst cycle  overruns  cache misses/sample  miss rate" << std::endl;
+
+        for (auto numThreads : threadCounts)
+        {
+            auto result = drive (instances, inputs, numThreads, numWarmUpCycles, numCycles, budget);
+            auto numSamples = (double) numInstances * numCycles * options.blockSize;
+            auto nsPerSample = result.seconds * 1.0e9 / numSamples;
+            auto realtimeInstances = numSamples / options.sampleRate / result.seconds;
+            auto missesPerSample = (double) result.cache.misses / numSamples;
+            auto missRate = result.cache.references > 0 ? (double) result.cache.misses / (double) result.cache.references : 0.0;
+
+            std::cout << juce::String (numThreads).paddedRight (' ', 9)
+                      << juce::String (nsPerSample, 3).paddedRight (' ', 12)
+                      << juce::String (realtimeInstances, 1).paddedRight (' ', 20)
+                      << (juce::String (100.0 * result.worstCycle / budget, 0) + "%").paddedRight (' ', 13)
+                      << juce::String (result.numOverruns).paddedRight (' ', 10)
+                      << (result.cache.counted ? juce::String (missesPerSample, 3) : juce::String ("n/a")).paddedRight (' ', 21)
+                      << (result.cache.counted ? juce::String (100.0 * missRate, 1) + "%" : juce::String ("n/a")) << std::endl;
+
+            auto* row = new juce::DynamicObject();
+            row->setProperty ("instances", numInstances);
+            row->setProperty ("threads", numThreads);
+            row->setProperty ("blockSize", options.blockSize);
+            row->setProperty ("nsPerSample", nsPerSample);
+            row->setProperty ("realtimeInstances", realtimeInstances);
+            row->setProperty ("worstCycle", result.worstCycle / budget);
+            row->setProperty ("overruns", result.numOverruns);
+            row->setProperty ("firstInstanceBytes", first);
+            row->setProperty ("instanceBytes", each);
+
+            if (result.cache.counted)
+            {
+                row->setProperty ("cacheMissesPerSample", missesPerSample);
+                row->setProperty ("cacheMissRate", missRate);
+            }
+
+            results.add (row);
+        }
+    }
+
+    return results;
+}
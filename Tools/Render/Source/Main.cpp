@@ -0,0 +1,198 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    ezrender: renders audio files through EZ Distortion without a host or UI.
+    Files are spread across a pool of workers, each with its own processor.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <iostream>
+#include "OfflineRenderer.h"
+
+static void printUsage()
+{
+    std::cout << "Usage: ezrender [options] <input files...>\n"
+                 "\n"
+                 "  -p, --set <ID=value>      Sets a parameter, e.g. GAIN=-6 or OVERSAMPLING=4x. Repeatable\n"
+                 "  -a, --automate <ID=list>  Changes a parameter at given times, e.g. GAIN=0:-20,1.5:0 (seconds:value). Repeatable\n"
+                 "  -s, --state <file>        Loads a saved plug-in state before any --set values\n"
+                 "      --save-state <file>   Writes the resulting state, so it can be reused with --state\n"
+                 "      --cab <file>          Loads a cabinet impulse response and sets CAB=On\n"
+                 "  -o, --out-dir <dir>       Where to write the rendered files (default: next to each input)\n"
+                 "      --suffix <text>       Appended to each output name (default: _ez)\n"
+                 "      --format <wav|aiff>   Output format (default: same as the input)\n"
+                 "  -b, --block-size <n>      Samples per processBlock call (default: 512)\n"
+                 "  -j, --jobs <n>            Number of files rendered in parallel (default: one per core)\n"
+                 "  -h, --help\n";
+}
+
+static int fail (const juce::String& message)
+{
+    std::cerr << "ezrender: " << message << std::endl;
+    return 1;
+}
+
+int main (int argc, char* argv[])
+{
+    // The parameter tree needs a message manager for its timers, even though it never runs
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    RenderSettings settings;
+    juce::Array<juce::File> inputs;
+    juce::File stateOut;
+    auto numJobs = juce::SystemStats::getNumCpus();
+
+    juce::StringArray args;
+
+    for (int i = 1; i < argc; ++i)
+        args.add (juce::CharPointer_UTF8 (argv[i]));
+
+    for (int i = 0; i < args.size(); ++i)
+    {
+        auto arg = args[i];
+        auto takesValue = arg.startsWith ("-") && ! (arg == "-h" || arg == "--help");
+
+        if (takesValue && i + 1 >= args.size())
+            return fail ("missing value for " + arg);
+
+        auto value = takesValue ? args[i + 1] : juce::String();
+        auto currentDir = juce::File::getCurrentWorkingDirectory();
+
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage();
+            return 0;
+        }
+
+        if (arg == "-p" || arg == "--set")
+        {
+            if (! value.containsChar ('='))
+                return fail ("expected ID=value, got " + value);
+
+            settings.parameters.set (value.upToFirstOccurrenceOf ("=", false, false).trim(),
+                                     value.fromFirstOccurrenceOf ("=", false, false).trim());
+        }
+        else if (arg == "-a" || arg == "--automate")
+        {
+            if (! value.containsChar ('='))
+                return fail ("expected ID=seconds:value,..., got " + value);
+
+            auto id = value.upToFirstOccurrenceOf ("=", false, false).trim();
+            auto points = value.fromFirstOccurrenceOf ("=", false, false).trim();
+            auto existing = settings.automation[id];
+            settings.automation.set (id, existing.isEmpty() ? points : existing + "," + points);
+        }
+        else if (arg == "-s" || arg == "--state")
+        {
+            if (! currentDir.getChildFile (value).loadFileAsData (settings.state))
+                return fail ("can't read state file " + value);
+        }
+        else if (arg == "--save-state")     stateOut = currentDir.getChildFile (value);
+        else if (arg == "--cab")
+        {
+            settings.cabinet = currentDir.getChildFile (value);
+
+            if (! settings.cabinet.existsAsFile())
+                return fail ("can't find impulse response " + value);
+        }
+        else if (arg == "-o" || arg == "--out-dir") settings.outputDirectory = currentDir.getChildFile (value);
+        else if (arg == "--suffix")         settings.suffix = value;
+        else if (arg == "--format")         settings.format = value.toLowerCase();
+        else if (arg == "-b" || arg == "--block-size") settings.blockSize = value.getIntValue();
+        else if (arg == "-j" || arg == "--jobs")       numJobs = value.getIntValue();
+        else if (! takesValue)
+        {
+            inputs.add (currentDir.getChildFile (arg));
+            continue;
+        }
+        else
+        {
+            return fail ("unknown option " + arg);
+        }
+
+        ++i;
+    }
+
+    if (settings.blockSize <= 0 || numJobs <= 0)
+        return fail ("block size and job count must be positive");
+
+    if (settings.format.isNotEmpty() && settings.format != "wav" && settings.format != "aiff")
+        return fail ("unsupported format " + settings.format);
+
+    if (inputs.isEmpty() && stateOut == juce::File())
+    {
+        printUsage();
+        return 1;
+    }
+
+    for (auto& input : inputs)
+    {
+        if (! input.existsAsFile())
+            return fail ("no such file " + input.getFullPathName());
+
+        if (OfflineRenderer::getOutputFile (input, settings) == input)
+            return fail ("rendering " + input.getFileName() + " would overwrite it, set --suffix or --out-dir");
+    }
+
+    if (settings.outputDirectory != juce::File() && ! settings.outputDirectory.createDirectory())
+        return fail ("can't create " + settings.outputDirectory.getFullPathName());
+
+    // Processors are created and set up here on the message thread, then each one is used by a single worker
+    juce::OwnedArray<OfflineRenderer> renderers;
+    auto numWorkers = juce::jmax (1, juce::jmin (numJobs, inputs.size()));
+
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        auto* renderer = renderers.add (new OfflineRenderer (settings));
+        auto result = renderer->applySettings();
+
+        if (result.failed())
+            return fail (result.getErrorMessage());
+    }
+
+    if (stateOut != juce::File())
+    {
+        juce::MemoryBlock state;
+        renderers[0]->getState (state);
+
+        if (! stateOut.replaceWithData (state.getData(), state.getSize()))
+            return fail ("can't write " + stateOut.getFullPathName());
+    }
+
+    std::atomic<int> nextInput { 0 }, numFailed { 0 };
+    juce::CriticalSection outputLock;
+    juce::ThreadPool pool (numWorkers);
+
+    for (auto* renderer : renderers)
+    {
+        pool.addJob ([&, renderer]
+        {
+            for (int i = nextInput++; i < inputs.size(); i = nextInput++)
+            {
+                auto output = OfflineRenderer::getOutputFile (inputs[i], settings);
+                auto result = renderer->render (inputs[i], output);
+
+                const juce::ScopedLock sl (outputLock);
+
+                if (result.wasOk())
+                {
+                    std::cout << inputs[i].getFileName() << " -> " << output.getFullPathName() << std::endl;
+                }
+                else
+                {
+                    std::cerr << "ezrender: " << result.getErrorMessage() << std::endl;
+                    ++numFailed;
+                }
+            }
+        });
+    }
+
+    // The pool's destructor would give up on long renders, so wait for every job here
+    while (pool.getNumJobs() > 0)
+        juce::Thread::sleep (50);
+
+    return numFailed > 0 ? 1 : 0;
+}
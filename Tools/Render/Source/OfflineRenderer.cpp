@@ -0,0 +1,183 @@
+/*
+  ==============================================================================
+
+    OfflineRenderer.cpp
+
+  ==============================================================================
+*/
+
+#include "OfflineRenderer.h"
+
+OfflineRenderer::OfflineRenderer (const RenderSettings& settingsToUse)
+    : settings (settingsToUse)
+{
+    formats.registerBasicFormats();
+}
+
+juce::Result OfflineRenderer::applySettings()
+{
+    if (! settings.state.isEmpty())
+        processor.setStateInformation (settings.state.getData(), (int) settings.state.getSize());
+
+    // The cabinet reads its file in the background, and a state saved from here should include it
+    if (settings.cabinet != juce::File())
+    {
+        processor.cabinet.loadFile (settings.cabinet);
+        processor.apvts.getParameter ("CAB")->setValueNotifyingHost (1.0f);
+    }
+
+    if (! processor.cabinet.waitUntilReady (cabinetTimeoutMs))
+        return juce::Result::fail ("Timed out loading the cabinet impulse response");
+
+    auto& keys = settings.parameters.getAllKeys();
+    auto& values = settings.parameters.getAllValues();
+
+    for (int i = 0; i < keys.size(); ++i)
+    {
+        auto* parameter = processor.apvts.getParameter (keys[i]);
+
+        if (parameter == nullptr)
+            return juce::Result::fail ("Unknown parameter: " + keys[i]);
+
+        parameter->setValueNotifyingHost (parameter->getValueForText (values[i]));
+    }
+
+    auto& lanes = settings.automation.getAllKeys();
+
+    for (int i = 0; i < lanes.size(); ++i)
+    {
+        auto index = PresetBank::indexOf (lanes[i]);
+
+        if (index < 0)
+            return juce::Result::fail ("Unknown parameter: " + lanes[i]);
+
+        auto* parameter = processor.apvts.getParameter (lanes[i]);
+        automationStart.push_back ({ index, parameter->getValue() });
+
+        for (auto& point : juce::StringArray::fromTokens (settings.automation.getAllValues()[i], ",", ""))
+        {
+            if (! point.containsChar (':'))
+                return juce::Result::fail ("Expected seconds:value, got " + point);
+
+            automation.push_back ({ point.upToFirstOccurrenceOf (":", false, false).getDoubleValue(), index,
+                                    parameter->getValueForText (point.fromFirstOccurrenceOf (":", false, false).trim()) });
+        }
+    }
+
+    std::stable_sort (automation.begin(), automation.end(),
+                      [] (const AutomationPoint& a, const AutomationPoint& b) { return a.seconds < b.seconds; });
+
+    return juce::Result::ok();
+}
+
+void OfflineRenderer::setParameter (int parameterIndex, float value)
+{
+    processor.apvts.getParameter (PresetBank::parameterIds[parameterIndex])->setValueNotifyingHost (value);
+}
+
+juce::Result OfflineRenderer::render (const juce::File& input, const juce::File& output)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader (formats.createReaderFor (input));
+
+    if (reader == nullptr)
+        return juce::Result::fail ("Can't read " + input.getFullPathName());
+
+    auto numChannels = (int) reader->numChannels;
+    auto channelSet = juce::AudioChannelSet::canonicalChannelSet (numChannels);
+
+    juce::AudioProcessor::BusesLayout layout;
+    layout.inputBuses.add (channelSet);
+    layout.outputBuses.add (channelSet);
+
+    if (! processor.setBusesLayout (layout))
+        return juce::Result::fail (input.getFileName() + ": " + juce::String (numChannels) + " channels aren't supported");
+
+    auto* format = formats.findFormatForFileExtension (output.getFileExtension());
+
+    if (format == nullptr)
+        return juce::Result::fail ("No audio format for " + output.getFileName());
+
+    // Keep the input's bit depth where the output format has it
+    auto bitDepth = format->getPossibleBitDepths().contains ((int) reader->bitsPerSample) ? (int) reader->bitsPerSample : 24;
+
+    output.deleteFile();
+    std::unique_ptr<juce::OutputStream> stream (output.createOutputStream());
+
+    if (stream == nullptr)
+        return juce::Result::fail ("Can't write " + output.getFullPathName());
+
+    std::unique_ptr<juce::AudioFormatWriter> writer (format->createWriterFor (stream.get(), reader->sampleRate, (unsigned int) numChannels,
+                                                                             bitDepth, reader->metadataValues, 0));
+
+    if (writer == nullptr)
+        return juce::Result::fail ("Can't write " + output.getFullPathName());
+
+    stream.release();
+
+    // Points at the very start are applied before preparing, so the file doesn't start with a glide
+    auto sampleOf = [&] (const AutomationPoint& point) { return (juce::int64) std::llround (point.seconds * reader->sampleRate); };
+    size_t nextPoint = 0;
+
+    for (auto& start : automationStart)
+        setParameter (start.first, start.second);
+
+    for (; nextPoint < automation.size() && sampleOf (automation[nextPoint]) <= 0; ++nextPoint)
+        setParameter (automation[nextPoint].parameterIndex, automation[nextPoint].value);
+
+    processor.setNonRealtime (true);
+    processor.prepareToPlay (reader->sampleRate, settings.blockSize);
+
+    // The response is resampled for this file's rate before anything is rendered
+    if (! processor.cabinet.waitUntilReady (cabinetTimeoutMs))
+        return juce::Result::fail ("Timed out preparing the cabinet impulse response");
+
+    // Reading past the end of the file gives silence, which flushes out the delayed signal and lets the cabinet ring out
+    auto latency = (juce::int64) processor.getLatencySamples();
+    auto tail = (juce::int64) juce::roundToInt (processor.getTailLengthSeconds() * reader->sampleRate);
+    auto totalLength = reader->lengthInSamples + latency + tail;
+    auto samplesToSkip = latency;
+
+    juce::AudioBuffer<float> buffer (numChannels, settings.blockSize);
+    juce::MidiBuffer midi;
+    auto result = juce::Result::ok();
+
+    for (juce::int64 position = 0; position < totalLength; position += settings.blockSize)
+    {
+        auto numSamples = (int) juce::jmin ((juce::int64) settings.blockSize, totalLength - position);
+        buffer.setSize (numChannels, numSamples, false, false, true);
+
+        reader->read (&buffer, 0, numSamples, position, true, true);
+
+        // The processor splits the block where each point lands. Points that don't fit the queue wait for the next block.
+        for (; nextPoint < automation.size(); ++nextPoint)
+        {
+            auto& point = automation[nextPoint];
+            auto offset = sampleOf (point) - position;
+
+            if (offset >= numSamples || ! processor.queueParameterEvent ({ (int) juce::jmax ((juce::int64) 0, offset), point.parameterIndex, point.value }))
+                break;
+        }
+
+        processor.processBlock (buffer, midi);
+        midi.clear();
+
+        auto skipped = (int) juce::jmin (samplesToSkip, (juce::int64) numSamples);
+        samplesToSkip -= skipped;
+
+        if (! writer->writeFromAudioSampleBuffer (buffer, skipped, numSamples - skipped))
+        {
+            result = juce::Result::fail ("Write failed: " + output.getFullPathName());
+            break;
+        }
+    }
+
+    processor.releaseResources();
+    return result;
+}
+
+juce::File OfflineRenderer::getOutputFile (const juce::File& input, const RenderSettings& settings)
+{
+    auto directory = settings.outputDirectory.isDirectory() ? settings.outputDirectory : input.getParentDirectory();
+    auto extension = settings.format.isNotEmpty() ? "." + settings.format : input.getFileExtension();
+    return directory.getChildFile (input.getFileNameWithoutExtension() + settings.suffix + extension);
+}
@@ -0,0 +1,70 @@
+/*
+  ==============================================================================
+
+    OfflineRenderer.h
+    Streams audio files through one EZDistortionAudioProcessor in fixed size
+    blocks. Only a single block is held in memory, so the length of a file
+    doesn't matter. The plugin's latency is trimmed from the start and
+    flushed out at the end, so every output lines up with its input.
+    Automation points are queued as parameter events, so they land on
+    their exact sample whatever the block size.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+/** What to render and how, shared read-only by all workers. */
+struct RenderSettings
+{
+    int blockSize = 512;
+    juce::MemoryBlock state;                // applied before the parameter values
+    juce::File cabinet;                     // an impulse response to load after the state, switching CAB on
+    juce::StringPairArray parameters;       // parameter ID -> value text, as the host would show it
+    juce::StringPairArray automation;       // parameter ID -> "seconds:value,seconds:value...", value text as above
+    juce::File outputDirectory;             // next to each input when this doesn't exist
+    juce::String suffix = "_ez";
+    juce::String format;                    // "wav" or "aiff", the input's format when empty
+};
+
+//==============================================================================
+class OfflineRenderer
+{
+public:
+    explicit OfflineRenderer (const RenderSettings& settingsToUse);
+
+    /** Loads the state, the parameter values and the automation. Call once, from the message thread. */
+    juce::Result applySettings();
+
+    /** Renders one file. Each renderer must only be used by one thread at a time. */
+    juce::Result render (const juce::File& input, const juce::File& output);
+
+    void getState (juce::MemoryBlock& destData)     { processor.getStateInformation (destData); }
+
+    static juce::File getOutputFile (const juce::File& input, const RenderSettings& settings);
+
+private:
+    struct AutomationPoint
+    {
+        double seconds;
+        int parameterIndex;     // into PresetBank::parameterIds
+        float value;            // normalised
+    };
+
+    void setParameter (int parameterIndex, float value);
+
+    static constexpr int cabinetTimeoutMs = 30000;
+
+    const RenderSettings& settings;
+    juce::AudioFormatManager formats;
+    EZDistortionAudioProcessor processor;
+
+    // Sorted by time. Every file starts from the automated parameters' values before their first point.
+    std::vector<AutomationPoint> automation;
+    std::vector<std::pair<int, float>> automationStart;
+
+    JUCE_DECLARE_NON_COPYABLE (OfflineRenderer)
+};